@@ -0,0 +1,58 @@
+#include "fixtures.h"
+
+#include <benchmark/benchmark.h>
+
+#include <limits>
+
+using namespace benchmarks;
+
+namespace {
+/* Deltas are limited to 64 KiB, so the payloads stay below */
+void payload_sizes(benchmark::internal::Benchmark* bench) {
+    bench->Arg(64)->Arg(1024)->Arg(16 * 1024);
+}
+
+/** Appends a keyframe per iteration, every frame being a keyframe */
+template <class Writer>
+void append_keyframe(benchmark::State& state) {
+    temporary_file file;
+    const auto data = payload(state.range(0));
+
+    Writer stream{file.filepath(), 1, "", 0};
+    for (auto _ : state) {
+        stream.append_keyframe(data.data(), data.size());
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+
+/** Appends a delta per iteration, all of them following a single keyframe */
+template <class Writer>
+void append_delta(benchmark::State& state) {
+    temporary_file file;
+    const auto data = payload(state.range(0));
+
+    Writer stream{file.filepath(), std::numeric_limits<std::uint32_t>::max(), "", 0};
+    stream.append_keyframe(data.data(), data.size());
+    for (auto _ : state) {
+        stream.append_delta(data.data(), data.size());
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+}
+
+#define APPEND_BENCHMARKS(pattern)                                                                 \
+    BENCHMARK_TEMPLATE(pattern, mmap_writer<offsets_only_cache>)->Apply(payload_sizes);            \
+    BENCHMARK_TEMPLATE(pattern, mmap_writer<full_cache>)->Apply(payload_sizes);                    \
+    BENCHMARK_TEMPLATE(pattern, stream_writer<offsets_only_cache>)->Apply(payload_sizes);          \
+    BENCHMARK_TEMPLATE(pattern, stream_writer<full_cache>)->Apply(payload_sizes);                  \
+    BENCHMARK_TEMPLATE(pattern, mmap_writer<offsets_only_cache, checksum_mode::eager>)             \
+        ->Apply(payload_sizes);                                                                    \
+    BENCHMARK_TEMPLATE(pattern, stream_writer<offsets_only_cache, checksum_mode::eager>)           \
+        ->Apply(payload_sizes)
+
+APPEND_BENCHMARKS(append_keyframe);
+APPEND_BENCHMARKS(append_delta);
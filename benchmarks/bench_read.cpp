@@ -0,0 +1,139 @@
+#include "fixtures.h"
+
+#include <benchmark/benchmark.h>
+
+#include <iterator>
+#include <memory>
+#include <random>
+
+using namespace benchmarks;
+
+namespace {
+constexpr auto frames_per_keyframe = 32u;
+constexpr auto frame_count = std::size_t{1} << 17;
+constexpr auto frame_size = std::size_t{256};
+
+/* Random seeks measured per iteration */
+constexpr auto seek_batch = 64;
+
+/** The file read by the benchmarks, written on first use */
+template <checksum_mode Checksums>
+const char* input_file() {
+    static const auto file = [] {
+        auto file = std::make_unique<temporary_file>();
+        fill<stream_writer<offsets_only_cache, Checksums>>(file->filepath(), frames_per_keyframe,
+                                                           frame_count, frame_size);
+        return file;
+    }();
+    return file->filepath();
+}
+
+/** Runs `batch` once per iteration.
+ *
+ * Readers verifying checksums read a file with checksums, the others one
+ * without. With a cold page cache the file is evicted from the page cache
+ * and opened by a new stream, with empty caches, before each batch. The
+ * opening is measured, so the rows include the verification of the whole
+ * file by `checksum_mode::eager` readers. With a warm one a single stream is
+ * used throughout.
+ */
+template <class Reader, page_cache Cache, class Batch>
+void run(benchmark::State& state, Batch batch) {
+    constexpr auto file_checksums =
+        Reader::checksums == checksum_mode::off ? checksum_mode::off : checksum_mode::on_read;
+    const auto path = input_file<file_checksums>();
+    auto stream = std::make_unique<Reader>(path);
+
+    for (auto _ : state) {
+        if (Cache == page_cache::cold) {
+            state.PauseTiming();
+            stream.reset();
+            drop_page_cache(path);
+            state.ResumeTiming();
+            stream = std::make_unique<Reader>(path);
+        }
+
+        batch(*stream);
+    }
+}
+
+/** Reads every frame in order */
+template <class Reader, page_cache Cache>
+void replay(benchmark::State& state) {
+    run<Reader, Cache>(state, [](const Reader& stream) {
+        for (const auto& keyframe : stream) {
+            benchmark::DoNotOptimize(keyframe.get());
+            for (const auto& delta : keyframe) {
+                benchmark::DoNotOptimize(delta.get());
+            }
+        }
+    });
+
+    state.SetItemsProcessed(state.iterations() * frame_count);
+    state.SetBytesProcessed(state.iterations() * frame_count * frame_size);
+}
+
+/** Reads keyframes chosen at random, each seek starting from the beginning */
+template <class Reader, page_cache Cache>
+void seek_keyframe(benchmark::State& state) {
+    std::mt19937_64 gen{0};
+    std::uniform_int_distribution<std::size_t> keyframes{0, (frame_count - 1) /
+                                                                frames_per_keyframe};
+
+    run<Reader, Cache>(state, [&](const Reader& stream) {
+        for (auto i = 0; i < seek_batch; ++i) {
+            benchmark::DoNotOptimize(stream.begin()[keyframes(gen)].get());
+        }
+    });
+
+    state.SetItemsProcessed(state.iterations() * seek_batch);
+}
+
+/** Reads frames chosen at random, walking the deltas from their keyframe */
+template <class Reader, page_cache Cache>
+void seek_frame(benchmark::State& state) {
+    std::mt19937_64 gen{0};
+    std::uniform_int_distribution<std::size_t> frames{0, frame_count - 1};
+
+    run<Reader, Cache>(state, [&](const Reader& stream) {
+        for (auto i = 0; i < seek_batch; ++i) {
+            const auto frame = frames(gen);
+            const auto keyframe = stream.begin()[frame / frames_per_keyframe];
+            if (frame % frames_per_keyframe == 0) {
+                benchmark::DoNotOptimize(keyframe.get());
+            } else {
+                benchmark::DoNotOptimize(
+                    std::next(keyframe.begin(), frame % frames_per_keyframe - 1)->get());
+            }
+        }
+    });
+
+    state.SetItemsProcessed(state.iterations() * seek_batch);
+}
+
+template <checksum_mode Checksums>
+using checked_mmap_reader = mmap_reader<offsets_only_cache, Checksums>;
+
+template <checksum_mode Checksums>
+using checked_stream_reader = stream_reader<offsets_only_cache, Checksums>;
+}
+
+/* Reads wait on the disk with a cold page cache, so the wall time is reported */
+#define READ_BENCHMARKS(pattern, cache)                                                            \
+    BENCHMARK_TEMPLATE(pattern, mmap_reader<offsets_only_cache>, cache)->UseRealTime();            \
+    BENCHMARK_TEMPLATE(pattern, mmap_reader<full_cache>, cache)->UseRealTime();                    \
+    BENCHMARK_TEMPLATE(pattern, stream_reader<offsets_only_cache>, cache)->UseRealTime();          \
+    BENCHMARK_TEMPLATE(pattern, stream_reader<full_cache>, cache)->UseRealTime();                  \
+    BENCHMARK_TEMPLATE(pattern, checked_mmap_reader<checksum_mode::on_read>, cache)                \
+        ->UseRealTime();                                                                           \
+    BENCHMARK_TEMPLATE(pattern, checked_mmap_reader<checksum_mode::eager>, cache)->UseRealTime();  \
+    BENCHMARK_TEMPLATE(pattern, checked_stream_reader<checksum_mode::on_read>, cache)              \
+        ->UseRealTime();                                                                           \
+    BENCHMARK_TEMPLATE(pattern, checked_stream_reader<checksum_mode::eager>, cache)->UseRealTime()
+
+READ_BENCHMARKS(replay, page_cache::warm);
+READ_BENCHMARKS(replay, page_cache::cold);
+READ_BENCHMARKS(seek_keyframe, page_cache::warm);
+READ_BENCHMARKS(seek_keyframe, page_cache::cold);
+READ_BENCHMARKS(seek_frame, page_cache::warm);
+READ_BENCHMARKS(seek_frame, page_cache::cold);
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "cache.h"
+#include "mmap_backend.h"
+#include "posix_file_backend.h"
+#include "stream.h"
+#include "../tools/string_factory.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace benchmarks {
+using namespace protostream;
+
+using tools::string_factory;
+
+template <class Backend, template <class> class Cache, checksum_mode Checksums>
+using bench_stream = stream<with_backend<Backend>,
+                            with_cache<Cache>,
+                            with_checksums<Checksums>,
+                            with_keyframe_factory<string_factory>,
+                            with_delta_factory<string_factory>,
+                            with_proto_header_factory<string_factory>>;
+
+template <template <class> class Cache, checksum_mode Checksums = checksum_mode::off>
+using mmap_writer = bench_stream<mmap_backend<file_mode_t::READ_APPEND>, Cache, Checksums>;
+
+template <template <class> class Cache, checksum_mode Checksums = checksum_mode::off>
+using stream_writer =
+    bench_stream<posix_file_backend<file_mode_t::READ_APPEND>, Cache, Checksums>;
+
+template <template <class> class Cache, checksum_mode Checksums = checksum_mode::off>
+using mmap_reader = bench_stream<mmap_backend<file_mode_t::READ_ONLY>, Cache, Checksums>;
+
+template <template <class> class Cache, checksum_mode Checksums = checksum_mode::off>
+using stream_reader = bench_stream<posix_file_backend<file_mode_t::READ_ONLY>, Cache, Checksums>;
+
+/** Whether the file is evicted from the page cache before each measured batch */
+enum class page_cache { cold, warm };
+
+/** An empty file, removed on destruction.
+ *
+ * The file is created in $PROTOSTREAM_BENCHMARK_DIR, or in /tmp if it is not
+ * set. Cold page cache benchmarks are meaningful only on a disk-backed file
+ * system, as the pages of a tmpfs cannot be evicted.
+ */
+class temporary_file {
+public:
+    temporary_file() {
+        const auto dir = std::getenv("PROTOSTREAM_BENCHMARK_DIR");
+        path = std::string{dir ? dir : "/tmp"} + "/protostream_benchmark.XXXXXX";
+
+        const auto fd = mkstemp(&path[0]);
+        if (fd < 0) {
+            throw std::system_error{errno, std::system_category(), "mkstemp"};
+        }
+        close(fd);
+    }
+
+    temporary_file(const temporary_file&) = delete;
+
+    temporary_file& operator=(const temporary_file&) = delete;
+
+    ~temporary_file() {
+        unlink(path.c_str());
+    }
+
+    const char* filepath() const {
+        return path.c_str();
+    }
+
+private:
+    std::string path;
+};
+
+/** Writes back and evicts the pages of the file from the page cache */
+inline void drop_page_cache(const char* path) {
+    const auto fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        throw std::system_error{errno, std::system_category(), "open"};
+    }
+
+    const auto error = fdatasync(fd) != 0 ? errno : posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    if (error != 0) {
+        throw std::system_error{error, std::system_category(), "posix_fadvise"};
+    }
+}
+
+/** A payload of the given size with pseudo-random contents */
+inline std::vector<std::uint8_t> payload(std::size_t size, std::uint32_t seed = 0) {
+    std::mt19937 gen{seed};
+    std::vector<std::uint8_t> data(size);
+    for (auto& byte : data) {
+        byte = static_cast<std::uint8_t>(gen());
+    }
+    return data;
+}
+
+/** Writes `frame_count` frames of `frame_size` bytes, every `frames_per_kf`-th
+ * of them being a keyframe */
+template <class Writer>
+void fill(const char* path,
+          std::uint32_t frames_per_kf,
+          std::size_t frame_count,
+          std::size_t frame_size) {
+    const auto data = payload(frame_size);
+
+    Writer stream{path, frames_per_kf, "", 0};
+    for (auto frame = std::size_t{0}; frame < frame_count; ++frame) {
+        if (frame % frames_per_kf == 0) {
+            stream.append_keyframe(data.data(), data.size());
+        } else {
+            stream.append_delta(data.data(), data.size());
+        }
+    }
+}
+}
@@ -1,82 +1,167 @@
 #pragma once
 
 #include "header.h"
+#include "probes.h"
+#include "stats.h"
 
+#include <array>
+#include <cstring>
 #include <experimental/optional>
-#include <unordered_map>
+#include <map>
+#include <utility>
 
 namespace protostream {
 
+namespace detail {
+/** The keyframe offsets known to a cache */
+class offset_index {
+public:
+    std::experimental::optional<offset_t> find(keyframe_id_t keyframe_id) const {
+        const auto it = offsets.find(keyframe_id);
+        if (it == offsets.end()) {
+            return {};
+        } else {
+            return {it->second};
+        }
+    }
+
+    std::experimental::optional<std::pair<keyframe_id_t, offset_t>> nearest_known(
+        keyframe_id_t keyframe_id) const {
+        auto it = offsets.upper_bound(keyframe_id);
+        if (it == offsets.begin()) {
+            return {};
+        } else {
+            --it;
+            return {*it};
+        }
+    }
+
+    /** Records the offset of a keyframe and the targets of its skiplist
+     * (`height` links, no_keyframe if absent) */
+    void insert(keyframe_id_t keyframe_id,
+                offset_t offset,
+                const offset_t* skiplist,
+                unsigned height) {
+        offsets.emplace(keyframe_id, offset);
+        for (auto i = 0u; i < height; ++i) {
+            if (skiplist[i] != no_keyframe) {
+                offsets.emplace(keyframe_id + (keyframe_id_t{1} << i), skiplist[i]);
+            }
+        }
+    }
+
+    /** Forgets the keyframes from `keyframe_id` on */
+    void erase_from(keyframe_id_t keyframe_id) {
+        offsets.erase(offsets.lower_bound(keyframe_id), offsets.end());
+    }
+
+    std::size_t memory_usage() const {
+        /* A red-black tree node holds three pointers and the colour */
+        using node = decltype(offsets)::value_type;
+        return offsets.size() * (sizeof(node) + 4 * sizeof(void*));
+    }
+
+private:
+    /* Ordered, so that the nearest known predecessor of a keyframe can be found */
+    std::map<keyframe_id_t, offset_t> offsets;
+};
+}
+
 /** A CRTP base class for caches
  *
  * `Derived` is the CRTP derived class
  * `Backend` is the backend this cache will operate on
+ * `Index` stores the known keyframe offsets (see `detail::offset_index`)
  *
- *  The derived class must provide the following member:
+ *  The derived class must provide the following members:
+ *    * Derived(Backend& backend, const keyframe_layout& layout)
  *    * reduced_keyframe_header header_at(offset_t offset)
  *        returns the header at offset `offset`, possibly a cached one
+ *  and may hide `memory_usage` and `forget_from` if it caches anything else.
+ *  It may declare `static constexpr bool thread_safe = true` if it can be
+ *  used by several threads at once (see `stream::async_read_keyframe`).
  */
-template <class Derived, class Backend>
+template <class Derived, class Backend, class Index = detail::offset_index>
 class cache_base {
 public:
     /** Returns the offset of the given keyframe, if known */
     std::experimental::optional<offset_t> offset_of(keyframe_id_t keyframe_id) const {
-        const auto it = offsets.find(keyframe_id);
-        if (it == offsets.end()) {
-            return {};
-        } else {
-            return {it->second};
-        }
+        return offsets.find(keyframe_id);
+    }
+
+    /** Returns the number and the offset of the last known keyframe not
+     * following the given one, if any */
+    std::experimental::optional<std::pair<keyframe_id_t, offset_t>> nearest_known(
+        keyframe_id_t keyframe_id) const {
+        return offsets.nearest_known(keyframe_id);
     }
 
     /** Returns the `level`th link in the skiplist associated with the keyframe
    * with offset `offset */
     offset_t link_at(offset_t offset, unsigned level) {
-        assert(level < fields::skiplist_height);
+        assert(level < layout.skiplist_height);
         assert(offset != no_keyframe);
 
+        stats().on_link_hop();
+
         const auto& header = self()->header_at(offset);
         const auto kf_num = header.template get<fields::kf_num>();
 
-        const auto it = offsets.find(kf_num + (1 << level));
-        if (it != offsets.end()) {
-            return it->second;
+        if (const auto known = offsets.find(kf_num + (keyframe_id_t{1} << level))) {
+            stats().on_cache_hit();
+            return *known;
         }
-
-        offsets.emplace(kf_num, offset);
+        stats().on_cache_miss();
+        PROTOSTREAM_PROBE(link_cache_miss, offset, level);
 
         const auto ptr = backend.read(offset + fields::skiplist_offset(),
-                                      sizeof(offset_t) * fields::skiplist_height);
-
-        const auto skiplist = reinterpret_cast<const offset_t*>(detail::as_ptr(ptr));
+                                      sizeof(offset_t) * layout.skiplist_height);
 
-        for (auto i = 0u; i < fields::skiplist_height; ++i) {
-            const auto link_offset = detail::betoh<offset_t>(skiplist[i]);
+        std::array<offset_t, fields::max_skiplist_height> skiplist;
+        layout.read_links(detail::as_ptr(ptr), skiplist.data());
 
-            if (link_offset != no_keyframe) {
-                if (link_offset <= offset) {
-                    throw std::runtime_error{"Back link found"};
-                }
-
-                offsets.emplace(kf_num + (1 << i), link_offset);
+        for (auto i = 0u; i < layout.skiplist_height; ++i) {
+            if (skiplist[i] != no_keyframe && skiplist[i] <= offset) {
+                throw std::runtime_error{"Back link found"};
             }
         }
 
-        return detail::betoh<offset_t>(skiplist[level]);
+        offsets.insert(kf_num, offset, skiplist.data(), layout.skiplist_height);
+
+        return skiplist[level];
+    }
+
+    /** Forgets the keyframes from `keyframe_id` on, which are placed at
+     * `offset` or further, e.g. after the file was truncated */
+    void forget_from(keyframe_id_t keyframe_id, offset_t /* offset */) {
+        offsets.erase_from(keyframe_id);
+    }
+
+    /** Returns the estimated number of bytes used by the cached offsets */
+    std::size_t memory_usage() const {
+        return offsets.memory_usage();
     }
 
 protected:
-    explicit cache_base(Backend& backend) : backend{backend} {
+    cache_base(Backend& backend, const keyframe_layout& layout, Index offsets = Index{})
+        : backend{backend}, layout{layout}, offsets{std::move(offsets)} {
     }
 
     /** Returns the keyframe header read from the backend */
     reduced_keyframe_header retrieve(offset_t offset) const {
-        return reduced_keyframe_header::read(backend, offset);
+        const auto ptr = backend.read(offset, layout.header_size());
+        return layout.read(detail::as_ptr(ptr));
+    }
+
+    /** Returns the statistics policy of the backend (see `with_stats`) */
+    decltype(auto) stats() const {
+        return detail::stats_of(backend);
     }
 
 private:
     Backend& backend;
-    std::unordered_map<keyframe_id_t, offset_t> offsets;
+    keyframe_layout layout;
+    Index offsets;
 
     Derived* self() {
         return static_cast<Derived*>(this);
@@ -93,7 +178,9 @@ protected:
     using base::retrieve;
 
 public:
-    explicit offsets_only_cache(Backend& backend) : base{backend} {
+    explicit offsets_only_cache(Backend& backend,
+                                const keyframe_layout& layout = keyframe_layout{})
+        : base{backend, layout} {
     }
 
     reduced_keyframe_header header_at(offset_t offset) const {
@@ -108,23 +195,40 @@ class full_cache : public cache_base<full_cache<Backend>, Backend> {
 
 protected:
     using base::retrieve;
+    using base::stats;
 
 public:
-    explicit full_cache(Backend& backend) : base{backend} {
+    explicit full_cache(Backend& backend, const keyframe_layout& layout = keyframe_layout{})
+        : base{backend, layout} {
     }
 
     reduced_keyframe_header header_at(offset_t offset) {
         auto it = headers.find(offset);
         if (it != headers.end()) {
+            stats().on_cache_hit();
             return it->second;
         } else {
+            stats().on_cache_miss();
             auto header = retrieve(offset);
             headers.emplace(offset, header);
             return header;
         }
     }
 
+    void forget_from(keyframe_id_t keyframe_id, offset_t offset) {
+        base::forget_from(keyframe_id, offset);
+        headers.erase(headers.lower_bound(offset), headers.end());
+    }
+
+    /** Returns the estimated number of bytes used by the cached offsets and headers */
+    std::size_t memory_usage() const {
+        /* A red-black tree node holds three pointers and the colour */
+        using node = typename decltype(headers)::value_type;
+        return base::memory_usage() + headers.size() * (sizeof(node) + 4 * sizeof(void*));
+    }
+
 private:
-    std::unordered_map<offset_t, reduced_keyframe_header> headers;
+    /* Ordered, so that the headers past a truncation point are dropped at once */
+    std::map<offset_t, reduced_keyframe_header> headers;
 };
 }
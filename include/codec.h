@@ -0,0 +1,355 @@
+#pragma once
+
+#include "common.h"
+#include "config.h"
+#include "utils.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif /* HAVE_ZSTD */
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif /* HAVE_LZ4 */
+
+namespace protostream {
+
+/** Codecs compress keyframe and delta payloads (see `with_codec`).
+ *
+ * A codec must provide the following members:
+ *   * static constexpr std::uint8_t id
+ *       a unique identifier recorded in the file header
+ *   * static std::vector<std::uint8_t> compress(const std::uint8_t* data, std::size_t size)
+ *   * static void decompress(const std::uint8_t* data,
+ *                            std::size_t size,
+ *                            std::uint8_t* into,
+ *                            std::size_t original_size)
+ *       decompresses exactly `original_size` bytes into `into`, throwing
+ *       std::runtime_error if the data is corrupted
+ */
+
+/** Stores the payloads as they are. This is the default codec.
+ *
+ * Streams using it do not frame the payloads at all, so the members below
+ * are never called by them.
+ */
+struct identity_codec {
+    static constexpr std::uint8_t id = 0;
+
+    static std::vector<std::uint8_t> compress(const std::uint8_t* data, std::size_t size) {
+        return {data, data + size};
+    }
+
+    static void decompress(const std::uint8_t* data,
+                           std::size_t size,
+                           std::uint8_t* into,
+                           std::size_t original_size) {
+        if (size != original_size) {
+            throw std::runtime_error{"Corrupted frame"};
+        }
+        memcpy(into, data, size);
+    }
+};
+
+/** A fast LZ77 codec with no external dependencies.
+ *
+ * The compressed data is a sequence of LZ4-like sequences: a token byte with
+ * the literal length in its high and the match length (minus 4) in its low
+ * nibble, the length extensions (runs of 255-valued bytes), the literals and
+ * a 2-byte little-endian match offset. The last sequence has literals only.
+ */
+struct lz_codec {
+    static constexpr std::uint8_t id = 1;
+
+    static std::vector<std::uint8_t> compress(const std::uint8_t* data, std::size_t size) {
+        constexpr auto no_position = std::numeric_limits<std::uint32_t>::max();
+
+        std::vector<std::uint8_t> result;
+        result.reserve(size + size / 255 + 16);
+
+        /* Sized to the input, as most payloads are much smaller than the
+         * table and filling it would dominate their compression */
+        auto bits = 4u;
+        while (bits < hash_bits && (std::size_t{1} << bits) < size) {
+            ++bits;
+        }
+        std::array<std::uint32_t, std::size_t{1} << hash_bits> table;
+        std::fill_n(table.begin(), std::size_t{1} << bits, no_position);
+
+        std::size_t anchor = 0;
+        std::size_t pos = 0;
+        while (pos + min_match <= size) {
+            const auto sequence = read32(data + pos);
+            auto& entry = table[hash(sequence, bits)];
+            const auto candidate = entry;
+            entry = static_cast<std::uint32_t>(pos);
+
+            if (candidate == no_position || pos - candidate > max_offset ||
+                read32(data + candidate) != sequence) {
+                ++pos;
+                continue;
+            }
+
+            auto length = min_match;
+            while (pos + length < size && data[candidate + length] == data[pos + length]) {
+                ++length;
+            }
+
+            emit(result, data + anchor, pos - anchor, pos - candidate, length);
+            pos += length;
+            anchor = pos;
+        }
+
+        emit(result, data + anchor, size - anchor, 0, 0);
+        return result;
+    }
+
+    static void decompress(const std::uint8_t* data,
+                           std::size_t size,
+                           std::uint8_t* into,
+                           std::size_t original_size) {
+        const auto end = data + size;
+        std::size_t out = 0;
+
+        while (data != end) {
+            const auto token = *data++;
+
+            const auto literals = read_length(data, end, token >> 4);
+            if (static_cast<std::size_t>(end - data) < literals ||
+                original_size - out < literals) {
+                throw std::runtime_error{"Corrupted compressed frame"};
+            }
+            memcpy(into + out, data, literals);
+            data += literals;
+            out += literals;
+
+            if (data == end) {
+                break;
+            }
+
+            if (end - data < 2) {
+                throw std::runtime_error{"Corrupted compressed frame"};
+            }
+            const std::size_t offset = data[0] | (data[1] << 8);
+            data += 2;
+
+            const auto length = read_length(data, end, token & 0xf) + min_match;
+            if (offset == 0 || offset > out || original_size - out < length) {
+                throw std::runtime_error{"Corrupted compressed frame"};
+            }
+
+            /* Byte by byte, as the match may overlap the output */
+            for (auto i = std::size_t{0}; i < length; ++i, ++out) {
+                into[out] = into[out - offset];
+            }
+        }
+
+        if (out != original_size) {
+            throw std::runtime_error{"Corrupted compressed frame"};
+        }
+    }
+
+private:
+    static constexpr unsigned hash_bits = 12;
+    static constexpr std::size_t min_match = 4;
+    static constexpr std::size_t max_offset = 0xffff;
+
+    static std::uint32_t read32(const std::uint8_t* ptr) {
+        std::uint32_t value;
+        memcpy(&value, ptr, sizeof(value));
+        return value;
+    }
+
+    /** Hashes four bytes into `bits` bits */
+    static std::uint32_t hash(std::uint32_t sequence, unsigned bits) {
+        return (sequence * 2654435761u) >> (32 - bits);
+    }
+
+    static void write_length(std::vector<std::uint8_t>& out, std::size_t length) {
+        for (; length >= 255; length -= 255) {
+            out.push_back(255);
+        }
+        out.push_back(static_cast<std::uint8_t>(length));
+    }
+
+    static std::size_t read_length(const std::uint8_t*& data,
+                                   const std::uint8_t* end,
+                                   std::size_t length) {
+        if (length != 15) {
+            return length;
+        }
+
+        std::uint8_t byte;
+        do {
+            if (data == end) {
+                throw std::runtime_error{"Corrupted compressed frame"};
+            }
+            byte = *data++;
+            length += byte;
+        } while (byte == 255);
+
+        return length;
+    }
+
+    /** Emits a sequence; `match_length` == 0 marks the last one */
+    static void emit(std::vector<std::uint8_t>& out,
+                     const std::uint8_t* literals,
+                     std::size_t literal_length,
+                     std::size_t offset,
+                     std::size_t match_length) {
+        const auto match_code = match_length == 0 ? 0 : match_length - min_match;
+
+        out.push_back(static_cast<std::uint8_t>((std::min<std::size_t>(literal_length, 15) << 4) |
+                                                std::min<std::size_t>(match_code, 15)));
+        if (literal_length >= 15) {
+            write_length(out, literal_length - 15);
+        }
+
+        out.insert(out.end(), literals, literals + literal_length);
+
+        if (match_length == 0) {
+            return;
+        }
+
+        out.push_back(static_cast<std::uint8_t>(offset & 0xff));
+        out.push_back(static_cast<std::uint8_t>(offset >> 8));
+        if (match_code >= 15) {
+            write_length(out, match_code - 15);
+        }
+    }
+};
+
+#ifdef HAVE_ZSTD
+/** An adapter for the zstd library */
+template <int Level = 1>
+struct zstd_codec {
+    static constexpr std::uint8_t id = 2;
+
+    static std::vector<std::uint8_t> compress(const std::uint8_t* data, std::size_t size) {
+        std::vector<std::uint8_t> result(ZSTD_compressBound(size));
+        const auto ret = ZSTD_compress(result.data(), result.size(), data, size, Level);
+        if (ZSTD_isError(ret)) {
+            throw std::runtime_error{ZSTD_getErrorName(ret)};
+        }
+        result.resize(ret);
+        return result;
+    }
+
+    static void decompress(const std::uint8_t* data,
+                           std::size_t size,
+                           std::uint8_t* into,
+                           std::size_t original_size) {
+        const auto ret = ZSTD_decompress(into, original_size, data, size);
+        if (ZSTD_isError(ret) || ret != original_size) {
+            throw std::runtime_error{"Corrupted compressed frame"};
+        }
+    }
+};
+#endif /* HAVE_ZSTD */
+
+#ifdef HAVE_LZ4
+/** An adapter for the lz4 library */
+struct lz4_codec {
+    static constexpr std::uint8_t id = 3;
+
+    static std::vector<std::uint8_t> compress(const std::uint8_t* data, std::size_t size) {
+        std::vector<std::uint8_t> result(LZ4_compressBound(static_cast<int>(size)));
+        const auto ret =
+            LZ4_compress_default(reinterpret_cast<const char*>(data),
+                                 reinterpret_cast<char*>(result.data()), static_cast<int>(size),
+                                 static_cast<int>(result.size()));
+        if (ret <= 0) {
+            throw std::runtime_error{"LZ4 compression failed"};
+        }
+        result.resize(ret);
+        return result;
+    }
+
+    static void decompress(const std::uint8_t* data,
+                           std::size_t size,
+                           std::uint8_t* into,
+                           std::size_t original_size) {
+        const auto ret = LZ4_decompress_safe(reinterpret_cast<const char*>(data),
+                                             reinterpret_cast<char*>(into), static_cast<int>(size),
+                                             static_cast<int>(original_size));
+        if (ret < 0 || static_cast<std::size_t>(ret) != original_size) {
+            throw std::runtime_error{"Corrupted compressed frame"};
+        }
+    }
+};
+#endif /* HAVE_LZ4 */
+
+namespace detail {
+
+/** Frames the output of a codec.
+ *
+ * A stored payload starts with a method byte: `stored` means the payload
+ * follows as it is (used when compression does not pay off), `compressed`
+ * that a big-endian uint32 original size and the compressed data follow.
+ */
+template <class Codec>
+struct codec_frame {
+    enum method : std::uint8_t { stored = 0, compressed = 1 };
+
+    static constexpr std::size_t compressed_header_size = 1 + sizeof(std::uint32_t);
+
+    static std::vector<std::uint8_t> encode(const std::uint8_t* data, std::size_t size) {
+        auto packed = Codec::compress(data, size);
+
+        std::vector<std::uint8_t> result;
+        if (size <= std::numeric_limits<std::uint32_t>::max() &&
+            packed.size() + compressed_header_size < size + 1) {
+            result.resize(compressed_header_size + packed.size());
+            result[0] = compressed;
+            const auto original_size = htobe(static_cast<std::uint32_t>(size));
+            memcpy(&result[1], &original_size, sizeof(original_size));
+            memcpy(&result[compressed_header_size], packed.data(), packed.size());
+        } else {
+            result.resize(1 + size);
+            result[0] = stored;
+            memcpy(&result[1], data, size);
+        }
+
+        return result;
+    }
+
+    static std::pair<std::unique_ptr<const std::uint8_t[]>, std::size_t> decode(
+        const std::uint8_t* data, std::size_t size) {
+        if (size == 0) {
+            throw std::runtime_error{"Corrupted compressed frame"};
+        }
+
+        switch (data[0]) {
+        case stored: {
+            auto result = std::make_unique<std::uint8_t[]>(size - 1);
+            memcpy(result.get(), data + 1, size - 1);
+            return {std::move(result), size - 1};
+        }
+        case compressed: {
+            if (size < compressed_header_size) {
+                throw std::runtime_error{"Corrupted compressed frame"};
+            }
+            const auto original_size = readbuf_unaligned<std::uint32_t>(data + 1);
+            auto result = std::make_unique<std::uint8_t[]>(original_size);
+            Codec::decompress(data + compressed_header_size, size - compressed_header_size,
+                              result.get(), original_size);
+            return {std::move(result), original_size};
+        }
+        default:
+            throw std::runtime_error{"Unknown compression method"};
+        }
+    }
+};
+}
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define PROTOSTREAM_HAVE_SSE42_CRC32C 1
+#include <nmmintrin.h>
+#endif
+
+namespace protostream {
+namespace detail {
+
+namespace crc32c_impl {
+/** The reflected Castagnoli polynomial */
+constexpr std::uint32_t polynomial = 0x82f63b78u;
+
+/** Lookup tables for the slicing-by-8 algorithm */
+struct tables {
+    std::uint32_t data[8][256];
+
+    tables() {
+        for (auto i = 0u; i < 256; ++i) {
+            auto crc = i;
+            for (auto bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ (polynomial & (0u - (crc & 1)));
+            }
+            data[0][i] = crc;
+        }
+
+        for (auto i = 0u; i < 256; ++i) {
+            for (auto slice = 1u; slice < 8; ++slice) {
+                data[slice][i] = (data[slice - 1][i] >> 8) ^ data[0][data[slice - 1][i] & 0xff];
+            }
+        }
+    }
+};
+
+inline const tables& get_tables() {
+    static const tables instance;
+    return instance;
+}
+
+/** The portable implementation, operating on an inverted crc */
+inline std::uint32_t software(std::uint32_t crc, const std::uint8_t* data, std::size_t size) {
+    const auto& t = get_tables().data;
+
+    for (; size >= 8; size -= 8, data += 8) {
+        std::uint32_t low, high;
+        memcpy(&low, data, sizeof(low));
+        memcpy(&high, data + 4, sizeof(high));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        low = __builtin_bswap32(low);
+        high = __builtin_bswap32(high);
+#endif
+        low ^= crc;
+        crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^ t[5][(low >> 16) & 0xff] ^
+              t[4][low >> 24] ^ t[3][high & 0xff] ^ t[2][(high >> 8) & 0xff] ^
+              t[1][(high >> 16) & 0xff] ^ t[0][high >> 24];
+    }
+
+    for (; size > 0; --size, ++data) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xff];
+    }
+
+    return crc;
+}
+
+/** Multiplies two polynomials modulo the Castagnoli polynomial, in the
+ * reflected representation */
+inline std::uint32_t multiply(std::uint32_t a, std::uint32_t b) {
+    std::uint32_t result = 0;
+    for (auto mask = std::uint32_t{1} << 31; mask != 0; mask >>= 1) {
+        if (a & mask) {
+            result ^= b;
+        }
+        b = (b >> 1) ^ (polynomial & (0u - (b & 1)));
+    }
+    return result;
+}
+
+/** Returns x^(8 * size) modulo the polynomial, i.e. the operator appending
+ * `size` zero bytes to the data of a checksum */
+inline std::uint32_t zeros_operator(std::size_t size) {
+    /* x^0 and x^8 in the reflected representation */
+    auto result = std::uint32_t{1} << 31;
+    auto power = std::uint32_t{1} << 23;
+    for (; size > 0; size >>= 1) {
+        if (size & 1) {
+            result = multiply(power, result);
+        }
+        power = multiply(power, power);
+    }
+    return result;
+}
+
+#ifdef PROTOSTREAM_HAVE_SSE42_CRC32C
+/** The implementation using the SSE 4.2 crc32 instruction, operating on an
+ * inverted crc */
+__attribute__((target("sse4.2"))) inline std::uint32_t hardware(std::uint32_t crc,
+                                                                 const std::uint8_t* data,
+                                                                 std::size_t size) {
+    std::uint64_t crc64 = crc;
+    for (; size >= 8; size -= 8, data += 8) {
+        std::uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+
+    crc = static_cast<std::uint32_t>(crc64);
+    for (; size > 0; --size, ++data) {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+
+    return crc;
+}
+
+inline bool has_hardware() {
+    static const bool result = __builtin_cpu_supports("sse4.2");
+    return result;
+}
+#endif
+}
+
+/** Computes the CRC32C (Castagnoli) checksum of `size` bytes at `data`.
+ *
+ * `crc` is the checksum of the preceding data, if the checksum is computed
+ * incrementally. The SSE 4.2 crc32 instruction is used if the CPU supports
+ * it, a table-driven implementation otherwise. PCLMUL folding is
+ * deliberately omitted, as it only pays off for buffers much larger than
+ * typical frames.
+ */
+inline std::uint32_t crc32c(const std::uint8_t* data, std::size_t size, std::uint32_t crc = 0) {
+#ifdef PROTOSTREAM_HAVE_SSE42_CRC32C
+    if (crc32c_impl::has_hardware()) {
+        return ~crc32c_impl::hardware(~crc, data, size);
+    }
+#endif
+    return ~crc32c_impl::software(~crc, data, size);
+}
+
+/** Returns the checksum of the concatenation of two blocks of data, given
+ * their checksums and the size of the second one, in O(log size2) time */
+inline std::uint32_t crc32c_combine(std::uint32_t crc1, std::uint32_t crc2, std::size_t size2) {
+    return crc32c_impl::multiply(crc32c_impl::zeros_operator(size2), crc1) ^ crc2;
+}
+}
+}
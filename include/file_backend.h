@@ -24,6 +24,10 @@ namespace protostream {
  *
  *  Note: the latter two members are only required if the backend is not
  * read-only.
+ *
+ *  It may declare `static constexpr bool thread_safe = true` if its const
+ * members may be called by several threads at once (see
+ * `stream::async_read_keyframe`).
  */
 template <class Derived>
 struct file_backend {
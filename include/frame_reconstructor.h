@@ -0,0 +1,215 @@
+#pragma once
+
+#include "common.h"
+#include "utils.h"
+
+#include <cassert>
+#include <cstddef>
+
+#include <experimental/optional>
+#include <list>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+namespace protostream {
+
+namespace detail {
+template <class State, class = void>
+struct has_size : std::false_type {};
+
+template <class State>
+struct has_size<State, void_t<decltype(std::declval<const State&>().size())>> : std::true_type {};
+}
+
+/** Estimates the memory used by a reconstructed state: its own size plus
+ * `state.size()` bytes if such a member exists (e.g. for std::string).
+ */
+struct default_state_size {
+    template <class State>
+    std::size_t operator()(const State& state) const {
+        return sizeof(State) + extra(state, detail::has_size<State>{});
+    }
+
+private:
+    template <class State>
+    static std::size_t extra(const State& state, std::true_type) {
+        return state.size();
+    }
+
+    template <class State>
+    static std::size_t extra(const State&, std::false_type) {
+        return 0;
+    }
+};
+
+/** Reconstructs frames by applying deltas to their keyframes.
+ *
+ * The state of a frame is the keyframe (as built by the keyframe factory)
+ * with all the following deltas of its group applied by the user-provided
+ * callback `void apply(keyframe_type& state, const delta_type& delta)`.
+ *
+ * Reconstructed states are cached every `checkpoint_interval` frames within
+ * a keyframe group (the keyframe itself included), so accessing a frame
+ * costs at most `checkpoint_interval - 1` delta applications once the
+ * neighbouring checkpoint is cached. The checkpoints are evicted in LRU
+ * order when their total size, as estimated by `SizeFn`, exceeds
+ * `memory_budget` bytes. The last reconstructed frame is kept as well,
+ * which makes sequential replay cost a single application per frame.
+ */
+template <class Stream, class ApplyFn, class SizeFn = default_state_size>
+class frame_reconstructor {
+public:
+    using state_type = typename Stream::keyframe_type;
+
+    frame_reconstructor(const Stream& stream,
+                        ApplyFn apply,
+                        std::size_t checkpoint_interval,
+                        std::size_t memory_budget,
+                        SizeFn state_size = {})
+        : str{stream},
+          apply{std::move(apply)},
+          state_size{std::move(state_size)},
+          interval{checkpoint_interval},
+          budget{memory_budget} {
+        assert(interval > 0);
+    }
+
+    frame_reconstructor(const frame_reconstructor&) = delete;
+
+    frame_reconstructor(frame_reconstructor&&) = default;
+
+    frame_reconstructor& operator=(const frame_reconstructor&) = delete;
+
+    frame_reconstructor& operator=(frame_reconstructor&&) = delete;
+
+    /** Returns the state of the frame `frame_id`.
+     *
+     * The reference is valid until the next call to `get`.
+     */
+    const state_type& get(keyframe_id_t frame_id) {
+        assert(frame_id < str.frame_count());
+
+        const auto group_start = frame_id - frame_id % str.frames_per_keyframe();
+
+        restore(group_start, frame_id);
+
+        auto& frame = current->first;
+        auto& point = current->second;
+        while (frame < frame_id) {
+            apply(point.state, point.next->get());
+            ++point.next;
+            ++frame;
+
+            if ((frame - group_start) % interval == 0) {
+                store(frame, point);
+            }
+        }
+
+        return point.state;
+    }
+
+    /** Returns the total estimated size of the cached checkpoints */
+    std::size_t memory_usage() const {
+        return used;
+    }
+
+    /** Drops all the cached states */
+    void clear() {
+        checkpoints.clear();
+        lru.clear();
+        current = {};
+        used = 0;
+    }
+
+private:
+    using delta_iterator = typename Stream::delta_iterator;
+
+    struct checkpoint {
+        state_type state;
+        /* The first delta not yet applied to `state` */
+        delta_iterator next;
+    };
+
+    struct cache_entry {
+        checkpoint point;
+        std::size_t size;
+        typename std::list<keyframe_id_t>::iterator lru_position;
+    };
+
+    const Stream& str;
+    ApplyFn apply;
+    SizeFn state_size;
+    std::size_t interval;
+    std::size_t budget;
+    std::size_t used = 0;
+
+    std::unordered_map<keyframe_id_t, cache_entry> checkpoints;
+    /* Most recently used checkpoints first */
+    std::list<keyframe_id_t> lru;
+    /* The last reconstructed frame */
+    std::experimental::optional<std::pair<keyframe_id_t, checkpoint>> current;
+
+    /** Makes `current` the nearest cached checkpoint of `group_start`'s group
+     * not following `frame_id`, or the keyframe itself if there is none.
+     * Keeps `current` if it is in the group, not following `frame_id` and
+     * nearer to it than any such checkpoint */
+    void restore(keyframe_id_t group_start, keyframe_id_t frame_id) {
+        const auto continued =
+            current && current->first >= group_start && current->first <= frame_id;
+
+        for (auto frame = frame_id - (frame_id - group_start) % interval;; frame -= interval) {
+            if (continued && frame <= current->first) {
+                return;
+            }
+
+            const auto it = checkpoints.find(frame);
+            if (it != checkpoints.end()) {
+                lru.splice(lru.begin(), lru, it->second.lru_position);
+                current = std::make_pair(frame, it->second.point);
+                return;
+            }
+
+            if (frame == group_start) {
+                break;
+            }
+        }
+
+        const auto keyframe = str.begin()[group_start / str.frames_per_keyframe()];
+        current = std::make_pair(group_start, checkpoint{keyframe.get(), keyframe.begin()});
+        store(group_start, current->second);
+    }
+
+    void store(keyframe_id_t frame_id, const checkpoint& point) {
+        if (checkpoints.count(frame_id)) {
+            return;
+        }
+
+        const auto size = state_size(point.state);
+        if (size > budget) {
+            return;
+        }
+
+        lru.push_front(frame_id);
+        checkpoints.emplace(frame_id, cache_entry{point, size, lru.begin()});
+        used += size;
+
+        while (used > budget) {
+            const auto it = checkpoints.find(lru.back());
+            used -= it->second.size;
+            checkpoints.erase(it);
+            lru.pop_back();
+        }
+    }
+};
+
+/** Creates a `frame_reconstructor`, deducing the callback type */
+template <class Stream, class ApplyFn>
+auto make_frame_reconstructor(const Stream& stream,
+                              ApplyFn apply,
+                              std::size_t checkpoint_interval,
+                              std::size_t memory_budget) {
+    return frame_reconstructor<Stream, ApplyFn>{stream, std::move(apply), checkpoint_interval,
+                                                memory_budget};
+}
+}
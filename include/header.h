@@ -5,6 +5,12 @@
 #include "header/magic_value.h"
 #include "header/placeholder.h"
 #include "header/with_offset.h"
+#include "utils.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 
 namespace protostream {
 
@@ -23,10 +29,35 @@ struct kf0_offset : public detail::with_offset<offset_t, 8 * 3> {};
 struct keyframe_count : public detail::with_offset<offset_t, 8 * 4> {};
 struct frame_count : public detail::with_offset<offset_t, 8 * 5> {};
 struct frames_per_kf : public detail::with_offset<uint32_t, 8 * 6> {};
-struct reserved : public detail::placeholder<4, 8 * 6 + 4> {};
+struct kf_metadata_size : public detail::with_offset<uint8_t, 8 * 6 + 4> {};
+struct codec : public detail::with_offset<uint8_t, 8 * 6 + 5> {};
+struct flags : public detail::with_offset<uint8_t, 8 * 6 + 6> {};
+/** The number of links of every keyframe, 0 in files written before it was
+ * made configurable (see `keyframe_layout::height_of`) */
+struct kf_skiplist_height : public detail::with_offset<uint8_t, 8 * 6 + 7> {};
+}
 }
+
+/** Bits of the `flags` field of the file header */
+namespace file_flags {
+/** Every frame is followed by a CRC32C checksum */
+constexpr std::uint8_t checksums = 1 << 0;
+/** The numbers following the file header are little-endian (see
+ * `byte_order::native`) */
+constexpr std::uint8_t little_endian = 1 << 1;
+
+constexpr std::uint8_t all = checksums | little_endian;
 }
 
+/** The byte order of the numbers following the file header (keyframe
+ * headers, delta sizes and checksums). The file header itself and the user
+ * metadata are always big-endian. */
+enum class byte_order {
+    big,
+    /** The byte order of the host, so that no byte swapping is needed */
+    native
+};
+
 struct file_header : public detail::generic_header<file_header,
                                                    fields::file_header::magic_field,
                                                    fields::file_header::file_size,
@@ -35,12 +66,20 @@ struct file_header : public detail::generic_header<file_header,
                                                    fields::file_header::keyframe_count,
                                                    fields::file_header::frame_count,
                                                    fields::file_header::frames_per_kf,
-                                                   fields::file_header::reserved> {};
+                                                   fields::file_header::kf_metadata_size,
+                                                   fields::file_header::codec,
+                                                   fields::file_header::flags,
+                                                   fields::file_header::kf_skiplist_height> {};
 
 namespace fields {
 inline namespace reduced_keyframe_header {
+/** The default skiplist height. The fields below describe the layout of
+ * keyframe headers with skiplists of this height (see `keyframe_layout`). */
 static constexpr unsigned skiplist_height = 10;
 
+/** Keyframe numbers are 64-bit, so higher skiplists would be useless */
+static constexpr unsigned max_skiplist_height = 64;
+
 static constexpr offset_t skiplist_offset(unsigned level = 0) {
     return 8 * 2 + 8 * level;
 }
@@ -58,4 +97,92 @@ struct reduced_keyframe_header
                                     fields::reduced_keyframe_header::delta_offset,
                                     fields::reduced_keyframe_header::skiplist_placeholder,
                                     fields::reduced_keyframe_header::kf_size> {};
+
+/** The image of the beginning of a keyframe header stored in the native
+ * byte order. The skiplist and the keyframe size follow it. */
+struct native_keyframe_header {
+    keyframe_id_t kf_num;
+    offset_t delta_offset;
+
+    /** Returns the image stored at `ptr`, which need not be aligned */
+    static native_keyframe_header read(const std::uint8_t* ptr) {
+        native_keyframe_header result;
+        memcpy(&result, ptr, sizeof(result));
+        return result;
+    }
+};
+
+static_assert(offsetof(native_keyframe_header, kf_num) == fields::kf_num::offset &&
+                  offsetof(native_keyframe_header, delta_offset) == fields::delta_offset::offset &&
+                  sizeof(native_keyframe_header) == fields::skiplist_offset(),
+              "native_keyframe_header does not match the keyframe header layout");
+
+/** Describes how the keyframe headers of a file are stored.
+ *
+ * A keyframe header consists of the keyframe number, the delta offset,
+ * `skiplist_height` links and the keyframe size, so only the position of
+ * the latter depends on the height. */
+struct keyframe_layout {
+    byte_order order = byte_order::big;
+    unsigned skiplist_height = fields::skiplist_height;
+
+    /** Returns the skiplist height recorded in the file header */
+    static unsigned height_of(const file_header& header) {
+        const auto height = header.get<fields::kf_skiplist_height>();
+        return height == 0 ? fields::skiplist_height : height;
+    }
+
+    offset_t kf_size_offset() const {
+        return fields::skiplist_offset(skiplist_height);
+    }
+
+    /** The size of a keyframe header */
+    std::size_t header_size() const {
+        return kf_size_offset() + sizeof(std::uint32_t);
+    }
+
+    /** Decodes a keyframe header from a buffer of `header_size()` bytes */
+    reduced_keyframe_header read(const std::uint8_t* buffer) const {
+        reduced_keyframe_header result;
+        if (order == byte_order::native) {
+            const auto image = native_keyframe_header::read(buffer);
+            result.get<fields::kf_num>() = image.kf_num;
+            result.get<fields::delta_offset>() = image.delta_offset;
+            result.get<fields::kf_size>() =
+                detail::readbuf_native<std::uint32_t>(buffer + kf_size_offset());
+        } else {
+            result.get<fields::kf_num>() = fields::kf_num::read(buffer);
+            result.get<fields::delta_offset>() = fields::delta_offset::read(buffer);
+            result.get<fields::kf_size>() =
+                detail::readbuf_unaligned<std::uint32_t>(buffer + kf_size_offset());
+        }
+        return result;
+    }
+
+    /** Decodes the skiplist from a buffer of `skiplist_height` links */
+    void read_links(const std::uint8_t* buffer, offset_t* into) const {
+        if (order == byte_order::native) {
+            memcpy(into, buffer, skiplist_height * sizeof(offset_t));
+        } else {
+            detail::readbuf_array(buffer, skiplist_height, into);
+        }
+    }
+
+    /** Encodes a keyframe header into a zeroed buffer of `header_size()`
+     * bytes, leaving the skiplist empty */
+    void write(const reduced_keyframe_header& header, std::uint8_t* buffer) const {
+        encode(header.get<fields::kf_num>(), buffer + fields::kf_num::offset);
+        encode(header.get<fields::delta_offset>(), buffer + fields::delta_offset::offset);
+        encode(header.get<fields::kf_size>(), buffer + kf_size_offset());
+    }
+
+    /** Encodes a number in the byte order of the file */
+    template <class T>
+    void encode(T value, std::uint8_t* buffer) const {
+        if (order == byte_order::big) {
+            value = detail::htobe(value);
+        }
+        memcpy(buffer, &value, sizeof(value));
+    }
+};
 }
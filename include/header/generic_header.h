@@ -1,6 +1,10 @@
 #pragma once
 
+#include "common.h"
+#include "utils.h"
+
 #include <cstddef>
+#include <cstdint>
 
 #include <algorithm>
 #include <tuple>
@@ -34,13 +38,22 @@ class generic_header {
 public:
     static constexpr std::size_t size = std::max({(Fields::offset + Fields::size)...});
 
-    template <class... Args>
-    void read_self(Args&&... args) {
+    /** Decodes the header from a buffer holding its `size` bytes */
+    void read_self(const std::uint8_t* buffer) {
         /* Call read_self for every field */
-        int _[] = {(std::get<Fields>(fields).read_self(args...), 0)...};
+        int _[] = {(std::get<Fields>(fields).read_self(buffer), 0)...};
         (void)_;
     }
 
+    /** Reads the header with a single backend read spanning all the fields
+     * (the layout is known at compile time), then decodes it from the buffer
+     */
+    template <class Backend>
+    void read_self(const Backend& backend, offset_t file_offset) {
+        const auto buffer = backend.read(file_offset, size);
+        read_self(as_ptr(buffer));
+    }
+
     template <class... Args>
     static Derived read(Args&&... args) {
         Derived result;
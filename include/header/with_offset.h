@@ -22,8 +22,9 @@ struct with_offset {
         return value;
     }
 
+    /* The buffer may come straight from a mapping, so no alignment is assumed */
     static with_offset read(const std::uint8_t* buffer) {
-        return readbuf_aligned<type>(buffer + offset);
+        return readbuf_unaligned<type>(buffer + offset);
     }
 
     template <class Backend>
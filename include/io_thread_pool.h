@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace protostream {
+
+/** A fixed number of threads running blocking reads, e.g. the ones of
+ * `stream::async_read_keyframe`, so that page faults and `pread`s do not
+ * stall the submitting thread.
+ *
+ * Tasks are started in submission order. The destructor waits for all the
+ * submitted tasks to complete.
+ */
+class io_thread_pool {
+public:
+    explicit io_thread_pool(std::size_t thread_count = std::thread::hardware_concurrency()) {
+        thread_count = std::max<std::size_t>(thread_count, 1);
+        threads.reserve(thread_count);
+        for (auto i = std::size_t{0}; i < thread_count; ++i) {
+            threads.emplace_back([this] { work(); });
+        }
+    }
+
+    io_thread_pool(const io_thread_pool&) = delete;
+
+    io_thread_pool& operator=(const io_thread_pool&) = delete;
+
+    ~io_thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            stopping = true;
+        }
+        not_empty.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    /** Runs `fun()` on one of the threads. Its result, or the exception it
+     * throws, is passed through the returned future. */
+    template <class Fun>
+    std::future<std::result_of_t<Fun()>> submit(Fun fun) {
+        auto task = std::make_shared<std::packaged_task<std::result_of_t<Fun()>()>>(std::move(fun));
+        auto result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            tasks.emplace_back([task] { (*task)(); });
+        }
+        not_empty.notify_one();
+        return result;
+    }
+
+    std::size_t size() const {
+        return threads.size();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::deque<std::function<void()>> tasks;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+
+    void work() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock{mutex};
+                not_empty.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+}
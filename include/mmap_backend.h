@@ -3,6 +3,7 @@
 #include "file_backend.h"
 #include "mmap_guard.h"
 #include "posix_file_handler.h"
+#include "probes.h"
 
 namespace protostream {
 
@@ -17,6 +18,9 @@ public:
    */
     using pointer_type = const std::uint8_t*;
 
+    /** Reads only access the mapping */
+    static constexpr bool thread_safe = true;
+
     mmap_backend(const char* path) : file{path}, used_size{file.size()}, buffer{file} {
     }
 
@@ -48,6 +52,20 @@ public:
         return used_size;
     }
 
+    file_identity identity() const {
+        return file.identity();
+    }
+
+    const posix_file_handler<mode>& handler() const {
+        return file;
+    }
+
+    /** The size of the mapping, growing with the file in steps of
+     * `ExpansionGranularity` bytes */
+    std::size_t mapped_size() const {
+        return buffer.size();
+    }
+
     template <class T>
     void write_small(offset_t offset, const T* from) {
         check_expand(offset + sizeof(*from));
@@ -59,6 +77,16 @@ public:
         memcpy(buffer.get() + offset, from, length);
     }
 
+    /** Discards the data following the first `new_size` bytes. The file
+     * itself is truncated when the backend is destroyed, as the mapping is
+     * still used by the following writes. */
+    template <bool /* dummy */ = true>
+    void truncate(std::size_t new_size) {
+        static_assert(mode == file_mode_t::READ_APPEND, "writing into a read-only file");
+        assert(new_size <= used_size);
+        used_size = new_size;
+    }
+
 private:
     posix_file_handler<mode> file;
     std::size_t used_size;
@@ -92,6 +120,7 @@ inline void mmap_backend<file_mode_t::READ_APPEND>::check_expand(std::size_t new
     expand_by /= expansion_granularity;
     expand_by *= expansion_granularity;
 
+    PROTOSTREAM_PROBE(mmap_remap, buffer.size(), buffer.size() + expand_by);
     file.expand(buffer.size(), expand_by);
     buffer.mremap(buffer.size() + expand_by);
     used_size = new_end;
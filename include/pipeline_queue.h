@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+
+#include <condition_variable>
+#include <deque>
+#include <experimental/optional>
+#include <mutex>
+#include <utility>
+
+namespace protostream {
+
+namespace detail {
+/** A queue of bounded capacity passing items between the stages of a
+ * pipeline */
+template <class T>
+class pipeline_queue {
+public:
+    explicit pipeline_queue(std::size_t capacity) : capacity{capacity} {
+    }
+
+    /** Waits for free space and enqueues the item. Returns false if the
+     * queue was cancelled. */
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock{mutex};
+        not_full.wait(lock, [this] { return cancelled || items.size() < capacity; });
+        if (cancelled) {
+            return false;
+        }
+
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+        return true;
+    }
+
+    /** Waits for an item and dequeues it. Returns nothing once the queue is
+     * closed and empty, or cancelled. */
+    std::experimental::optional<T> pop() {
+        std::unique_lock<std::mutex> lock{mutex};
+        not_empty.wait(lock, [this] { return cancelled || closed || !items.empty(); });
+        if (cancelled || items.empty()) {
+            return {};
+        }
+
+        auto result = std::experimental::make_optional(std::move(items.front()));
+        items.pop_front();
+        not_full.notify_one();
+        return result;
+    }
+
+    /** Marks the end of the items */
+    void close() {
+        std::lock_guard<std::mutex> lock{mutex};
+        closed = true;
+        not_empty.notify_all();
+    }
+
+    /** Drops the items and wakes up all the waiting threads */
+    void cancel() {
+        std::lock_guard<std::mutex> lock{mutex};
+        cancelled = true;
+        items.clear();
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+private:
+    std::size_t capacity;
+    bool closed = false;
+    bool cancelled = false;
+
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::deque<T> items;
+};
+}
+}
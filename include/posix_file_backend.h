@@ -18,6 +18,9 @@ class posix_file_backend : public file_backend<posix_file_backend<mode>> {
 public:
     using pointer_type = std::unique_ptr<const std::uint8_t[]>;
 
+    /** Reads are independent `pread` calls */
+    static constexpr bool thread_safe = true;
+
     posix_file_backend(const char* path) : file{path} {
     }
 
@@ -52,10 +55,25 @@ public:
         file.write(offset, length, from);
     }
 
+    /** Discards the data following the first `new_size` bytes */
+    template <bool /* dummy */ = true>
+    void truncate(std::size_t new_size) {
+        static_assert(mode == file_mode_t::READ_APPEND, "writing into a read-only file");
+        file.truncate(new_size);
+    }
+
     std::size_t size() const {
         return file.size();
     }
 
+    file_identity identity() const {
+        return file.identity();
+    }
+
+    const posix_file_handler<mode>& handler() const {
+        return file;
+    }
+
 private:
     posix_file_handler<mode> file;
 };
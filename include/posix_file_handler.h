@@ -9,12 +9,41 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cerrno>
 #include <system_error>
+#include <utility>
+#include <vector>
 
 namespace protostream {
 
 enum class file_mode_t { READ_ONLY, READ_APPEND };
 
+/** Identifies a version of a file within the system, regardless of its
+ * path: the file by its device and inode, and its contents by its size and
+ * modification time. Rewriting a file in place thus changes its identity,
+ * unless the size is kept within the resolution of the timestamps. */
+struct file_identity {
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    decltype(std::declval<struct stat>().st_mtim.tv_sec) mtime_sec;
+    decltype(std::declval<struct stat>().st_mtim.tv_nsec) mtime_nsec;
+
+    static file_identity of(const struct stat& st) {
+        return {st.st_dev, st.st_ino, st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec};
+    }
+
+    bool operator==(const file_identity& that) const {
+        return device == that.device && inode == that.inode && size == that.size &&
+               mtime_sec == that.mtime_sec && mtime_nsec == that.mtime_nsec;
+    }
+
+    bool operator!=(const file_identity& that) const {
+        return !(*this == that);
+    }
+};
+
 namespace detail {
 constexpr int open_flags(file_mode_t mode) {
     return mode == file_mode_t::READ_ONLY ? O_RDONLY : O_RDWR | O_CREAT;
@@ -52,11 +81,21 @@ public:
 
     void write(offset_t offset, size_t length, const std::uint8_t* from);
 
+    /** Copies `length` bytes at `source_offset` in `source` to `offset` in
+     * this file, without passing them through user space if possible */
+    template <file_mode_t source_mode>
+    void copy_from(const posix_file_handler<source_mode>& source,
+                   offset_t source_offset,
+                   std::size_t length,
+                   offset_t offset);
+
     buffer_type mmap() {
         return mmap(size());
     }
 
-    buffer_type mmap(std::size_t size);
+    /** Maps `size` bytes of the file starting from `offset`, which must be
+     * a multiple of the page size */
+    buffer_type mmap(std::size_t size, offset_t offset = 0);
 
     void munmap(const buffer_type buffer) const {
         munmap(buffer, size());
@@ -75,13 +114,22 @@ public:
     void truncate(std::size_t new_size);
 
     std::size_t size() const {
+        return status().st_size;
+    }
+
+    file_identity identity() const {
+        return file_identity::of(status());
+    }
+
+private:
+    struct stat status() const {
         struct stat st;
 
         if (fstat(fd, &st) != 0) {
             throw std::system_error{errno, std::system_category(), "fstat"};
         }
 
-        return st.st_size;
+        return st;
     }
 };
 
@@ -118,7 +166,50 @@ inline void posix_file_handler<file_mode_t::READ_APPEND>::write(offset_t offset,
 }
 
 template <file_mode_t mode>
-auto posix_file_handler<mode>::mmap(std::size_t size) -> buffer_type {
+template <file_mode_t source_mode>
+void posix_file_handler<mode>::copy_from(const posix_file_handler<source_mode>& source,
+                                         offset_t source_offset,
+                                         std::size_t length,
+                                         offset_t offset) {
+    static_assert(mode == file_mode_t::READ_APPEND, "writing into a read-only file");
+
+#ifdef HAVE_COPY_FILE_RANGE
+    /* The filesystem may share the extents of the files (reflink) rather than
+     * copy the data */
+    while (length > 0) {
+        auto from = static_cast<loff_t>(source_offset);
+        auto to = static_cast<loff_t>(offset);
+        const auto ret = copy_file_range(source.fd, &from, fd, &to, length, 0);
+
+        if (ret == 0) {
+            throw std::logic_error{"Premature end of file"};
+        } else if (ret < 0) {
+            if (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP) {
+                break;
+            }
+            throw std::system_error{errno, std::system_category(), "copy_file_range"};
+        }
+
+        source_offset += ret;
+        offset += ret;
+        length -= ret;
+    }
+#endif
+
+    std::vector<std::uint8_t> buffer(std::min<std::size_t>(length, 1 << 16));
+    while (length > 0) {
+        const auto count = std::min(length, buffer.size());
+        source.read(source_offset, count, buffer.data());
+        write(offset, count, buffer.data());
+
+        source_offset += count;
+        offset += count;
+        length -= count;
+    }
+}
+
+template <file_mode_t mode>
+auto posix_file_handler<mode>::mmap(std::size_t size, offset_t offset) -> buffer_type {
     if (size == 0) {
         return nullptr;
     }
@@ -126,7 +217,7 @@ auto posix_file_handler<mode>::mmap(std::size_t size) -> buffer_type {
     const auto mmap_prot = mode == file_mode_t::READ_ONLY ? PROT_READ : (PROT_WRITE | PROT_READ);
     const auto mmap_flags = mode == file_mode_t::READ_ONLY ? MAP_PRIVATE : MAP_SHARED;
 
-    auto buf = ::mmap(nullptr, size, mmap_prot, mmap_flags, fd, 0);
+    auto buf = ::mmap(nullptr, size, mmap_prot, mmap_flags, fd, static_cast<off_t>(offset));
     if (buf == MAP_FAILED) {
         throw std::system_error{errno, std::system_category(), "mmap"};
     }
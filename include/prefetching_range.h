@@ -0,0 +1,163 @@
+#pragma once
+
+#include "common.h"
+#include "pipeline_queue.h"
+#include "utils.h"
+
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <exception>
+#include <experimental/optional>
+#include <iterator>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace protostream {
+
+/** A range over the keyframes of a stream, with their deltas, read ahead of
+ * the consumer on a helper thread.
+ *
+ * The helper thread keeps up to `depth` keyframe blocks (a keyframe and all
+ * its deltas) loaded: built by the stream's factories, so that backends
+ * copying the frames (posix_file_backend) have already filled their
+ * buffers, and with their pages faulted in for backends returning raw
+ * pointers (mmap_backend). The consumer's processing of a block thus
+ * overlaps the reading of the next ones.
+ *
+ * The stream is used by the helper thread until the range is destroyed, so
+ * meanwhile it must not be used by other threads unless its cache is
+ * thread-safe, nor modified. The range may be iterated only once.
+ */
+template <class Stream>
+class prefetching_range {
+public:
+    struct keyframe_block {
+        keyframe_id_t id;
+        typename Stream::keyframe_type keyframe;
+        std::vector<typename Stream::delta_type> deltas;
+    };
+
+    class iterator : public std::iterator<std::input_iterator_tag, keyframe_block> {
+    public:
+        const keyframe_block& operator*() const {
+            return *range->current;
+        }
+
+        const keyframe_block* operator->() const {
+            return &*range->current;
+        }
+
+        iterator& operator++() {
+            if (!range->next()) {
+                range = nullptr;
+            }
+            return *this;
+        }
+
+        bool operator==(const iterator& that) const {
+            return range == that.range;
+        }
+
+        bool operator!=(const iterator& that) const {
+            return !(*this == that);
+        }
+
+    private:
+        explicit iterator(prefetching_range* range) : range{range} {
+        }
+
+        prefetching_range* range;
+
+        friend class prefetching_range;
+    };
+
+    /** Starts reading the keyframes from `first` on */
+    prefetching_range(const Stream& stream, std::size_t depth, keyframe_id_t first = 0)
+        : blocks{std::max<std::size_t>(depth, 1)}, helper{[this, &stream, first] {
+              prefetch(stream, first);
+          }} {
+    }
+
+    prefetching_range(const prefetching_range&) = delete;
+
+    prefetching_range& operator=(const prefetching_range&) = delete;
+
+    ~prefetching_range() {
+        blocks.cancel();
+        helper.join();
+    }
+
+    /** Waits for the first block. Rethrows the exception thrown while reading
+     * a block when that block is reached. */
+    iterator begin() {
+        return iterator{next() ? this : nullptr};
+    }
+
+    iterator end() {
+        return iterator{nullptr};
+    }
+
+private:
+    detail::pipeline_queue<keyframe_block> blocks;
+    std::exception_ptr error;
+    std::experimental::optional<keyframe_block> current;
+    std::thread helper;
+
+    bool next() {
+        current = blocks.pop();
+        if (!current && error) {
+            std::rethrow_exception(error);
+        }
+        return static_cast<bool>(current);
+    }
+
+    void prefetch(const Stream& stream, keyframe_id_t first) {
+        try {
+            const auto end = stream.end();
+            for (auto it = stream.begin() + first; it != end; ++it) {
+                prefault(*it, has_raw_pointers{});
+
+                keyframe_block block{it->id(), it->get(), {}};
+                for (const auto& delta : *it) {
+                    prefault(delta, has_raw_pointers{});
+                    block.deltas.push_back(delta.get());
+                }
+
+                if (!blocks.push(std::move(block))) {
+                    return;
+                }
+            }
+        } catch (...) {
+            error = std::current_exception();
+        }
+        blocks.close();
+    }
+
+    using has_raw_pointers = std::is_pointer<typename Stream::pointer_type>;
+
+    /** Touches every page of a memory-mapped frame */
+    template <class Data>
+    static void prefault(const Data& data, std::true_type /* raw pointers */) {
+        static const auto page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        const auto ptr = data.raw();
+        const auto size = data.size();
+
+        volatile std::uint8_t sink = 0;
+        for (auto offset = std::size_t{0}; offset < size; offset += page_size) {
+            sink = sink + ptr[offset];
+        }
+        (void)sink;
+    }
+
+    /** Frames copied into buffers are loaded by `get` */
+    template <class Data>
+    static void prefault(const Data&, std::false_type /* raw pointers */) {
+    }
+};
+}
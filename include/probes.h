@@ -0,0 +1,32 @@
+#pragma once
+
+#include "config.h"
+
+/** USDT (statically defined tracing) probes, usable with bpftrace, perf or
+ * SystemTap on running processes, e.g.
+ *   bpftrace -e 'usdt:./a.out:protostream:header_commit { @[probe] = count(); }'
+ *
+ * The probes are compiled in only if libprotostream is configured with
+ * ENABLE_USDT_PROBES and <sys/sdt.h> is available. An inactive probe is a
+ * single nop instruction; otherwise the macro expands to nothing and its
+ * arguments are not evaluated.
+ *
+ * Probes (arguments in parentheses):
+ *   * append_keyframe_entry (size), append_keyframe_return (frame count)
+ *   * append_delta_entry (size), append_delta_return (frame count)
+ *   * keyframe_seek (keyframe number from, keyframe number to), whenever a
+ *     keyframe iterator moves to another keyframe: by `++`, or by a seek
+ *     (`--`, `+=`, `-=`, `+`, `-` and `[]`). Seeks to the current keyframe
+ *     do not fire it.
+ *   * link_cache_miss (keyframe offset, skiplist level)
+ *   * mmap_remap (mapped size before, mapped size after)
+ *   * header_commit (frame count, file size)
+ */
+#ifdef PROTOSTREAM_USDT
+#include <sys/sdt.h>
+#define PROTOSTREAM_PROBE(name, ...) STAP_PROBEV(protostream, name, __VA_ARGS__)
+#else
+#define PROTOSTREAM_PROBE(name, ...) \
+    do {                             \
+    } while (0)
+#endif /* PROTOSTREAM_USDT */
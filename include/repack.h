@@ -0,0 +1,228 @@
+#pragma once
+
+#include "codec.h"
+#include "common.h"
+#include "pipeline_queue.h"
+#include "utils.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <exception>
+#include <experimental/optional>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace protostream {
+
+namespace detail {
+/** Returns the payload of a keyframe or a delta, as passed to `append_*` */
+template <class Stream, class Data>
+std::vector<std::uint8_t> stored_payload(const Data& data) {
+    const auto raw = data.raw();
+    const auto ptr = as_ptr(raw);
+    if (Stream::is_compressed) {
+        const auto decoded =
+            codec_frame<typename Stream::codec_type>::decode(ptr, data.size());
+        return {decoded.first.get(), decoded.first.get() + decoded.second};
+    }
+    return {ptr, ptr + data.size()};
+}
+
+template <class Stream>
+auto keyframe_metadata(const typename Stream::keyframe_data& keyframe,
+                       std::true_type /* has metadata */) {
+    return keyframe.metadata();
+}
+
+template <class Stream>
+typename Stream::keyframe_metadata_type::type keyframe_metadata(
+    const typename Stream::keyframe_data&, std::false_type /* has metadata */) {
+    return {};
+}
+}
+
+/** Copies the frames of `source` into the empty stream `destination`, which
+ * may use a different number of frames per keyframe, a different codec or
+ * another skiplist height.
+ *
+ * The frames keeping their kind are copied as they are. A frame which
+ * becomes a keyframe is encoded from its state by
+ * `std::vector<std::uint8_t> encode_keyframe(const state_type& state)`,
+ * and a keyframe which becomes a delta by
+ * `std::vector<std::uint8_t> encode_delta(const state_type& previous,
+ *                                         const state_type& state)`,
+ * where `state_type` is the keyframe type of `source`. The states are
+ * reconstructed by `void apply(state_type& state, const delta_type& delta)`,
+ * as in `frame_reconstructor`. The synthesized keyframes get the metadata of
+ * the preceding keyframe of `source`.
+ *
+ * The source is read and the states are reconstructed on one thread, the
+ * frames are encoded on another, and they are appended to the destination on
+ * the calling thread; at most `queue_capacity` frames are buffered between
+ * the stages. Neither stream may be used by other threads meanwhile. The
+ * first exception thrown by any stage (including the callbacks) stops the
+ * others and is rethrown, leaving the destination incomplete.
+ */
+template <class Source,
+          class Destination,
+          class ApplyFn,
+          class KeyframeEncoder,
+          class DeltaEncoder>
+void repack(const Source& source,
+            Destination& destination,
+            ApplyFn apply,
+            KeyframeEncoder encode_keyframe,
+            DeltaEncoder encode_delta,
+            std::size_t queue_capacity = 64) {
+    using state_type = typename Source::keyframe_type;
+    using metadata_type = typename Source::keyframe_metadata_type::type;
+    using optional_state = std::experimental::optional<state_type>;
+
+    static_assert(std::is_same<metadata_type,
+                               typename Destination::keyframe_metadata_type::type>::value,
+                  "Keyframe metadata of the streams differ");
+
+    if (destination.frame_count() != 0) {
+        throw std::runtime_error{"Destination stream is not empty"};
+    }
+
+    /* A frame, as passed from the reconstructing to the encoding stage */
+    struct state_frame {
+        bool keyframe;
+        /* The payload copied from the source, if the frame keeps its kind */
+        std::vector<std::uint8_t> payload;
+        optional_state previous;
+        optional_state state;
+        metadata_type metadata;
+    };
+
+    /* A frame, as passed from the encoding to the writing stage */
+    struct encoded_frame {
+        bool keyframe;
+        std::vector<std::uint8_t> payload;
+        metadata_type metadata;
+    };
+
+    const auto source_interval = keyframe_id_t{source.frames_per_keyframe()};
+    const auto interval = keyframe_id_t{destination.frames_per_keyframe()};
+    if (source_interval == 0 || interval == 0) {
+        throw std::runtime_error{"Invalid number of frames per keyframe"};
+    }
+
+    detail::pipeline_queue<state_frame> states{queue_capacity};
+    detail::pipeline_queue<encoded_frame> encoded{queue_capacity};
+
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    const auto fail = [&](std::exception_ptr exception) {
+        {
+            std::lock_guard<std::mutex> lock{error_mutex};
+            if (!error) {
+                error = exception;
+            }
+        }
+        states.cancel();
+        encoded.cancel();
+    };
+
+    std::thread reconstructing{[&] {
+        try {
+            auto frame = keyframe_id_t{0};
+            optional_state previous;
+
+            for (const auto& keyframe : source) {
+                const auto metadata = detail::keyframe_metadata<Source>(
+                    keyframe, std::integral_constant<bool, (Source::keyframe_metadata_size > 0)>{});
+
+                optional_state state{keyframe.get()};
+                if (frame % interval == 0) {
+                    if (!states.push({true, detail::stored_payload<Source>(keyframe), {}, {},
+                                      metadata})) {
+                        return;
+                    }
+                } else if (!states.push({false, {}, std::move(previous), state, metadata})) {
+                    return;
+                }
+
+                for (auto it = keyframe.begin(); it != keyframe.end(); ++it) {
+                    ++frame;
+                    apply(*state, it->get());
+                    if (frame % interval == 0) {
+                        if (!states.push({true, {}, {}, state, metadata})) {
+                            return;
+                        }
+                    } else if (!states.push({false, detail::stored_payload<Source>(*it), {}, {},
+                                             metadata})) {
+                        return;
+                    }
+                }
+
+                ++frame;
+                /* The last state of a group is needed only if the following
+                 * keyframe becomes a delta */
+                if (frame % source_interval == 0 && frame % interval != 0) {
+                    previous = std::move(state);
+                } else {
+                    previous = {};
+                }
+            }
+
+            states.close();
+        } catch (...) {
+            fail(std::current_exception());
+        }
+    }};
+
+    std::thread encoding{[&] {
+        try {
+            while (auto item = states.pop()) {
+                encoded_frame result{item->keyframe, std::move(item->payload), item->metadata};
+                if (item->keyframe && item->state) {
+                    result.payload = encode_keyframe(static_cast<const state_type&>(*item->state));
+                } else if (item->state) {
+                    result.payload =
+                        encode_delta(static_cast<const state_type&>(*item->previous),
+                                     static_cast<const state_type&>(*item->state));
+                }
+
+                if (!encoded.push(std::move(result))) {
+                    return;
+                }
+            }
+
+            encoded.close();
+        } catch (...) {
+            fail(std::current_exception());
+        }
+    }};
+
+    try {
+        while (auto item = encoded.pop()) {
+            if (item->keyframe) {
+                destination.append_keyframe(item->payload.data(), item->payload.size(),
+                                            item->metadata);
+            } else if (item->payload.size() > std::numeric_limits<delta_size_t>::max()) {
+                throw std::length_error{"Delta too large"};
+            } else {
+                destination.append_delta(item->payload.data(),
+                                         static_cast<delta_size_t>(item->payload.size()));
+            }
+        }
+    } catch (...) {
+        fail(std::current_exception());
+    }
+
+    reconstructing.join();
+    encoding.join();
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+}
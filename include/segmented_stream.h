@@ -0,0 +1,597 @@
+#pragma once
+
+#include "common.h"
+#include "posix_file_handler.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace protostream {
+
+/** When a `segmented_stream` starts a new segment */
+struct segment_limits {
+    /** The segment is closed once its file is at least that large */
+    std::size_t max_segment_size = std::numeric_limits<std::size_t>::max();
+    /** The segment is closed once it holds that many keyframes */
+    keyframe_id_t max_segment_keyframes = std::numeric_limits<keyframe_id_t>::max();
+};
+
+namespace detail {
+/** Flushes the entries of `directory`, so that the files created or renamed
+ * in it survive a crash */
+inline void sync_directory(const std::string& directory) {
+    const auto fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        throw std::system_error{errno, std::system_category(), "open"};
+    }
+
+    if (fsync(fd) != 0) {
+        const auto error = errno;
+        close(fd);
+        throw std::system_error{error, std::system_category(), "fsync"};
+    }
+
+    close(fd);
+}
+
+/** The manifest of a segmented stream (see spec.txt) */
+struct segment_manifest {
+    std::uint32_t frames_per_kf = 0;
+    std::vector<std::uint8_t> proto_header;
+    /* The number of the first keyframe of every segment, in order */
+    std::vector<keyframe_id_t> first_keyframes;
+
+    static segment_manifest read(const std::string& path) {
+        posix_file_handler<file_mode_t::READ_ONLY> file{path.c_str()};
+        std::vector<std::uint8_t> buffer(file.size());
+        if (!buffer.empty()) {
+            file.read(0, buffer.size(), buffer.data());
+        }
+
+        auto pos = buffer.data();
+        const auto end = pos + buffer.size();
+        const auto take = [&pos, end](std::size_t size) {
+            if (static_cast<std::size_t>(end - pos) < size) {
+                throw std::runtime_error{"Manifest truncated"};
+            }
+            const auto result = pos;
+            pos += size;
+            return result;
+        };
+
+        if (memcmp(take(sizeof(magic) - 1), magic, sizeof(magic) - 1) != 0) {
+            throw std::runtime_error{"Invalid manifest"};
+        }
+
+        segment_manifest result;
+        result.frames_per_kf = readbuf_unaligned<std::uint32_t>(take(sizeof(std::uint32_t)));
+        const auto segment_count = readbuf_unaligned<std::uint32_t>(take(sizeof(std::uint32_t)));
+        const auto proto_header_size =
+            readbuf_unaligned<std::uint64_t>(take(sizeof(std::uint64_t)));
+
+        const auto proto_header = take(proto_header_size);
+        result.proto_header.assign(proto_header, proto_header + proto_header_size);
+
+        for (auto i = 0u; i < segment_count; ++i) {
+            const auto first = readbuf_unaligned<keyframe_id_t>(take(sizeof(keyframe_id_t)));
+            if (!result.first_keyframes.empty() && first <= result.first_keyframes.back()) {
+                throw std::runtime_error{"Segments not ordered in the manifest"};
+            }
+            result.first_keyframes.push_back(first);
+        }
+
+        if (pos != end || segment_count == 0) {
+            throw std::runtime_error{"Invalid manifest"};
+        }
+
+        return result;
+    }
+
+    /** Replaces the manifest at `path` atomically and durably */
+    void write(const std::string& path) const {
+        std::vector<std::uint8_t> buffer{magic, magic + sizeof(magic) - 1};
+        put(buffer, frames_per_kf);
+        put(buffer, static_cast<std::uint32_t>(first_keyframes.size()));
+        put(buffer, static_cast<std::uint64_t>(proto_header.size()));
+        buffer.insert(buffer.end(), proto_header.begin(), proto_header.end());
+        for (const auto first : first_keyframes) {
+            put(buffer, first);
+        }
+
+        const auto temporary = path + ".tmp";
+        if (unlink(temporary.c_str()) != 0 && errno != ENOENT) {
+            throw std::system_error{errno, std::system_category(), "unlink"};
+        }
+
+        {
+            posix_file_handler<file_mode_t::READ_APPEND> file{temporary.c_str()};
+            file.write(0, buffer.size(), buffer.data());
+            if (fsync(file.fd) != 0) {
+                throw std::system_error{errno, std::system_category(), "fsync"};
+            }
+        }
+
+        if (rename(temporary.c_str(), path.c_str()) != 0) {
+            throw std::system_error{errno, std::system_category(), "rename"};
+        }
+        const auto separator = path.rfind('/');
+        sync_directory(separator == std::string::npos ? "." : path.substr(0, separator + 1));
+    }
+
+private:
+    static constexpr char magic[] = "PSSEGMAN";
+
+    template <class T>
+    static void put(std::vector<std::uint8_t>& buffer, T value) {
+        const auto stored = htobe(value);
+        const auto ptr = reinterpret_cast<const std::uint8_t*>(&stored);
+        buffer.insert(buffer.end(), ptr, ptr + sizeof(stored));
+    }
+};
+
+constexpr char segment_manifest::magic[];
+}
+
+/** A stream split into segments, each of them a complete file readable by
+ * `Stream` on its own.
+ *
+ * The segments are kept in a directory together with a manifest listing
+ * them. A writer starts a new segment before appending a keyframe once the
+ * current segment reaches one of the `segment_limits`, so keyframes never
+ * span segments. The keyframes and frames are numbered across the segments;
+ * the keyframe numbers stored in a segment start from 0 though, so
+ * `keyframe_data::id()` is relative to its segment.
+ *
+ * All the segments are opened by the constructor. They are independent
+ * streams, so different segments may be read by different threads through
+ * `segment()`. The oldest segments may be deleted by
+ * `drop_segments_before()`.
+ */
+template <class Stream>
+class segmented_stream {
+public:
+    using stream_type = Stream;
+    using keyframe_data = typename Stream::keyframe_data;
+    using keyframe_metadata_type = typename Stream::keyframe_metadata_type;
+    using proto_header_type = typename Stream::proto_header_type;
+
+    /** Opens the segmented stream stored in `directory` */
+    explicit segmented_stream(const char* directory, segment_limits limits = segment_limits{});
+
+    /** Creates a new segmented stream in `directory`, creating the directory
+     * itself if needed */
+    segmented_stream(const char* directory,
+                     std::uint32_t frames_per_kf,
+                     const void* proto_header,
+                     std::size_t proto_header_size,
+                     segment_limits limits = segment_limits{});
+
+    segmented_stream(const segmented_stream&) = delete;
+
+    segmented_stream(segmented_stream&&) = default;
+
+    segmented_stream& operator=(const segmented_stream&) = delete;
+
+    segmented_stream& operator=(segmented_stream&&) = default;
+
+    proto_header_type get_proto_header() const {
+        return streams.front()->get_proto_header();
+    }
+
+    class keyframe_iterator;
+
+    /** A random access iterator over the keyframes of all the segments.
+     *
+     * Moving an iterator within a segment is done by the iterator of the
+     * segment; moving it to another segment starts from the beginning of
+     * that segment, found by a binary search of the manifest.
+     */
+    class keyframe_iterator : public std::iterator<std::random_access_iterator_tag,
+                                                   keyframe_data,
+                                                   std::ptrdiff_t,
+                                                   const keyframe_data*,
+                                                   const keyframe_data&> {
+    public:
+        using typename std::iterator<std::random_access_iterator_tag,
+                                     keyframe_data,
+                                     std::ptrdiff_t,
+                                     const keyframe_data*,
+                                     const keyframe_data&>::difference_type;
+
+        const keyframe_data& operator*() const {
+            return *inner;
+        }
+
+        const keyframe_data* operator->() const {
+            return &*inner;
+        }
+
+        keyframe_data operator[](difference_type diff) const {
+            return *(*this + diff);
+        }
+
+        keyframe_iterator& operator++() {
+            locate_segment();
+            if (num + 1 == str->segment_end(segment_index) &&
+                segment_index + 1 < str->streams.size()) {
+                seek(num + 1);
+            } else {
+                ++inner;
+                ++num;
+            }
+            return *this;
+        }
+
+        keyframe_iterator operator++(int) {
+            auto tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        keyframe_iterator& operator--() {
+            return *this -= 1;
+        }
+
+        keyframe_iterator operator--(int) {
+            auto tmp = *this;
+            --*this;
+            return tmp;
+        }
+
+        keyframe_iterator& operator+=(difference_type diff) {
+            seek(num + diff);
+            return *this;
+        }
+
+        keyframe_iterator& operator-=(difference_type diff) {
+            seek(num - diff);
+            return *this;
+        }
+
+        keyframe_iterator operator+(difference_type diff) const {
+            auto tmp = *this;
+            return tmp += diff;
+        }
+
+        friend keyframe_iterator operator+(difference_type diff, const keyframe_iterator& it) {
+            return it + diff;
+        }
+
+        keyframe_iterator operator-(difference_type diff) const {
+            auto tmp = *this;
+            return tmp -= diff;
+        }
+
+        difference_type operator-(const keyframe_iterator& that) const {
+            assert(str == that.str);
+            return static_cast<difference_type>(num - that.num);
+        }
+
+        bool operator==(const keyframe_iterator& that) const {
+            return str == that.str && num == that.num;
+        }
+
+        bool operator!=(const keyframe_iterator& that) const {
+            return !(*this == that);
+        }
+
+        bool operator<(const keyframe_iterator& that) const {
+            assert(str == that.str);
+            return num < that.num;
+        }
+
+        bool operator>(const keyframe_iterator& that) const {
+            return that < *this;
+        }
+
+        bool operator<=(const keyframe_iterator& that) const {
+            return !(that < *this);
+        }
+
+        bool operator>=(const keyframe_iterator& that) const {
+            return !(*this < that);
+        }
+
+        /** Returns the number of the keyframe across all the segments */
+        keyframe_id_t keyframe_id() const {
+            return num;
+        }
+
+    private:
+        keyframe_iterator(const segmented_stream& str, keyframe_id_t num)
+            : str{&str},
+              num{num},
+              segment_index{str.segment_of(num)},
+              segment_first{str.segment_begin(segment_index)},
+              inner{str.streams[segment_index]->begin() +
+                    static_cast<difference_type>(num - segment_first)} {
+        }
+
+        /** Updates the index of the current segment, which is shifted when
+         * the segments preceding it are dropped */
+        void locate_segment() {
+            if (segment_index >= str->streams.size() ||
+                str->segment_begin(segment_index) != segment_first) {
+                segment_index = str->segment_of(segment_first);
+            }
+        }
+
+        /** Moves the iterator to the keyframe `target` */
+        void seek(keyframe_id_t target) {
+            locate_segment();
+            if (target >= str->segment_begin(segment_index) &&
+                (target < str->segment_end(segment_index) ||
+                 segment_index + 1 == str->streams.size())) {
+                inner += static_cast<difference_type>(target) - static_cast<difference_type>(num);
+            } else {
+                segment_index = str->segment_of(target);
+                segment_first = str->segment_begin(segment_index);
+                inner = str->streams[segment_index]->begin() +
+                        static_cast<difference_type>(target - segment_first);
+            }
+            num = target;
+        }
+
+        const segmented_stream* str;
+        keyframe_id_t num;
+        std::size_t segment_index;
+        /* The number of the first keyframe of the current segment, which
+         * identifies it even after preceding segments are dropped */
+        keyframe_id_t segment_first;
+        typename Stream::keyframe_iterator inner;
+
+        friend class segmented_stream;
+    };
+
+    keyframe_iterator begin() const {
+        return {*this, first_keyframe()};
+    }
+
+    keyframe_iterator end() const {
+        return {*this, keyframe_count()};
+    }
+
+    /** Returns an iterator to the first keyframe whose metadata is not less
+     * than `key`, or `end()` if there is none. See
+     * `stream::lower_bound_by_metadata`. */
+    keyframe_iterator lower_bound_by_metadata(
+        const typename keyframe_metadata_type::type& key) const {
+        return std::partition_point(begin(), end(), [&key](const keyframe_data& keyframe) {
+            return keyframe.metadata() < key;
+        });
+    }
+
+    void append_delta(const std::uint8_t* data, delta_size_t size) {
+        streams.back()->append_delta(data, size);
+    }
+
+    /** Appends a keyframe, starting a new segment first if the current one
+     * reached the limits */
+    void append_keyframe(const std::uint8_t* data,
+                         std::size_t size,
+                         typename keyframe_metadata_type::type metadata = {}) {
+        if (segment_full()) {
+            add_segment(keyframe_count());
+        }
+        streams.back()->append_keyframe(data, size, metadata);
+    }
+
+    /** Returns the number of frames, including the ones of dropped segments */
+    std::size_t frame_count() const {
+        return segment_begin(streams.size() - 1) * frames_per_keyframe() +
+               streams.back()->frame_count();
+    }
+
+    /** Returns the number of keyframes, including the ones of dropped segments */
+    std::size_t keyframe_count() const {
+        return segment_begin(streams.size() - 1) + streams.back()->keyframe_count();
+    }
+
+    /** Returns the number of the first keyframe not dropped */
+    keyframe_id_t first_keyframe() const {
+        return segment_begin(0);
+    }
+
+    std::uint32_t frames_per_keyframe() const {
+        return manifest.frames_per_kf;
+    }
+
+    std::size_t segment_count() const {
+        return streams.size();
+    }
+
+    const Stream& segment(std::size_t index) const {
+        return *streams[index];
+    }
+
+    /** Returns the number of the first keyframe of the segment `index` */
+    keyframe_id_t segment_begin(std::size_t index) const {
+        return manifest.first_keyframes[index];
+    }
+
+    /** Deletes the segments all of whose keyframes precede `keyframe_id`.
+     * The last segment is never deleted.
+     *
+     * The iterators to the keyframes of the deleted segments are
+     * invalidated. The other iterators remain valid. */
+    void drop_segments_before(keyframe_id_t keyframe_id) {
+        auto count = std::size_t{0};
+        while (count + 1 < streams.size() && segment_begin(count + 1) <= keyframe_id) {
+            ++count;
+        }
+
+        if (count == 0) {
+            return;
+        }
+
+        /* The manifest is updated first, so that a segment listed in it is
+         * never missing */
+        auto updated = manifest;
+        updated.first_keyframes.erase(updated.first_keyframes.begin(),
+                                      updated.first_keyframes.begin() + count);
+        updated.write(manifest_path());
+
+        std::vector<std::string> paths;
+        for (auto i = std::size_t{0}; i < count; ++i) {
+            paths.push_back(segment_path(segment_begin(i)));
+        }
+
+        manifest = std::move(updated);
+        streams.erase(streams.begin(), streams.begin() + count);
+
+        for (const auto& path : paths) {
+            if (unlink(path.c_str()) != 0 && errno != ENOENT) {
+                throw std::system_error{errno, std::system_category(), "unlink"};
+            }
+        }
+    }
+
+    /** Returns the estimated number of bytes of memory used by the streams of
+     * all the segments */
+    std::size_t memory_usage() const {
+        auto result = sizeof(*this) + manifest.proto_header.capacity() +
+                      manifest.first_keyframes.capacity() * sizeof(keyframe_id_t);
+        for (const auto& stream : streams) {
+            result += stream->memory_usage();
+        }
+        return result;
+    }
+
+private:
+    std::string directory;
+    segment_limits limits;
+    detail::segment_manifest manifest;
+    std::vector<std::unique_ptr<Stream>> streams;
+
+    std::string manifest_path() const {
+        return directory + "/manifest";
+    }
+
+    /** The segments are named after their first keyframes */
+    std::string segment_path(keyframe_id_t first_keyframe) const {
+        char name[32];
+        snprintf(name, sizeof(name), "/%020" PRIu64 ".segment", first_keyframe);
+        return directory + name;
+    }
+
+    /** Returns the number of the keyframe following the segment `index` */
+    keyframe_id_t segment_end(std::size_t index) const {
+        return index + 1 < streams.size() ? segment_begin(index + 1) : keyframe_count();
+    }
+
+    /** Returns the index of the segment holding the keyframe `keyframe_id`,
+     * or of the last segment if it is the end of the stream */
+    std::size_t segment_of(keyframe_id_t keyframe_id) const {
+        const auto& firsts = manifest.first_keyframes;
+        const auto it = std::upper_bound(firsts.begin(), firsts.end(), keyframe_id);
+        assert(it != firsts.begin());
+        return static_cast<std::size_t>(it - firsts.begin()) - 1;
+    }
+
+    bool segment_full() const {
+        const Stream& last = *streams.back();
+        return last.keyframe_count() > 0 && (last.file_size() >= limits.max_segment_size ||
+                                             last.keyframe_count() >= limits.max_segment_keyframes);
+    }
+
+    /** Creates a segment starting with the keyframe `first_keyframe` and
+     * records it in the manifest */
+    void add_segment(keyframe_id_t first_keyframe) {
+        const auto path = segment_path(first_keyframe);
+
+        /* A segment not listed in the manifest is a leftover of an
+         * interrupted rollover */
+        if (unlink(path.c_str()) != 0 && errno != ENOENT) {
+            throw std::system_error{errno, std::system_category(), "unlink"};
+        }
+
+        auto stream = std::make_unique<Stream>(path.c_str(), manifest.frames_per_kf,
+                                               manifest.proto_header.data(),
+                                               manifest.proto_header.size());
+        /* The manifest must never list a segment lost by a crash */
+        detail::sync_directory(directory);
+
+        auto updated = manifest;
+        updated.first_keyframes.push_back(first_keyframe);
+        updated.write(manifest_path());
+
+        manifest = std::move(updated);
+        streams.push_back(std::move(stream));
+    }
+};
+
+template <class Stream>
+segmented_stream<Stream>::segmented_stream(const char* directory, segment_limits limits)
+    : directory{directory},
+      limits{limits},
+      manifest{detail::segment_manifest::read(manifest_path())} {
+    const auto& firsts = manifest.first_keyframes;
+    for (auto i = std::size_t{0}; i < firsts.size(); ++i) {
+        streams.push_back(std::make_unique<Stream>(segment_path(firsts[i]).c_str()));
+    }
+
+    for (auto i = std::size_t{0}; i < streams.size(); ++i) {
+        const Stream& stream = *streams[i];
+        if (stream.frames_per_keyframe() != manifest.frames_per_kf) {
+            throw std::runtime_error{"Segment not consistent with the manifest"};
+        }
+
+        /* Only the last segment may be extended */
+        if (i + 1 < streams.size() &&
+            (stream.keyframe_count() != firsts[i + 1] - firsts[i] ||
+             stream.frame_count() != stream.keyframe_count() * manifest.frames_per_kf)) {
+            throw std::runtime_error{"Segment not consistent with the manifest"};
+        }
+    }
+}
+
+template <class Stream>
+segmented_stream<Stream>::segmented_stream(const char* directory,
+                                           std::uint32_t frames_per_kf,
+                                           const void* proto_header,
+                                           std::size_t proto_header_size,
+                                           segment_limits limits)
+    : directory{directory}, limits{limits} {
+    if (mkdir(directory, 0777) != 0 && errno != EEXIST) {
+        throw std::system_error{errno, std::system_category(), "mkdir"};
+    }
+
+    if (access(manifest_path().c_str(), F_OK) == 0) {
+        throw std::runtime_error{"Segmented stream already exists"};
+    }
+
+    const auto proto_header_ptr = static_cast<const std::uint8_t*>(proto_header);
+    manifest.frames_per_kf = frames_per_kf;
+    manifest.proto_header.assign(proto_header_ptr, proto_header_ptr + proto_header_size);
+
+    add_segment(0);
+}
+
+template <class Stream>
+auto begin(const segmented_stream<Stream>& stream) {
+    return stream.begin();
+}
+
+template <class Stream>
+auto end(const segmented_stream<Stream>& stream) {
+    return stream.end();
+}
+}
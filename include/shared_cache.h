@@ -0,0 +1,240 @@
+#pragma once
+
+#include "cache.h"
+#include "header.h"
+#include "posix_file_handler.h"
+
+#include <cstddef>
+
+#include <experimental/optional>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace protostream {
+
+namespace detail {
+/** The keyframe offsets and headers of a file, shared by all the
+ * `shared_cache`s reading it */
+class shared_file_index {
+public:
+    std::experimental::optional<offset_t> find(keyframe_id_t keyframe_id) const {
+        std::lock_guard<std::mutex> lock{mutex};
+        return offsets.find(keyframe_id);
+    }
+
+    std::experimental::optional<std::pair<keyframe_id_t, offset_t>> nearest_known(
+        keyframe_id_t keyframe_id) const {
+        std::lock_guard<std::mutex> lock{mutex};
+        return offsets.nearest_known(keyframe_id);
+    }
+
+    void insert(keyframe_id_t keyframe_id,
+                offset_t offset,
+                const offset_t* skiplist,
+                unsigned height) {
+        std::lock_guard<std::mutex> lock{mutex};
+        offsets.insert(keyframe_id, offset, skiplist, height);
+    }
+
+    std::experimental::optional<reduced_keyframe_header> header_at(offset_t offset) const {
+        std::lock_guard<std::mutex> lock{mutex};
+        const auto it = headers.find(offset);
+        if (it == headers.end()) {
+            return {};
+        } else {
+            return {it->second};
+        }
+    }
+
+    void insert_header(offset_t offset, const reduced_keyframe_header& header) {
+        std::lock_guard<std::mutex> lock{mutex};
+        headers.emplace(offset, header);
+    }
+
+    /** Forgets the keyframes from `keyframe_id` on, placed at `offset` or further */
+    void erase_from(keyframe_id_t keyframe_id, offset_t offset) {
+        std::lock_guard<std::mutex> lock{mutex};
+        offsets.erase_from(keyframe_id);
+        headers.erase(headers.lower_bound(offset), headers.end());
+    }
+
+    std::size_t memory_usage() const {
+        std::lock_guard<std::mutex> lock{mutex};
+        /* A red-black tree node holds three pointers and the colour */
+        using node = decltype(headers)::value_type;
+        return sizeof(*this) + offsets.memory_usage() +
+               headers.size() * (sizeof(node) + 4 * sizeof(void*));
+    }
+
+private:
+    mutable std::mutex mutex;
+    offset_index offsets;
+    /* Ordered like the headers of `full_cache` */
+    std::map<offset_t, reduced_keyframe_header> headers;
+};
+
+/** Makes a shared index usable as the `Index` of `cache_base` */
+class shared_offsets {
+public:
+    explicit shared_offsets(std::shared_ptr<shared_file_index> index) : index{std::move(index)} {
+    }
+
+    std::experimental::optional<offset_t> find(keyframe_id_t keyframe_id) const {
+        return index->find(keyframe_id);
+    }
+
+    std::experimental::optional<std::pair<keyframe_id_t, offset_t>> nearest_known(
+        keyframe_id_t keyframe_id) const {
+        return index->nearest_known(keyframe_id);
+    }
+
+    void insert(keyframe_id_t keyframe_id,
+                offset_t offset,
+                const offset_t* skiplist,
+                unsigned height) {
+        index->insert(keyframe_id, offset, skiplist, height);
+    }
+
+    std::size_t memory_usage() const {
+        return index->memory_usage();
+    }
+
+private:
+    std::shared_ptr<shared_file_index> index;
+};
+}
+
+/** The process-wide registry of the indexes used by `shared_cache`s.
+ *
+ * An index is kept as long as some cache uses it. As the cache's stream
+ * keeps the file open, the identity of the file cannot be reused by another
+ * file in the meantime. The identity includes the size and the modification
+ * time of the file, so the caches opened after the file was modified get a
+ * new index rather than one describing the old contents.
+ */
+class shared_index_registry {
+public:
+    static shared_index_registry& instance() {
+        static shared_index_registry registry;
+        return registry;
+    }
+
+    /** Returns the index of the given version of a file, creating it if
+     * needed */
+    std::shared_ptr<detail::shared_file_index> get(const file_identity& identity) {
+        std::lock_guard<std::mutex> lock{mutex};
+
+        auto& entry = indexes[identity];
+        auto index = entry.lock();
+        if (!index) {
+            index = std::make_shared<detail::shared_file_index>();
+            entry = index;
+            collect();
+        }
+
+        return index;
+    }
+
+    /** Returns the number of indexes in use */
+    std::size_t size() {
+        std::lock_guard<std::mutex> lock{mutex};
+        collect();
+        return indexes.size();
+    }
+
+private:
+    struct identity_hash {
+        std::size_t operator()(const file_identity& identity) const {
+            auto result = std::hash<decltype(identity.inode)>{}(identity.inode);
+            result = result * 31 + std::hash<decltype(identity.device)>{}(identity.device);
+            result = result * 31 + std::hash<decltype(identity.size)>{}(identity.size);
+            result = result * 31 + std::hash<decltype(identity.mtime_sec)>{}(identity.mtime_sec);
+            return result * 31 + std::hash<decltype(identity.mtime_nsec)>{}(identity.mtime_nsec);
+        }
+    };
+
+    std::mutex mutex;
+    std::unordered_map<file_identity, std::weak_ptr<detail::shared_file_index>, identity_hash>
+        indexes;
+
+    shared_index_registry() = default;
+
+    /** Drops the indexes no longer in use */
+    void collect() {
+        for (auto it = indexes.begin(); it != indexes.end();) {
+            if (it->second.expired()) {
+                it = indexes.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+};
+
+/** Caches the keyframe offsets and headers like `full_cache`, but shares
+ * them between all the `shared_cache`s reading the same version of a file
+ * (see `file_identity`), across threads.
+ *
+ * The memory and the warm-up cost of the index are thus paid once per file.
+ * A cache opened after the file was modified uses a new index. The file must
+ * not be truncated nor rewritten while it is read; appending keyframes to it
+ * is fine. `Backend` must provide `file_identity identity()`.
+ */
+template <class Backend>
+class shared_cache : public cache_base<shared_cache<Backend>, Backend, detail::shared_offsets> {
+    using base = cache_base<shared_cache<Backend>, Backend, detail::shared_offsets>;
+
+protected:
+    using base::retrieve;
+    using base::stats;
+
+public:
+    /** The shared index is guarded by a mutex, see `detail::shared_file_index` */
+    static constexpr bool thread_safe = true;
+
+    explicit shared_cache(Backend& backend, const keyframe_layout& layout = keyframe_layout{})
+        : shared_cache{backend, layout, shared_index_registry::instance().get(backend.identity())} {
+    }
+
+    reduced_keyframe_header header_at(offset_t offset) {
+        if (const auto header = index->header_at(offset)) {
+            stats().on_cache_hit();
+            return *header;
+        }
+        stats().on_cache_miss();
+
+        const auto header = retrieve(offset);
+        index->insert_header(offset, header);
+        return header;
+    }
+
+    /** Forgets the keyframes from `keyframe_id` on in all the streams sharing
+     * the index */
+    void forget_from(keyframe_id_t keyframe_id, offset_t offset) {
+        index->erase_from(keyframe_id, offset);
+    }
+
+    /** Returns the estimated number of bytes used by the shared index */
+    std::size_t memory_usage() const {
+        return index->memory_usage();
+    }
+
+    /** Returns the index shared with the other caches reading the file */
+    const detail::shared_file_index& shared_index() const {
+        return *index;
+    }
+
+private:
+    std::shared_ptr<detail::shared_file_index> index;
+
+    shared_cache(Backend& backend,
+                 const keyframe_layout& layout,
+                 std::shared_ptr<detail::shared_file_index> index)
+        : base{backend, layout, detail::shared_offsets{index}}, index{std::move(index)} {
+    }
+};
+}
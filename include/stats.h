@@ -0,0 +1,208 @@
+#pragma once
+
+#include "common.h"
+#include "utils.h"
+
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace protostream {
+
+/** The statistics policy used by default: records nothing.
+ *
+ * A statistics policy (see `with_stats`) must provide the following members,
+ * called whenever the corresponding event occurs:
+ *   * void on_read(std::size_t bytes)
+ *       a backend read
+ *   * void on_write(std::size_t bytes)
+ *       a backend write
+ *   * void on_allocation(std::size_t bytes)
+ *       a buffer allocated by a backend read
+ *   * void on_expansion()
+ *       a remapping of a memory-mapped file growing past its mapping
+ *   * void on_header_write()
+ *       a rewrite of the file header
+ *   * void on_link_hop()
+ *       a skiplist link followed by a cache
+ *   * void on_cache_hit(), void on_cache_miss()
+ *       a keyframe offset or header looked up in a cache
+ */
+struct no_stats {
+    void on_read(std::size_t) const {
+    }
+
+    void on_write(std::size_t) const {
+    }
+
+    void on_allocation(std::size_t) const {
+    }
+
+    void on_expansion() const {
+    }
+
+    void on_header_write() const {
+    }
+
+    void on_link_hop() const {
+    }
+
+    void on_cache_hit() const {
+    }
+
+    void on_cache_miss() const {
+    }
+};
+
+/** A statistics policy counting the events */
+struct counting_stats {
+    std::uint64_t reads = 0;
+    std::uint64_t bytes_read = 0;
+    std::uint64_t writes = 0;
+    std::uint64_t bytes_written = 0;
+    std::uint64_t bytes_allocated = 0;
+    std::uint64_t mmap_expansions = 0;
+    std::uint64_t header_writes = 0;
+    std::uint64_t link_hops = 0;
+    std::uint64_t cache_hits = 0;
+    std::uint64_t cache_misses = 0;
+
+    void on_read(std::size_t bytes) {
+        ++reads;
+        bytes_read += bytes;
+    }
+
+    void on_write(std::size_t bytes) {
+        ++writes;
+        bytes_written += bytes;
+    }
+
+    void on_allocation(std::size_t bytes) {
+        bytes_allocated += bytes;
+    }
+
+    void on_expansion() {
+        ++mmap_expansions;
+    }
+
+    void on_header_write() {
+        ++header_writes;
+    }
+
+    void on_link_hop() {
+        ++link_hops;
+    }
+
+    void on_cache_hit() {
+        ++cache_hits;
+    }
+
+    void on_cache_miss() {
+        ++cache_misses;
+    }
+};
+
+namespace detail {
+template <class Backend, class = void>
+struct has_mapped_size : std::false_type {};
+
+template <class Backend>
+struct has_mapped_size<Backend, void_t<decltype(std::declval<const Backend&>().mapped_size())>>
+    : std::true_type {};
+
+/** Wraps a backend, reporting its reads and writes to a statistics policy.
+ *
+ * Buffers are counted as allocated if `pointer_type` is not a raw pointer.
+ * Expansions are counted only for backends providing
+ * `std::size_t mapped_size() const`.
+ */
+template <class Backend, class Stats>
+class stats_backend : public Backend {
+public:
+    using typename Backend::pointer_type;
+
+    stats_backend(const char* path) : Backend{path} {
+    }
+
+    template <class T>
+    void read_small(offset_t offset, T* into) const {
+        stats.on_read(sizeof(T));
+        Backend::read_small(offset, into);
+    }
+
+    pointer_type read(offset_t offset, std::size_t length) const {
+        stats.on_read(length);
+        if (!std::is_pointer<pointer_type>::value) {
+            stats.on_allocation(length);
+        }
+        return Backend::read(offset, length);
+    }
+
+    template <class T>
+    T read_num(offset_t offset) const {
+        T value;
+        read_small(offset, &value);
+        return betoh(value);
+    }
+
+    template <class T>
+    void write_small(offset_t offset, const T* from) {
+        const auto mapped = mapped_size();
+        stats.on_write(sizeof(T));
+        Backend::write_small(offset, from);
+        count_expansion(mapped);
+    }
+
+    template <bool /* dummy */ = true>
+    void write(offset_t offset, std::size_t length, const std::uint8_t* from) {
+        const auto mapped = mapped_size();
+        stats.on_write(length);
+        Backend::write(offset, length, from);
+        count_expansion(mapped);
+    }
+
+    template <class T>
+    void write_num(offset_t offset, T value) {
+        value = htobe(value);
+        write_small(offset, &value);
+    }
+
+    Stats& statistics() const {
+        return stats;
+    }
+
+private:
+    mutable Stats stats;
+
+    std::size_t mapped_size() const {
+        return mapped_size(has_mapped_size<Backend>{});
+    }
+
+    std::size_t mapped_size(std::true_type) const {
+        return Backend::mapped_size();
+    }
+
+    std::size_t mapped_size(std::false_type) const {
+        return 0;
+    }
+
+    void count_expansion(std::size_t mapped_before) const {
+        if (mapped_size() != mapped_before) {
+            stats.on_expansion();
+        }
+    }
+};
+
+/** Returns the statistics policy of a backend, a no-op one unless the
+ * backend is wrapped in `stats_backend` */
+template <class Backend>
+no_stats stats_of(const Backend&) {
+    return {};
+}
+
+template <class Backend, class Stats>
+Stats& stats_of(const stats_backend<Backend, Stats>& backend) {
+    return backend.statistics();
+}
+}
+}
@@ -1,14 +1,27 @@
 #pragma once
 
+#include "codec.h"
 #include "common.h"
+#include "crc32c.h"
 #include "header.h"
+#include "io_thread_pool.h"
+#include "posix_file_handler.h"
+#include "probes.h"
+#include "stats.h"
 #include "utils.h"
 
 #include <cassert>
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <future>
 #include <iterator>
+#include <limits>
 #include <memory>
+#include <stdexcept>
 #include <type_traits>
+#include <vector>
 
 namespace protostream {
 
@@ -64,6 +77,200 @@ struct with_delta_factory : detail::constraint {
     using delta_factory_type = DeltaFactory;
 };
 
+/** Keyframe metadata used by default: occupies no space in the file */
+struct no_keyframe_metadata {
+    using type = std::nullptr_t;
+    static constexpr offset_t offset = 0;
+    static constexpr std::size_t size = 0;
+
+    type value;
+
+    template <class... Args>
+    static no_keyframe_metadata read(Args&&...) {
+        return {};
+    }
+
+    template <class... Args>
+    void write(Args&&...) const {
+    }
+};
+
+/** Stores a fixed-size user metadata field (e.g. a timestamp) after every
+ * keyframe header.
+ *
+ * `Metadata` is a `detail::with_offset` field whose offset is relative to the
+ * end of the reduced keyframe header, e.g.
+ *     struct timestamp : detail::with_offset<std::uint64_t, 0> {};
+ *
+ * The metadata can be read without touching the keyframe payload and, if it
+ * is non-decreasing, used to seek with `stream::lower_bound_by_metadata`.
+ * This option is optional, by default keyframes carry no metadata.
+ */
+template <class Metadata>
+struct with_keyframe_metadata : detail::constraint {
+    using keyframe_metadata_type = Metadata;
+};
+
+/** Transparently compresses the keyframe and delta payloads using `Codec`
+ * (see codec.h).
+ *
+ * The payloads are compressed by `append_*` and decompressed by
+ * `keyframe_data::get()` and `delta_data::get()`, whereas `raw()` and
+ * `size()` refer to the stored (compressed) data. If a codec is set, the
+ * factories are passed a `std::unique_ptr<const std::uint8_t[]>` owning the
+ * decompressed payload instead of a backend pointer. The codec id is recorded
+ * in the file header and checked when a file is opened.
+ * Every stored payload starts with a one-byte method tag, so a delta which
+ * does not compress can hold at most 65534 bytes instead of 65535.
+ * This option is optional, by default payloads are stored as they are.
+ */
+template <class Codec>
+struct with_codec : detail::constraint {
+    using codec_type = Codec;
+};
+
+/** Checksum verification modes (see `with_checksums`) */
+enum class checksum_mode {
+    /** No checksums are written into new files nor verified */
+    off,
+    /** Checksums are verified lazily, by `keyframe_data::get()` and `delta_data::get()` */
+    on_read,
+    /** Checksums (and the keyframe chain) are verified when a file is opened */
+    eager
+};
+
+/** Protects every keyframe and delta of new files with a CRC32C checksum.
+ *
+ * Whether a file contains checksums is recorded in its header, so a file
+ * can be read with any mode. Appending to a file with checksums always
+ * writes them, even if `Mode` is `checksum_mode::off`.
+ * This option is optional, by default the mode is `checksum_mode::off`.
+ */
+template <checksum_mode Mode>
+struct with_checksums : detail::constraint {
+    using checksum_mode_type = std::integral_constant<checksum_mode, Mode>;
+};
+
+/** Stores the numbers following the file header in the given byte order.
+ *
+ * With `byte_order::native`, keyframe headers, skiplist links, delta sizes
+ * and checksums are stored as they are in memory, so that they are read
+ * without byte swapping.
+ * The byte order is recorded in the file header and checked when a file is
+ * opened. This option is optional, by default numbers are big-endian.
+ */
+template <byte_order Order>
+struct with_byte_order : detail::constraint {
+    using byte_order_type = std::integral_constant<byte_order, Order>;
+};
+
+/** Sets the skiplist height of new files.
+ *
+ * Every keyframe links to the `Height` following keyframes at distances 1,
+ * 2, 4, ..., 2^(Height - 1), so higher skiplists make long seeks take fewer
+ * hops at the cost of 8 bytes per level in every keyframe header. The height
+ * is recorded in the file header, so files of any height can be read.
+ * This option is optional, by default the height is `fields::skiplist_height`.
+ */
+template <unsigned Height>
+struct with_skiplist_height : detail::constraint {
+    static_assert(Height > 0 && Height <= fields::max_skiplist_height, "Invalid skiplist height");
+
+    using skiplist_height_type = std::integral_constant<unsigned, Height>;
+};
+
+/** Reports I/O and cache events to the statistics policy `Stats` (see
+ * stats.h), e.g. `counting_stats`. The statistics are returned by
+ * `stream::stats()`.
+ * This option is optional, by default `no_stats` is used, which compiles to
+ * nothing.
+ */
+template <class Stats>
+struct with_stats : detail::constraint {
+    using stats_type = Stats;
+};
+
+namespace detail {
+/** Whether a cache may be used by several threads at once, as declared by
+ * its `static constexpr bool thread_safe` member */
+template <class Cache, class = void>
+struct is_thread_safe_cache : std::false_type {};
+
+template <class Cache>
+struct is_thread_safe_cache<Cache, void_t<decltype(Cache::thread_safe)>>
+    : std::integral_constant<bool, Cache::thread_safe> {};
+
+/** Whether the const members of a backend may be called by several threads
+ * at once, as declared by its `static constexpr bool thread_safe` member */
+template <class Backend, class = void>
+struct is_thread_safe_backend : std::false_type {};
+
+template <class Backend>
+struct is_thread_safe_backend<Backend, void_t<decltype(Backend::thread_safe)>>
+    : std::integral_constant<bool, Backend::thread_safe> {};
+
+/** Whether a backend may write into its file, as told by the mode of the
+ * file handler returned by its `handler()` member */
+template <class Backend, class = void>
+struct is_writable_backend : std::false_type {};
+
+template <class Backend>
+struct is_writable_backend<Backend, void_t<decltype(std::declval<const Backend&>().handler())>>
+    : std::is_same<std::decay_t<decltype(std::declval<const Backend&>().handler())>,
+                   posix_file_handler<file_mode_t::READ_APPEND>> {};
+
+template <class Options, class = void>
+struct stats_policy_of {
+    using type = no_stats;
+};
+
+template <class Options>
+struct stats_policy_of<Options, void_t<typename Options::stats_type>> {
+    using type = typename Options::stats_type;
+};
+
+template <class Options, class = void>
+struct skiplist_height_of : std::integral_constant<unsigned, fields::skiplist_height> {};
+
+template <class Options>
+struct skiplist_height_of<Options, void_t<typename Options::skiplist_height_type>>
+    : Options::skiplist_height_type {};
+
+template <class Options, class = void>
+struct byte_order_of : std::integral_constant<byte_order, byte_order::big> {};
+
+template <class Options>
+struct byte_order_of<Options, void_t<typename Options::byte_order_type>>
+    : Options::byte_order_type {};
+
+template <class Options, class = void>
+struct checksum_mode_of : std::integral_constant<checksum_mode, checksum_mode::off> {};
+
+template <class Options>
+struct checksum_mode_of<Options, void_t<typename Options::checksum_mode_type>>
+    : Options::checksum_mode_type {};
+
+template <class Options, class = void>
+struct codec_of {
+    using type = identity_codec;
+};
+
+template <class Options>
+struct codec_of<Options, void_t<typename Options::codec_type>> {
+    using type = typename Options::codec_type;
+};
+
+template <class Options, class = void>
+struct keyframe_metadata_of {
+    using type = no_keyframe_metadata;
+};
+
+template <class Options>
+struct keyframe_metadata_of<Options, void_t<typename Options::keyframe_metadata_type>> {
+    using type = typename Options::keyframe_metadata_type;
+};
+}
+
 template <class Pointer>
 struct default_factory {
     using type = std::pair<Pointer, std::size_t>;
@@ -76,7 +283,12 @@ struct default_factory {
 template <class... Args>
 class stream : public detail::options_handler<Args...> {
 public:
-    using typename detail::options_handler<Args...>::backend_type;
+    using stats_type = typename detail::stats_policy_of<detail::options_handler<Args...>>::type;
+    /* The backend is wrapped only if the statistics are recorded */
+    using backend_type = std::conditional_t<
+        std::is_same<stats_type, no_stats>::value,
+        typename detail::options_handler<Args...>::backend_type,
+        detail::stats_backend<typename detail::options_handler<Args...>::backend_type, stats_type>>;
     using cache_type = typename detail::options_handler<Args...>::template cache_type<backend_type>;
     using typename detail::options_handler<Args...>::proto_header_factory_type;
     using typename detail::options_handler<Args...>::keyframe_factory_type;
@@ -85,6 +297,32 @@ public:
     using proto_header_type = typename proto_header_factory_type::type;
     using keyframe_type = typename keyframe_factory_type::type;
     using delta_type = typename delta_factory_type::type;
+    using keyframe_metadata_type =
+        typename detail::keyframe_metadata_of<detail::options_handler<Args...>>::type;
+
+    static constexpr std::size_t keyframe_metadata_size =
+        keyframe_metadata_type::offset + keyframe_metadata_type::size;
+
+    static_assert(keyframe_metadata_size <= std::numeric_limits<std::uint8_t>::max(),
+                  "Keyframe metadata too large");
+
+    using codec_type = typename detail::codec_of<detail::options_handler<Args...>>::type;
+
+    static constexpr bool is_compressed = !std::is_same<codec_type, identity_codec>::value;
+
+    static constexpr checksum_mode checksums =
+        detail::checksum_mode_of<detail::options_handler<Args...>>::value;
+
+    static constexpr byte_order stored_byte_order =
+        detail::byte_order_of<detail::options_handler<Args...>>::value;
+
+    /** The skiplist height of the files created by this stream type */
+    static constexpr unsigned new_file_skiplist_height =
+        detail::skiplist_height_of<detail::options_handler<Args...>>::value;
+
+    /** The pointer type passed to the keyframe and delta factories */
+    using payload_pointer_type =
+        std::conditional_t<is_compressed, std::unique_ptr<const std::uint8_t[]>, pointer_type>;
 
     /** Opens the file and reads the header from it */
     stream(const char* path);
@@ -119,11 +357,14 @@ public:
         using size_type = delta_size_t;
 
         delta_type get() const {
-            return delta_factory_type::build(raw(), size());
+            if (checksums == checksum_mode::on_read) {
+                str->verify_delta(offset);
+            }
+            return str->template build<delta_factory_type>(raw(), size());
         }
 
         bool operator==(const delta_data& that) const {
-            return &str == &that.str && frame_id == that.frame_id;
+            return str == that.str && frame_id == that.frame_id;
         }
 
         bool operator!=(const delta_data& that) const {
@@ -131,15 +372,15 @@ public:
         }
 
         size_type size() const {
-            return str.backend.template read_num<size_type>(offset);
+            return str->template read_num<size_type>(offset);
         }
 
         pointer_type raw() const {
-            return str.backend.read(offset + sizeof(size_type), size());
+            return str->backend.read(offset + str->delta_header_size(), size());
         }
 
     private:
-        const stream& str;
+        const stream* str;
         offset_t offset;
         keyframe_id_t frame_id;
 
@@ -147,13 +388,15 @@ public:
      * `frame_id`s are used in comparison operators.
      */
         delta_data(const stream& str, keyframe_id_t frame_id)
-            : str{str}, offset{std::numeric_limits<offset_t>::max()}, frame_id{frame_id} {
+            : str{&str}, offset{std::numeric_limits<offset_t>::max()}, frame_id{frame_id} {
         }
 
         delta_data(const stream& str, offset_t offset, keyframe_id_t frame_id)
-            : str{str}, offset{offset}, frame_id{frame_id} {
+            : str{&str}, offset{offset}, frame_id{frame_id} {
         }
 
+        friend class stream;
+
         friend class delta_iterator;
     };
 
@@ -168,7 +411,7 @@ public:
         }
 
         delta_iterator& operator++() {
-            data.offset += sizeof(typename delta_data::size_type) + data.size();
+            data.offset += data.str->delta_header_size() + data.size();
             data.frame_id++;
             return *this;
         }
@@ -204,21 +447,24 @@ public:
     class keyframe_data {
     public:
         keyframe_type get() const {
-            return keyframe_factory_type::build(raw(), size());
+            if (checksums == checksum_mode::on_read) {
+                str->verify_keyframe(offset, header());
+            }
+            return str->template build<keyframe_factory_type>(raw(), size());
         }
 
         delta_iterator begin() const {
-            return {str, field<fields::delta_offset>(),
-                    id() * str.header_field<fields::frames_per_kf>() + 1};
+            return {*str, field<fields::delta_offset>(),
+                    id() * str->header_field<fields::frames_per_kf>() + 1};
         }
 
         delta_iterator end() const {
-            return {str, std::min(str.header_field<fields::frame_count>(),
-                                  (id() + 1) * str.header_field<fields::frames_per_kf>())};
+            return {*str, std::min(str->header_field<fields::frame_count>(),
+                                   (id() + 1) * str->header_field<fields::frames_per_kf>())};
         }
 
         bool operator==(const keyframe_data& that) const {
-            return &str == &that.str && offset == that.offset;
+            return str == that.str && num == that.num;
         }
 
         bool operator!=(const keyframe_data& that) const {
@@ -226,26 +472,37 @@ public:
         }
 
         pointer_type raw() const {
-            return str.backend.read(offset + reduced_keyframe_header::size, size());
+            return str->backend.read(offset + str->keyframe_header_size(), size());
         }
 
         std::size_t size() const {
             return field<fields::kf_size>();
         }
 
+        /** Returns the user metadata of the keyframe */
+        auto metadata() const {
+            static_assert(keyframe_metadata_size > 0, "The stream has no keyframe metadata");
+            return keyframe_metadata_type::read(str->backend, offset + str->kf_layout.header_size())
+                .value;
+        }
+
+        /** Returns the keyframe number. It is tracked by the iterators, so no
+         * header read is needed. */
         keyframe_id_t id() const {
-            return field<fields::kf_num>();
+            return num;
         }
 
     private:
-        keyframe_data(const stream& str, offset_t offset) : str{str}, offset{offset} {
+        keyframe_data(const stream& str, offset_t offset, keyframe_id_t num)
+            : str{&str}, offset{offset}, num{num} {
         }
 
-        const stream& str;
+        const stream* str;
         offset_t offset;
+        keyframe_id_t num;
 
         auto header() const {
-            return str.cache.header_at(offset);
+            return str->cache.header_at(offset);
         }
 
         template <class Field>
@@ -258,8 +515,25 @@ public:
         friend class keyframe_iterator;
     };
 
-    class keyframe_iterator : public std::iterator<std::forward_iterator_tag, keyframe_data> {
+    /** A random access iterator over keyframes.
+     *
+     * The position of an iterator is its keyframe number, so the distance
+     * between two iterators is computed without any I/O. Moving an iterator
+     * follows the skiplists, starting from the nearest keyframe preceding
+     * the target whose offset is already known.
+     */
+    class keyframe_iterator : public std::iterator<std::random_access_iterator_tag,
+                                                   keyframe_data,
+                                                   std::ptrdiff_t,
+                                                   const keyframe_data*,
+                                                   const keyframe_data&> {
     public:
+        using typename std::iterator<std::random_access_iterator_tag,
+                                     keyframe_data,
+                                     std::ptrdiff_t,
+                                     const keyframe_data*,
+                                     const keyframe_data&>::difference_type;
+
         const keyframe_data& operator*() const {
             assert(data.offset != no_keyframe);
             return data;
@@ -270,8 +544,14 @@ public:
             return &data;
         }
 
+        keyframe_data operator[](difference_type diff) const {
+            return *(*this + diff);
+        }
+
         keyframe_iterator& operator++() {
+            PROTOSTREAM_PROBE(keyframe_seek, data.num, data.num + 1);
             data.offset = link(0);
+            data.num++;
             return *this;
         }
 
@@ -281,30 +561,45 @@ public:
             return tmp;
         }
 
-        keyframe_iterator& operator+=(keyframe_id_t diff) {
-            static_assert(std::is_unsigned<decltype(diff)>{}, "Keyframe diff is not unsigned");
+        keyframe_iterator& operator--() {
+            return *this -= 1;
+        }
 
-            if (auto offset_opt = data.str.cache.offset_of(data.id() + diff)) {
-                data.offset = *offset_opt;
-            } else {
-                for (auto level = fields::skiplist_height - 1; diff > 0; level--) {
-                    while (diff >= (1u << level)) {
-                        diff -= 1u << level;
-                        data.offset = link(level);
-                    }
-                }
+        keyframe_iterator operator--(int) {
+            auto tmp = *this;
+            --*this;
+            return tmp;
+        }
 
-                assert(diff == 0);
-            }
+        keyframe_iterator& operator+=(difference_type diff) {
+            seek(data.num + diff);
+            return *this;
+        }
 
+        keyframe_iterator& operator-=(difference_type diff) {
+            seek(data.num - diff);
             return *this;
         }
 
-        keyframe_iterator operator+(keyframe_id_t diff) const {
+        keyframe_iterator operator+(difference_type diff) const {
             auto tmp = *this;
             return tmp += diff;
         }
 
+        friend keyframe_iterator operator+(difference_type diff, const keyframe_iterator& it) {
+            return it + diff;
+        }
+
+        keyframe_iterator operator-(difference_type diff) const {
+            auto tmp = *this;
+            return tmp -= diff;
+        }
+
+        difference_type operator-(const keyframe_iterator& that) const {
+            assert(data.str == that.data.str);
+            return static_cast<difference_type>(data.num - that.data.num);
+        }
+
         bool operator==(const keyframe_iterator& that) const {
             return data == that.data;
         }
@@ -313,12 +608,73 @@ public:
             return !(*this == that);
         }
 
+        bool operator<(const keyframe_iterator& that) const {
+            assert(data.str == that.data.str);
+            return data.num < that.data.num;
+        }
+
+        bool operator>(const keyframe_iterator& that) const {
+            return that < *this;
+        }
+
+        bool operator<=(const keyframe_iterator& that) const {
+            return !(that < *this);
+        }
+
+        bool operator>=(const keyframe_iterator& that) const {
+            return !(*this < that);
+        }
+
     private:
-        keyframe_iterator(const stream& str, offset_t offset) : data{str, offset} {
+        keyframe_iterator(const stream& str, offset_t offset, keyframe_id_t num)
+            : data{str, offset, num} {
         }
 
         offset_t link(unsigned level) const {
-            return data.str.cache.link_at(data.offset, level);
+            return data.str->cache.link_at(data.offset, level);
+        }
+
+        /** Moves the iterator to the keyframe `target` */
+        void seek(keyframe_id_t target) {
+            const stream& str = *data.str;
+
+            if (target == data.num) {
+                return;
+            }
+
+            PROTOSTREAM_PROBE(keyframe_seek, data.num, target);
+
+            if (target >= str.keyframe_count()) {
+                assert(target == str.keyframe_count());
+                data.offset = no_keyframe;
+                data.num = target;
+                return;
+            }
+
+            /* Skiplists only lead forwards, so start from the nearest known
+             * keyframe which is not past the target (keyframe 0 at worst). */
+            auto from = str.cache.nearest_known(target);
+            if (!from) {
+                from = std::make_pair(keyframe_id_t{0}, str.header_field<fields::kf0_offset>());
+            }
+
+            if (data.offset != no_keyframe && data.num < target && data.num > from->first) {
+                from = std::make_pair(data.num, data.offset);
+            }
+
+            data.num = from->first;
+            data.offset = from->second;
+
+            auto diff = target - data.num;
+            for (auto level = str.kf_layout.skiplist_height; diff > 0 && level-- > 0;) {
+                while (diff >= (keyframe_id_t{1} << level)) {
+                    diff -= keyframe_id_t{1} << level;
+                    data.offset = link(level);
+                }
+            }
+
+            assert(diff == 0);
+            data.num = target;
         }
 
         keyframe_data data;
@@ -327,46 +683,141 @@ public:
     };
 
     keyframe_iterator begin() const {
-        return {*this, header_field<fields::kf0_offset>()};
+        return {*this, keyframe_count() > 0 ? header_field<fields::kf0_offset>() : no_keyframe, 0};
     }
 
     keyframe_iterator end() const {
-        return {*this, 0};
+        return {*this, no_keyframe, keyframe_count()};
     }
 
-    void append_delta(const std::uint8_t* data, delta_size_t size) {
-        assert(header_field<fields::frame_count>() % header_field<fields::frames_per_kf>() != 0);
+    /** Returns an iterator to the first keyframe whose metadata is not less
+     * than `key`, or `end()` if there is none.
+     *
+     * The keyframe metadata must be non-decreasing. Only the keyframe headers
+     * are read, in a logarithmic number of seeks.
+     */
+    keyframe_iterator lower_bound_by_metadata(
+        const typename keyframe_metadata_type::type& key) const {
+        return std::partition_point(begin(), end(), [&key](const keyframe_data& keyframe) {
+            return keyframe.metadata() < key;
+        });
+    }
 
-        const auto offset = backend.size();
-        backend.write_num(offset, size);
-        backend.write(offset + sizeof(delta_size_t), size, data);
+    /** Reads the keyframe `id` on a thread of `pool`.
+     *
+     * Any number of reads may run concurrently, which requires a thread-safe
+     * cache (`shared_cache`), a thread-safe backend and no statistics. The
+     * stream must outlive the reads and must not be modified meanwhile.
+     */
+    std::future<keyframe_type> async_read_keyframe(keyframe_id_t id, io_thread_pool& pool) const {
+        check_concurrent_reads();
+        if (id >= keyframe_count()) {
+            throw std::out_of_range{"Invalid keyframe id"};
+        }
+        return pool.submit([this, id] { return begin()[id].get(); });
+    }
 
-        header_field<fields::frame_count>()++;
-        header_field<fields::file_size>() += sizeof(delta_size_t) + size;
-        header.write(backend, 0);
+    /** Reads the frame `id`, a keyframe or a delta, on a thread of `pool`.
+     *
+     * Requires the keyframe and delta factories to build the same type.
+     * See `async_read_keyframe` for the other requirements.
+     */
+    std::future<keyframe_type> async_read_frame(std::size_t id, io_thread_pool& pool) const {
+        static_assert(std::is_same<keyframe_type, delta_type>::value,
+                      "Keyframes and deltas are built into different types");
+        check_concurrent_reads();
+        if (id >= frame_count()) {
+            throw std::out_of_range{"Invalid frame id"};
+        }
+        return pool.submit([this, id] {
+            const auto frames_per_kf = frames_per_keyframe();
+            const auto keyframe = begin()[id / frames_per_kf];
+            if (id % frames_per_kf == 0) {
+                return keyframe.get();
+            }
+
+            auto delta = keyframe.begin();
+            std::advance(delta, id % frames_per_kf - 1);
+            return delta->get();
+        });
     }
 
-    void append_keyframe(const std::uint8_t* data, std::size_t size) {
-        assert(header_field<fields::frame_count>() % header_field<fields::frames_per_kf>() == 0);
+    /** Appends a delta of `size` bytes.
+     *
+     * With `with_codec`, throws `std::length_error` if the encoded delta does
+     * not fit in a `delta_size_t`, i.e. if an incompressible delta is larger
+     * than 65534 bytes.
+     */
+    void append_delta(const std::uint8_t* data, delta_size_t size) {
+        PROTOSTREAM_PROBE(append_delta_entry, size);
+        if (is_compressed) {
+            const auto encoded = detail::codec_frame<codec_type>::encode(data, size);
+            if (encoded.size() > std::numeric_limits<delta_size_t>::max()) {
+                throw std::length_error{"Compressed delta too large"};
+            }
+            append_delta_raw(encoded.data(), encoded.size());
+        } else {
+            append_delta_raw(data, size);
+        }
+        PROTOSTREAM_PROBE(append_delta_return, frame_count());
+    }
 
-        const auto offset = backend.size();
-        const auto id = header_field<fields::keyframe_count>();
+    void append_keyframe(const std::uint8_t* data,
+                         std::size_t size,
+                         typename keyframe_metadata_type::type metadata = {}) {
+        PROTOSTREAM_PROBE(append_keyframe_entry, size);
+        if (is_compressed) {
+            const auto encoded = detail::codec_frame<codec_type>::encode(data, size);
+            append_keyframe_raw(encoded.data(), encoded.size(), metadata);
+        } else {
+            append_keyframe_raw(data, size, metadata);
+        }
+        PROTOSTREAM_PROBE(append_keyframe_return, frame_count());
+    }
 
-        reduced_keyframe_header hdr;
-        hdr.get<fields::kf_num>() = id;
-        hdr.get<fields::delta_offset>() = offset + reduced_keyframe_header::size + size;
-        hdr.get<fields::kf_size>() = size;
-        hdr.write(backend, offset);
+    /** Discards the frames following the first `count` ones.
+     *
+     * The end of the kept frames is found by a seek and a walk over the
+     * deltas of the last kept keyframe. The links leading to the discarded
+     * keyframes are cleared, that is at most
+     * min(2^height - 1, height * discarded keyframes) of them, so the time
+     * taken does not depend on the length of the stream.
+     */
+    void truncate_frames(std::size_t count) {
+        if (count > frame_count()) {
+            throw std::out_of_range{"Invalid frame count"};
+        }
 
-        backend.write(offset + reduced_keyframe_header::size, size, data);
+        if (count == frame_count()) {
+            return;
+        }
 
-        update_links_to(id, offset);
+        const auto old_keyframe_count = keyframe_count();
+        const auto frames_per_kf = keyframe_id_t{frames_per_keyframe()};
+        const auto kept = (count + frames_per_kf - 1) / frames_per_kf;
 
-        header_field<fields::frame_count>()++;
-        header_field<fields::keyframe_count>()++;
-        header_field<fields::file_size>() += reduced_keyframe_header::size + size;
+        auto end = header_field<fields::kf0_offset>();
+        if (kept > 0) {
+            const auto last = begin() + (kept - 1);
+            end = last->template field<fields::delta_offset>();
+            for (auto delta = (kept - 1) * frames_per_kf + 1; delta < count; ++delta) {
+                end += delta_header_size() + read_num<delta_size_t>(end);
+            }
+        }
 
-        header.write(backend, 0);
+        /* The header is written first. If the process is interrupted
+         * afterwards, the file is longer than its header records: readers
+         * ignore the discarded frames and the links leading to them, and
+         * writers cut them off and clear those links when opening the file. */
+        header_field<fields::frame_count>() = count;
+        header_field<fields::keyframe_count>() = kept;
+        header_field<fields::file_size>() = end;
+        write_header();
+
+        clear_links(kept, old_keyframe_count);
+        cache.forget_from(kept, end);
+        recent_offsets.clear();
+        backend.truncate(end);
     }
 
     std::size_t frame_count() const {
@@ -381,57 +832,531 @@ public:
         return header_field<fields::frames_per_kf>();
     }
 
+    /** Returns the size of the file, as recorded in its header */
+    std::size_t file_size() const {
+        return header_field<fields::file_size>();
+    }
+
+    /** Copies the keyframes `first` to `last` (both included) together with
+     * their deltas into the new file `path`, so that it holds a stream of
+     * its own.
+     *
+     * The frames are copied by the kernel (see `posix_file_handler::copy_from`),
+     * and only the keyframe headers are rewritten: the keyframe numbers, the
+     * offsets and the skiplist links are adjusted, the links leading past the
+     * range are cleared, and the checksums are updated without reading the
+     * payloads. The proto header is copied as well.
+     */
+    void extract(keyframe_id_t first, keyframe_id_t last, const char* path) const {
+        if (first > last || last >= keyframe_count()) {
+            throw std::out_of_range{"Invalid keyframe range"};
+        }
+
+        const auto after_last = last + 1;
+        const auto kf0_offset = header_field<fields::kf0_offset>();
+        const auto range_begin = (begin() + first).data.offset;
+        const auto range_end = after_last == keyframe_count() ? file_size()
+                                                              : (begin() + after_last).data.offset;
+        const auto shift = range_begin - kf0_offset;
+
+        posix_file_handler<file_mode_t::READ_APPEND> file{path};
+        if (file.size() != 0) {
+            throw std::runtime_error{"File is not empty"};
+        }
+
+        const auto& source = backend.handler();
+        file.copy_from(source, file_header::size, kf0_offset - file_header::size,
+                       file_header::size);
+        file.copy_from(source, range_begin, range_end - range_begin, kf0_offset);
+
+        alignas(offset_t) std::array<std::uint8_t, max_keyframe_header_size> buffer;
+        std::array<offset_t, fields::max_skiplist_height> links;
+        const auto links_offset = fields::skiplist_offset(0);
+
+        auto it = begin() + first;
+        for (auto id = first; id < after_last; ++id, ++it) {
+            const auto offset = it.data.offset;
+            const auto stored = backend.read(offset, kf_layout.header_size());
+            const auto hdr = kf_layout.read(detail::as_ptr(stored));
+            kf_layout.read_links(detail::as_ptr(stored) + links_offset, links.data());
+
+            auto moved = hdr;
+            moved.template get<fields::kf_num>() = id - first;
+            moved.template get<fields::delta_offset>() -= shift;
+
+            buffer.fill(0);
+            kf_layout.write(moved, buffer.data());
+            for (auto level = 0u; level < kf_layout.skiplist_height; ++level) {
+                const auto target = id + (keyframe_id_t{1} << level);
+                if (target < after_last && links[level] != no_keyframe) {
+                    kf_layout.encode(links[level] - shift,
+                                     buffer.data() + fields::skiplist_offset(level));
+                }
+            }
+            file.write(offset - shift, kf_layout.header_size(), buffer.data());
+
+            if (has_checksums()) {
+                const auto checksum_offset =
+                    offset + kf_layout.header_size() + keyframe_metadata_size;
+                const auto checksum =
+                    moved_checksum(read_num<std::uint32_t>(checksum_offset), hdr, moved);
+                kf_layout.encode(checksum, buffer.data());
+                file.write(checksum_offset - shift, sizeof(checksum), buffer.data());
+            }
+        }
+
+        auto extracted = header;
+        extracted.get<fields::file_size>() = kf0_offset + (range_end - range_begin);
+        extracted.get<fields::keyframe_count>() = after_last - first;
+        extracted.get<fields::frame_count>() =
+            std::min<std::uint64_t>(frame_count(), after_last * frames_per_keyframe()) -
+            std::min<std::uint64_t>(frame_count(), first * frames_per_keyframe());
+
+        alignas(offset_t) std::array<std::uint8_t, file_header::size> header_buffer{};
+        extracted.write(header_buffer.data());
+        file.write(0, header_buffer.size(), header_buffer.data());
+    }
+
+    /** Returns a snapshot of the statistics recorded by the `with_stats` policy */
+    stats_type stats() const {
+        return detail::stats_of(backend);
+    }
+
+    /** Returns the estimated number of bytes of memory used by the stream,
+     * including its cache, but not the backend buffers */
+    std::size_t memory_usage() const {
+        return own_memory_usage() + cache.memory_usage();
+    }
+
+    /** Returns the estimated number of bytes of memory used by the stream,
+     * apart from what its cache holds (see `memory_usage`) */
+    std::size_t own_memory_usage() const {
+        return sizeof(*this) + recent_offsets.capacity() * sizeof(offset_t);
+    }
+
+    const cache_type& get_cache() const {
+        return cache;
+    }
+
 private:
+    bool has_checksums() const {
+        return header_field<fields::flags>() & file_flags::checksums;
+    }
+
+    std::size_t checksum_size() const {
+        return has_checksums() ? sizeof(std::uint32_t) : 0;
+    }
+
+    /** The size of a keyframe header together with the user metadata and the checksum */
+    std::size_t keyframe_header_size() const {
+        return kf_layout.header_size() + keyframe_metadata_size + checksum_size();
+    }
+
+    /** The size of a delta header together with the checksum */
+    std::size_t delta_header_size() const {
+        return sizeof(delta_size_t) + checksum_size();
+    }
+
+    static constexpr std::size_t max_keyframe_header_size =
+        fields::skiplist_offset(fields::max_skiplist_height) + sizeof(std::uint32_t);
+
+    /** Bounds the memory used by the recent keyframe offsets of writers */
+    static constexpr std::size_t max_recent_keyframes = std::size_t{1} << 16;
+
     backend_type backend;
-    mutable cache_type cache;
     file_header header;
+    keyframe_layout kf_layout;
+    mutable cache_type cache;
+    /* The offsets of the last `recent_capacity()` keyframes, keyframe k at
+     * index k % recent_capacity(), or empty if nothing was appended yet */
+    std::vector<offset_t> recent_offsets;
+
+    static constexpr bool is_native = stored_byte_order == byte_order::native;
+
+    static keyframe_layout layout_of(const file_header& header) {
+        keyframe_layout result;
+        result.order = stored_byte_order;
+        result.skiplist_height = keyframe_layout::height_of(header);
+        return result;
+    }
+
+    /** Reads the file header, checking only whether the file is large enough */
+    static file_header read_file_header(const backend_type& backend) {
+        if (backend.size() < file_header::size) {
+            throw std::runtime_error{"File too small"};
+        }
+
+        return file_header::read(backend, 0);
+    }
+
+    /** Returns the file header of a new, empty file */
+    static file_header new_file_header(std::uint32_t frames_per_kf, std::size_t proto_header_size) {
+        const auto end = file_header::size + proto_header_size;
+
+        file_header result;
+        result.get<fields::file_size>() = end;
+        result.get<fields::kf0_offset>() = end;
+        result.get<fields::proto_header_offset>() = file_header::size;
+        result.get<fields::frames_per_kf>() = frames_per_kf;
+        result.get<fields::kf_metadata_size>() = keyframe_metadata_size;
+        result.get<fields::codec>() = codec_type::id;
+        result.get<fields::flags>() =
+            (checksums != checksum_mode::off ? file_flags::checksums : 0) | byte_order_flag();
+        /* Files of the default height are written as they were before the
+         * height became configurable */
+        result.get<fields::kf_skiplist_height>() =
+            new_file_skiplist_height == fields::skiplist_height ? 0 : new_file_skiplist_height;
+        return result;
+    }
+
+    /** The value of the byte order bit of the file header flags */
+    static constexpr std::uint8_t byte_order_flag() {
+        return is_native && detail::host_is_little_endian() ? file_flags::little_endian : 0;
+    }
+
+    /** Decodes a number stored in the byte order of the file */
+    template <class T>
+    static T decode(const std::uint8_t* ptr) {
+        return is_native ? detail::readbuf_native<T>(ptr) : detail::readbuf_unaligned<T>(ptr);
+    }
+
+    template <class T>
+    T read_num(offset_t offset) const {
+        if (is_native) {
+            const auto ptr = backend.read(offset, sizeof(T));
+            return decode<T>(detail::as_ptr(ptr));
+        }
+        return backend.template read_num<T>(offset);
+    }
+
+    template <class T>
+    void write_num(offset_t offset, T value) {
+        if (is_native) {
+            backend.write(offset, sizeof(T), reinterpret_cast<const std::uint8_t*>(&value));
+        } else {
+            backend.write_num(offset, value);
+        }
+    }
+
+    static void check_concurrent_reads() {
+        static_assert(detail::is_thread_safe_cache<cache_type>::value,
+                      "Concurrent reads require a thread-safe cache, e.g. shared_cache");
+        static_assert(std::is_same<stats_type, no_stats>::value,
+                      "Concurrent reads cannot record statistics");
+        static_assert(detail::is_thread_safe_backend<backend_type>::value,
+                      "Concurrent reads require a thread-safe backend, e.g. mmap_backend");
+    }
+
+    /** Cuts off the data past the end recorded in the header, e.g. the
+     * frames left behind by an interrupted `truncate_frames`, so that the
+     * following appends start at that end. The links leading to the cut
+     * keyframes may not have been cleared yet, so they are cleared again. */
+    void discard_tail(std::true_type /* writable */) {
+        clear_links(keyframe_count(), std::numeric_limits<keyframe_id_t>::max());
+        cache.forget_from(keyframe_count(), file_size());
+        backend.truncate(file_size());
+    }
+
+    /** Leaves the data past the recorded end to readers, which never reach it */
+    void discard_tail(std::false_type /* writable */) {
+    }
+
+    /** Clears the links of the first `kept` keyframes leading to the
+     * keyframes [kept, old_keyframe_count), that is at most
+     * min(2^height - 1, height * (old_keyframe_count - kept)) of them.
+     * The cache may still hold the cleared links. */
+    void clear_links(keyframe_id_t kept, keyframe_id_t old_keyframe_count) {
+        /* Keyframe `id` links to a cleared one at `level` if
+         * kept <= id + 2^level < old_keyframe_count */
+        for (auto level = 0u; level < kf_layout.skiplist_height; ++level) {
+            const auto distance = keyframe_id_t{1} << level;
+            const auto from = kept > distance ? kept - distance : 0;
+            const auto to = std::min(kept, old_keyframe_count > distance
+                                               ? old_keyframe_count - distance
+                                               : keyframe_id_t{0});
+            if (from >= to) {
+                continue;
+            }
+
+            for (auto it = begin() + from;; ++it) {
+                write_num(it.data.offset + fields::skiplist_offset(level), offset_t{0});
+                if (it.data.num + 1 == to) {
+                    break;
+                }
+            }
+        }
+    }
+
+    /** Writes the in-memory file header back to the file */
+    void write_header() {
+        header.write(backend, 0);
+        detail::stats_of(backend).on_header_write();
+        PROTOSTREAM_PROBE(header_commit,
+                          header_field<fields::frame_count>(),
+                          header_field<fields::file_size>());
+    }
 
     template <class Field>
     auto header_field() const {
         return header.template get<Field>();
     }
 
+    /** Builds a keyframe or a delta out of a stored payload */
+    template <class Factory>
+    auto build(pointer_type ptr, std::size_t size) const {
+        return build<Factory>(std::move(ptr), size, std::integral_constant<bool, is_compressed>{});
+    }
+
+    template <class Factory>
+    static auto build(pointer_type ptr, std::size_t size, std::false_type /* compressed */) {
+        return Factory::build(std::move(ptr), size);
+    }
+
+    template <class Factory>
+    static auto build(pointer_type ptr, std::size_t size, std::true_type /* compressed */) {
+        auto decoded = detail::codec_frame<codec_type>::decode(detail::as_ptr(ptr), size);
+        return Factory::build(std::move(decoded.first), decoded.second);
+    }
+
+    /** Appends a delta whose payload has already been encoded by the codec */
+    void append_delta_raw(const std::uint8_t* data, std::size_t size) {
+        assert(header_field<fields::frame_count>() % header_field<fields::frames_per_kf>() != 0);
+        assert(size <= std::numeric_limits<delta_size_t>::max());
+
+        const auto offset = backend.size();
+        write_num(offset, static_cast<delta_size_t>(size));
+        if (has_checksums()) {
+            write_num(offset + sizeof(delta_size_t),
+                      delta_checksum(static_cast<delta_size_t>(size), data));
+        }
+        backend.write(offset + delta_header_size(), size, data);
+
+        header_field<fields::frame_count>()++;
+        header_field<fields::file_size>() += delta_header_size() + size;
+        write_header();
+    }
+
+    /** Appends a keyframe whose payload has already been encoded by the codec */
+    void append_keyframe_raw(const std::uint8_t* data,
+                             std::size_t size,
+                             typename keyframe_metadata_type::type metadata) {
+        assert(header_field<fields::frame_count>() % header_field<fields::frames_per_kf>() == 0);
+
+        const auto offset = backend.size();
+        const auto id = header_field<fields::keyframe_count>();
+
+        reduced_keyframe_header hdr;
+        hdr.get<fields::kf_num>() = id;
+        hdr.get<fields::delta_offset>() = offset + keyframe_header_size() + size;
+        hdr.get<fields::kf_size>() = size;
+
+        alignas(offset_t) std::array<std::uint8_t, max_keyframe_header_size> hdr_buffer{};
+        kf_layout.write(hdr, hdr_buffer.data());
+        backend.write(offset, kf_layout.header_size(), hdr_buffer.data());
+
+        keyframe_metadata_type metadata_field;
+        metadata_field.value = metadata;
+        metadata_field.write(backend, offset + kf_layout.header_size());
+
+        if (has_checksums()) {
+            alignas(offset_t) std::array<std::uint8_t, keyframe_metadata_size + 1>
+                metadata_buffer{};
+            metadata_field.write(metadata_buffer.data());
+            write_num(offset + kf_layout.header_size() + keyframe_metadata_size,
+                      keyframe_checksum(hdr, metadata_buffer.data(), data));
+        }
+
+        backend.write(offset + keyframe_header_size(), size, data);
+
+        update_links_to(id, offset);
+
+        header_field<fields::frame_count>()++;
+        header_field<fields::keyframe_count>()++;
+        header_field<fields::file_size>() = offset + keyframe_header_size() + size;
+
+        write_header();
+    }
+
     template <class Field>
     auto& header_field() {
         return header.template get<Field>();
     }
 
-    void update_links_to(keyframe_id_t keyframe_id, offset_t offset) {
-        auto level = static_cast<int>(fields::skiplist_height - 1);
-        while (level >= 0 && keyframe_id < (1u << level)) {
-            --level;
+    /** Computes the checksum of a keyframe: its big-endian header with a
+     * zeroed skiplist, the user metadata and the payload */
+    std::uint32_t keyframe_checksum(const reduced_keyframe_header& hdr,
+                                    const std::uint8_t* metadata,
+                                    const std::uint8_t* data) const {
+        auto crc = keyframe_header_checksum(hdr);
+        crc = detail::crc32c(metadata, keyframe_metadata_size, crc);
+        return detail::crc32c(data, hdr.get<fields::kf_size>(), crc);
+    }
+
+    /** Computes the checksum of the header part of a keyframe checksum */
+    std::uint32_t keyframe_header_checksum(const reduced_keyframe_header& hdr) const {
+        auto big_endian = kf_layout;
+        big_endian.order = byte_order::big;
+
+        std::array<std::uint8_t, max_keyframe_header_size> buffer{};
+        big_endian.write(hdr, buffer.data());
+        return detail::crc32c(buffer.data(), big_endian.header_size());
+    }
+
+    /** Computes the checksum of a keyframe whose header changed from `from`
+     * to `to`, given its former checksum, without reading the payload */
+    std::uint32_t moved_checksum(std::uint32_t checksum,
+                                 const reduced_keyframe_header& from,
+                                 const reduced_keyframe_header& to) const {
+        const auto rest_size = keyframe_metadata_size + from.get<fields::kf_size>();
+        /* The checksum of the metadata and the payload alone */
+        const auto rest =
+            checksum ^ detail::crc32c_combine(keyframe_header_checksum(from), 0, rest_size);
+        return detail::crc32c_combine(keyframe_header_checksum(to), rest, rest_size);
+    }
+
+    /** Computes the checksum of a delta: its big-endian size and the payload */
+    static std::uint32_t delta_checksum(delta_size_t size, const std::uint8_t* data) {
+        const auto size_be = detail::htobe(size);
+        const auto crc =
+            detail::crc32c(reinterpret_cast<const std::uint8_t*>(&size_be), sizeof(size_be));
+        return detail::crc32c(data, size, crc);
+    }
+
+    /** Checks that the keyframe at `offset` lies within the file and matches
+     * its checksum, if the file has checksums */
+    void verify_keyframe(offset_t offset, const reduced_keyframe_header& hdr) const {
+        const auto size = hdr.get<fields::kf_size>();
+        if (offset + keyframe_header_size() + size > backend.size()) {
+            throw std::runtime_error{"Keyframe past the end of file"};
+        }
+
+        if (!has_checksums()) {
+            return;
         }
 
-        if (level < 0) {
+        const auto metadata_offset = offset + kf_layout.header_size();
+        const auto metadata =
+            backend.read(metadata_offset, keyframe_metadata_size + checksum_size());
+        const auto data = backend.read(offset + keyframe_header_size(), size);
+
+        const auto expected =
+            decode<std::uint32_t>(detail::as_ptr(metadata) + keyframe_metadata_size);
+        if (expected != keyframe_checksum(hdr, detail::as_ptr(metadata), detail::as_ptr(data))) {
+            throw std::runtime_error{"Keyframe checksum mismatch"};
+        }
+    }
+
+    /** Checks that the delta at `offset` lies within the file and matches its
+     * checksum, if the file has checksums */
+    void verify_delta(offset_t offset) const {
+        const auto size = read_num<delta_size_t>(offset);
+        if (offset + delta_header_size() + size > backend.size()) {
+            throw std::runtime_error{"Delta past the end of file"};
+        }
+
+        if (!has_checksums()) {
             return;
         }
 
-        auto it = begin() + (keyframe_id - (1u << level));
-        while (level >= 0) {
-            backend.write_num(it.data.offset + fields::skiplist_offset(level), offset);
+        const auto expected = read_num<std::uint32_t>(offset + sizeof(size));
+        const auto data = backend.read(offset + delta_header_size(), size);
+        if (expected != delta_checksum(size, detail::as_ptr(data))) {
+            throw std::runtime_error{"Delta checksum mismatch"};
+        }
+    }
+
+    /** Verifies all the frames of the stream, following the keyframe chain */
+    void verify_all() const {
+        auto expected = keyframe_id_t{0};
+        for (auto it = begin(); it != end(); ++it) {
+            const auto hdr = it->header();
+            if (hdr.template get<fields::kf_num>() != expected++) {
+                throw std::runtime_error{"Keyframe number not consistent with its position"};
+            }
+
+            verify_keyframe(it->offset, hdr);
 
-            level--;
-            if (level >= 0) {
-                it += 1 << level;
+            if (hdr.template get<fields::delta_offset>() !=
+                it->offset + keyframe_header_size() + hdr.template get<fields::kf_size>()) {
+                throw std::runtime_error{"Invalid delta offset"};
+            }
+
+            for (auto delta = it->begin(); delta != it->end(); ++delta) {
+                verify_delta(delta->offset);
             }
         }
     }
-};
 
-template <class... Args>
-stream<Args...>::stream(const char* path) : backend{path}, cache{backend} {
-    const auto file_size = backend.size();
+    /** The number of recent keyframe offsets kept by writers */
+    std::size_t recent_capacity() const {
+        const auto span = keyframe_id_t{1} << (kf_layout.skiplist_height - 1);
+        return static_cast<std::size_t>(std::min<keyframe_id_t>(span, max_recent_keyframes));
+    }
 
-    if (file_size < file_header::size) {
-        throw std::runtime_error{"File too small"};
+    /** Loads the offsets of the last keyframes of the file, walking the
+     * level 0 links once. Called on the first append. */
+    void load_recent_offsets() {
+        recent_offsets.resize(recent_capacity());
+
+        const auto count = keyframe_count();
+        const auto first = count - std::min<keyframe_id_t>(count, recent_offsets.size());
+        if (first == count) {
+            return;
+        }
+
+        for (auto it = begin() + first;; ++it) {
+            recent_offsets[it.data.num % recent_offsets.size()] = it.data.offset;
+            if (it.data.num + 1 == count) {
+                break;
+            }
+        }
     }
 
-    header = file_header::read(backend, 0);
+    /** Points the links of the preceding keyframes to the new keyframe.
+     *
+     * The keyframe `keyframe_id - 2^level` links to it at each level. The
+     * offsets of those predecessors are taken from `recent_offsets`, so no
+     * reads are needed unless the skiplist spans more than
+     * `max_recent_keyframes` keyframes. */
+    void update_links_to(keyframe_id_t keyframe_id, offset_t offset) {
+        if (recent_offsets.empty()) {
+            load_recent_offsets();
+        }
+
+        const auto capacity = recent_offsets.size();
+        for (auto level = 0u; level < kf_layout.skiplist_height; ++level) {
+            const auto distance = keyframe_id_t{1} << level;
+            if (distance > keyframe_id) {
+                break;
+            }
 
-    if (header_field<fields::file_size>() != file_size) {
+            const auto predecessor = keyframe_id - distance;
+            const auto predecessor_offset = distance <= capacity
+                                                ? recent_offsets[predecessor % capacity]
+                                                : (begin() + predecessor).data.offset;
+            write_num(predecessor_offset + fields::skiplist_offset(level), offset);
+        }
+
+        recent_offsets[keyframe_id % capacity] = offset;
+    }
+};
+
+template <class... Args>
+stream<Args...>::stream(const char* path)
+    : backend{path},
+      header{read_file_header(backend)},
+      kf_layout{layout_of(header)},
+      cache{backend, kf_layout} {
+    const auto file_size = header_field<fields::file_size>();
+
+    if (file_size > backend.size()) {
         throw std::runtime_error{"File size not consistent with data in header"};
     }
 
+    if (file_size < backend.size()) {
+        discard_tail(detail::is_writable_backend<backend_type>{});
+    }
+
     if (header_field<fields::proto_header_offset>() > file_size - file_header::size) {
         throw std::runtime_error{"Invalid proto header offset"};
     }
@@ -443,6 +1368,30 @@ stream<Args...>::stream(const char* path) : backend{path}, cache{backend} {
     if (header_field<fields::proto_header_offset>() > header_field<fields::kf0_offset>()) {
         throw std::runtime_error{"Proto header is placed after keyframe 0"};
     }
+
+    if (header_field<fields::kf_metadata_size>() != keyframe_metadata_size) {
+        throw std::runtime_error{"Keyframe metadata size not consistent with the stream type"};
+    }
+
+    if (header_field<fields::codec>() != codec_type::id) {
+        throw std::runtime_error{"Codec not consistent with the stream type"};
+    }
+
+    if (header_field<fields::flags>() & ~file_flags::all) {
+        throw std::runtime_error{"Unsupported file flags"};
+    }
+
+    if ((header_field<fields::flags>() & file_flags::little_endian) != byte_order_flag()) {
+        throw std::runtime_error{"Byte order not consistent with the stream type"};
+    }
+
+    if (kf_layout.skiplist_height > fields::max_skiplist_height) {
+        throw std::runtime_error{"Invalid skiplist height"};
+    }
+
+    if (checksums == checksum_mode::eager) {
+        verify_all();
+    }
 }
 
 template <class... Args>
@@ -450,23 +1399,48 @@ stream<Args...>::stream(const char* path,
                         std::uint32_t frames_per_kf,
                         const void* proto_header,
                         std::size_t proto_header_size)
-    : backend{path}, cache{backend} {
-    auto end = file_header::size + proto_header_size;
-
+    : backend{path},
+      header{new_file_header(frames_per_kf, proto_header_size)},
+      kf_layout{layout_of(header)},
+      cache{backend, kf_layout} {
     if (backend.size() != 0) {
         throw std::runtime_error{"File is not empty"};
     }
 
-    header_field<fields::file_size>() = end;
-    header_field<fields::kf0_offset>() = end;
-    header_field<fields::proto_header_offset>() = file_header::size;
-    header_field<fields::frames_per_kf>() = frames_per_kf;
-    header.write(backend, 0);
+    /* Write the whole header at once, so that it is complete even if the
+     * proto header is empty */
+    alignas(offset_t) std::array<std::uint8_t, file_header::size> buffer{};
+    header.write(buffer.data());
+    backend.write(0, buffer.size(), buffer.data());
 
     backend.write(file_header::size, proto_header_size,
                   static_cast<const std::uint8_t*>(proto_header));
 }
 
+template <class... Args>
+constexpr std::size_t stream<Args...>::keyframe_metadata_size;
+
+template <class... Args>
+constexpr checksum_mode stream<Args...>::checksums;
+
+template <class... Args>
+constexpr bool stream<Args...>::is_compressed;
+
+template <class... Args>
+constexpr byte_order stream<Args...>::stored_byte_order;
+
+template <class... Args>
+constexpr bool stream<Args...>::is_native;
+
+template <class... Args>
+constexpr unsigned stream<Args...>::new_file_skiplist_height;
+
+template <class... Args>
+constexpr std::size_t stream<Args...>::max_keyframe_header_size;
+
+template <class... Args>
+constexpr std::size_t stream<Args...>::max_recent_keyframes;
+
 template <class... Args>
 auto begin(const stream<Args...>& stream) {
     return stream.begin();
@@ -0,0 +1,262 @@
+#pragma once
+
+#include "stream.h"
+
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <cstddef>
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+namespace protostream {
+
+namespace detail {
+/** Whether a cache shares its index with other caches, as told by its
+ * `shared_index()` member (see `shared_cache`) */
+template <class Cache, class = void>
+struct has_shared_index : std::false_type {};
+
+template <class Cache>
+struct has_shared_index<Cache, void_t<decltype(std::declval<const Cache&>().shared_index())>>
+    : std::true_type {};
+}
+
+/** Keeps recently used read-only streams open, so that reopening a file
+ * reuses its stream together with the populated cache.
+ *
+ * The streams are shared: `acquire` returns the same stream to every caller
+ * until it is evicted. Evicting a stream only drops the pool's reference, so
+ * it is closed when the last handle is released. At most `max_streams`
+ * streams (and thus file descriptors) are kept open by the pool, and the
+ * least recently used ones are evicted when their total `memory_usage()`
+ * exceeds `memory_budget` bytes. An index shared by several streams (see
+ * `shared_cache`) is counted once.
+ *
+ * The pool is thread-safe, and opens the streams without holding its lock.
+ * As every caller of `acquire` shares the same stream, the streams must
+ * support concurrent reads: they need a thread-safe cache (e.g.
+ * `shared_cache`) and backend, and cannot record statistics. Their caches
+ * grow while they are read, so their memory usage is recomputed on each
+ * eviction.
+ *
+ * A pooled stream is handed out without any system call for
+ * `revalidation_interval` after its file was last checked. This is a
+ * deliberate trade-off: a file replaced or modified in the meantime is
+ * noticed only once the interval has passed.
+ */
+template <class Stream>
+class stream_pool {
+    static_assert(detail::is_thread_safe_cache<typename Stream::cache_type>::value,
+                  "Pooled streams are shared between threads and require a thread-safe cache, "
+                  "e.g. shared_cache");
+    static_assert(std::is_same<typename Stream::stats_type, no_stats>::value,
+                  "Pooled streams are shared between threads and cannot record statistics");
+    static_assert(detail::is_thread_safe_backend<typename Stream::backend_type>::value,
+                  "Pooled streams are shared between threads and require a thread-safe backend, "
+                  "e.g. mmap_backend");
+
+public:
+    using handle = std::shared_ptr<const Stream>;
+
+    using clock = std::chrono::steady_clock;
+
+    explicit stream_pool(std::size_t max_streams,
+                         std::size_t memory_budget = std::numeric_limits<std::size_t>::max(),
+                         clock::duration revalidation_interval = std::chrono::seconds{1})
+        : max_streams{max_streams}, budget{memory_budget}, interval{revalidation_interval} {
+    }
+
+    stream_pool(const stream_pool&) = delete;
+
+    stream_pool& operator=(const stream_pool&) = delete;
+
+    /** Returns a stream reading the file `path`.
+     *
+     * The pooled stream of `path` is returned as is if its file was checked
+     * less than `revalidation_interval` ago. Otherwise the file is identified
+     * by its path and its `file_identity`, so a single `stat` call is made.
+     * The file is opened only if the pool holds no stream for it, or the
+     * file has been replaced or modified since the stream was opened. The
+     * reopened stream then gets a fresh shared index, as `shared_cache`
+     * keys the indexes by the same identity.
+     */
+    handle acquire(const std::string& path) {
+        const auto now = clock::now();
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            if (const auto stream = find_validated(path, now)) {
+                return stream;
+            }
+        }
+
+        const auto id = identify(path);
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            if (const auto stream = find(path, id, now)) {
+                return stream;
+            }
+        }
+
+        auto stream = std::make_shared<const Stream>(path.c_str());
+
+        std::lock_guard<std::mutex> lock{mutex};
+
+        /* Another thread may have opened the file meanwhile */
+        if (const auto pooled = find(path, id, now)) {
+            return pooled;
+        }
+
+        const auto it = entries.find(path);
+        if (it != entries.end()) {
+            lru.erase(it->second.lru_position);
+            entries.erase(it);
+        }
+
+        lru.push_front(path);
+        entries.emplace(path, entry{id, now, stream, lru.begin()});
+
+        evict();
+        return stream;
+    }
+
+    /** Returns the number of streams kept open by the pool */
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock{mutex};
+        return entries.size();
+    }
+
+    /** Returns the total estimated memory used by the streams of the pool */
+    std::size_t memory_usage() const {
+        std::lock_guard<std::mutex> lock{mutex};
+        index_users users;
+        return total_memory_usage(users);
+    }
+
+    /** Drops all the streams */
+    void clear() {
+        std::lock_guard<std::mutex> lock{mutex};
+        entries.clear();
+        lru.clear();
+    }
+
+private:
+    struct entry {
+        file_identity id;
+        /* When the file was last found to be `id` */
+        clock::time_point validated;
+        handle stream;
+        std::list<std::string>::iterator lru_position;
+    };
+
+    /** The memory used by a stream, apart from the index it shares with
+     * other streams, if any */
+    struct stream_usage {
+        std::size_t own;
+        const void* index;
+        std::size_t index_usage;
+    };
+
+    /* The number of pooled streams sharing each index */
+    using index_users = std::unordered_map<const void*, std::size_t>;
+
+    std::size_t max_streams;
+    std::size_t budget;
+    clock::duration interval;
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, entry> entries;
+    /* Most recently used paths first */
+    std::list<std::string> lru;
+
+    static file_identity identify(const std::string& path) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            throw std::system_error{errno, std::system_category(), "stat"};
+        }
+
+        return file_identity::of(st);
+    }
+
+    /** Returns the pooled stream of `path` if its file was checked less than
+     * `interval` before `now`, marking it as the most recently used one */
+    handle find_validated(const std::string& path, clock::time_point now) {
+        const auto it = entries.find(path);
+        if (it == entries.end() || now - it->second.validated >= interval) {
+            return nullptr;
+        }
+
+        lru.splice(lru.begin(), lru, it->second.lru_position);
+        return it->second.stream;
+    }
+
+    /** Returns the pooled stream of `path` if it is still the file `id`,
+     * marking it as the most recently used one, checked at `now` */
+    handle find(const std::string& path, const file_identity& id, clock::time_point now) {
+        const auto it = entries.find(path);
+        if (it == entries.end() || it->second.id != id) {
+            return nullptr;
+        }
+
+        it->second.validated = std::max(it->second.validated, now);
+        lru.splice(lru.begin(), lru, it->second.lru_position);
+        return it->second.stream;
+    }
+
+    static stream_usage usage_of(const Stream& stream) {
+        return usage_of(stream, detail::has_shared_index<typename Stream::cache_type>{});
+    }
+
+    static stream_usage usage_of(const Stream& stream, std::true_type /* shared index */) {
+        const auto& index = stream.get_cache().shared_index();
+        return {stream.own_memory_usage(), &index, index.memory_usage()};
+    }
+
+    static stream_usage usage_of(const Stream& stream, std::false_type /* shared index */) {
+        return {stream.memory_usage(), nullptr, 0};
+    }
+
+    /** Returns the memory used by the pooled streams, counting each shared
+     * index once, and fills `users` with the number of streams sharing it */
+    std::size_t total_memory_usage(index_users& users) const {
+        auto result = std::size_t{0};
+        for (const auto& item : entries) {
+            const auto usage = usage_of(*item.second.stream);
+            result += usage.own;
+            if (usage.index && users[usage.index]++ == 0) {
+                result += usage.index_usage;
+            }
+        }
+        return result;
+    }
+
+    /** Evicts the least recently used streams, but never the most recent one */
+    void evict() {
+        /* Computed once, as each call locks the index of every stream. The
+         * caches may grow meanwhile, so the subtractions are clamped. */
+        index_users users;
+        auto usage = total_memory_usage(users);
+        while (entries.size() > 1 && (entries.size() > max_streams || usage > budget)) {
+            const auto it = entries.find(lru.back());
+            const auto evicted = usage_of(*it->second.stream);
+            usage -= std::min(usage, evicted.own);
+            if (evicted.index && --users[evicted.index] == 0) {
+                usage -= std::min(usage, evicted.index_usage);
+            }
+
+            entries.erase(it);
+            lru.pop_back();
+        }
+    }
+};
+}
@@ -38,6 +38,11 @@
 
 #include <type_traits>
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define PROTOSTREAM_HAVE_SSSE3_BSWAP 1
+#include <tmmintrin.h>
+#endif
+
 namespace protostream {
 
 namespace detail {
@@ -55,6 +60,15 @@ struct conjunction<> : std::true_type {};
 template <class Head, class... Tail>
 struct conjunction<Head, Tail...> : std::conditional_t<Head::value, conjunction<Tail...>, Head> {};
 
+/** Maps any types to void (to be replaced with std::void_t) */
+template <class...>
+struct make_void {
+    using type = void;
+};
+
+template <class... Ts>
+using void_t = typename make_void<Ts...>::type;
+
 template <typename T>
 T betoh(const T);
 
@@ -73,6 +87,11 @@ inline std::uint16_t betoh<std::uint16_t>(const std::uint16_t x) {
     return be16toh(x);
 }
 
+template <>
+inline std::uint8_t betoh<std::uint8_t>(const std::uint8_t x) {
+    return x;
+}
+
 template <typename T>
 T htobe(const T);
 
@@ -91,6 +110,11 @@ inline std::uint16_t htobe<std::uint16_t>(const std::uint16_t x) {
     return htobe16(x);
 }
 
+template <>
+inline std::uint8_t htobe<std::uint8_t>(const std::uint8_t x) {
+    return x;
+}
+
 template <typename T>
 inline T readbuf_aligned(const void* ptr) {
     assert(reinterpret_cast<uintptr_t>(ptr) % sizeof(T) == 0);
@@ -103,6 +127,14 @@ inline void writebuf(void* ptr, const T x) {
     *static_cast<T*>(ptr) = htobe<T>(x);
 }
 
+/** Reads a number stored in the host byte order from a (possibly unaligned) buffer */
+template <typename T>
+T readbuf_native(const void* a) {
+    T val;
+    memcpy(&val, a, sizeof(T));
+    return val;
+}
+
 template <typename T>
 T readbuf_unaligned(const void* a) {
     T val;
@@ -111,6 +143,51 @@ T readbuf_unaligned(const void* a) {
     return val;
 }
 
+constexpr bool host_is_little_endian() {
+    return __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+}
+
+namespace bswap_impl {
+inline void software(const std::uint8_t* from, std::size_t count, std::uint64_t* into) {
+    for (auto i = std::size_t{0}; i < count; ++i) {
+        into[i] = readbuf_unaligned<std::uint64_t>(from + i * sizeof(std::uint64_t));
+    }
+}
+
+#ifdef PROTOSTREAM_HAVE_SSSE3_BSWAP
+/** Swaps two numbers per shuffle */
+__attribute__((target("ssse3"))) inline void shuffle(const std::uint8_t* from,
+                                                     std::size_t count,
+                                                     std::uint64_t* into) {
+    const auto mask = _mm_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+    auto i = std::size_t{0};
+    for (; i + 2 <= count; i += 2) {
+        const auto word =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(from + i * sizeof(std::uint64_t)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(into + i), _mm_shuffle_epi8(word, mask));
+    }
+    software(from + i * sizeof(std::uint64_t), count - i, into + i);
+}
+
+inline bool has_shuffle() {
+    static const bool result = __builtin_cpu_supports("ssse3");
+    return result;
+}
+#endif
+}
+
+/** Reads `count` consecutive big-endian uint64s from a (possibly unaligned)
+ * buffer, using SIMD byte shuffles if the CPU supports them */
+inline void readbuf_array(const std::uint8_t* from, std::size_t count, std::uint64_t* into) {
+#ifdef PROTOSTREAM_HAVE_SSSE3_BSWAP
+    if (bswap_impl::has_shuffle()) {
+        bswap_impl::shuffle(from, count, into);
+        return;
+    }
+#endif
+    bswap_impl::software(from, count, into);
+}
+
 template <class Ptr>
 auto as_ptr(Ptr& ptr) {
     return ptr.get();
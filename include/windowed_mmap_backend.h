@@ -0,0 +1,203 @@
+#pragma once
+
+#include "file_backend.h"
+#include "posix_file_handler.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+namespace protostream {
+
+/** A backend mapping the file in windows of `WindowSize` bytes, on demand.
+ *
+ * At most `MaxWindows` windows are kept mapped, evicting the least recently
+ * used one, so the address space and the resident memory used do not
+ * depend on the size of the file. A window is also kept mapped as long as a
+ * pointer returned by `read` into it is alive. Reads straddling a window
+ * boundary are copied into a buffer. Writes go through `pwrite`, so the
+ * file grows without remapping.
+ *
+ * Reads update the windows without synchronization, so the backend is not
+ * `thread_safe` and may be used by a single thread at a time.
+ */
+template <file_mode_t mode,
+          std::size_t WindowSize = 64 * 1024 * 1024 /* bytes */,
+          std::size_t MaxWindows = 16>
+class windowed_mmap_backend
+    : public file_backend<windowed_mmap_backend<mode, WindowSize, MaxWindows>> {
+    static_assert(WindowSize > 0 && WindowSize % (64 * 1024) == 0,
+                  "The window size must be a multiple of 64 KiB, so window offsets are "
+                  "page-aligned on every supported page size");
+    static_assert(MaxWindows > 0, "At least one window must be mapped");
+
+    using handler_type = posix_file_handler<mode>;
+
+public:
+    /** Pins the window the data lies in, or owns a copy of the data */
+    using pointer_type = std::shared_ptr<const std::uint8_t>;
+
+    static constexpr std::size_t window_size = WindowSize;
+    static constexpr std::size_t max_windows = MaxWindows;
+
+    windowed_mmap_backend(const char* path)
+        : file{std::make_shared<handler_type>(path)}, used_size{file->size()} {
+    }
+
+    windowed_mmap_backend(const windowed_mmap_backend&) = delete;
+
+    windowed_mmap_backend(windowed_mmap_backend&&) = default;
+
+    windowed_mmap_backend& operator=(const windowed_mmap_backend&) = delete;
+
+    windowed_mmap_backend& operator=(windowed_mmap_backend&&) = default;
+
+    template <class T>
+    void read_small(offset_t offset, T* into) const {
+        read_into(offset, sizeof(T), reinterpret_cast<std::uint8_t*>(into));
+    }
+
+    pointer_type read(offset_t offset, std::size_t length) const {
+        assert(offset + length <= used_size);
+        if (length == 0) {
+            return {};
+        }
+
+        const auto index = offset / window_size;
+        if ((offset + length - 1) / window_size == index) {
+            const auto window = window_at(index, offset + length);
+            return {window, window->data + (offset - index * window_size)};
+        }
+
+        std::shared_ptr<std::uint8_t> buffer{new std::uint8_t[length],
+                                             std::default_delete<std::uint8_t[]>{}};
+        read_into(offset, length, buffer.get());
+        return buffer;
+    }
+
+    template <class T>
+    void write_small(offset_t offset, const T* from) {
+        write(offset, sizeof(T), reinterpret_cast<const std::uint8_t*>(from));
+    }
+
+    template <bool /* dummy */ = true>
+    void write(offset_t offset, std::size_t length, const std::uint8_t* from) {
+        static_assert(mode == file_mode_t::READ_APPEND, "writing into a read-only file");
+        file->write(offset, length, from);
+        used_size = std::max<std::size_t>(used_size, offset + length);
+    }
+
+    /** Discards the data following the first `new_size` bytes */
+    template <bool /* dummy */ = true>
+    void truncate(std::size_t new_size) {
+        static_assert(mode == file_mode_t::READ_APPEND, "writing into a read-only file");
+        windows.clear();
+        positions.clear();
+        file->truncate(new_size);
+        used_size = new_size;
+    }
+
+    std::size_t size() const {
+        return used_size;
+    }
+
+    file_identity identity() const {
+        return file->identity();
+    }
+
+    const handler_type& handler() const {
+        return *file;
+    }
+
+    /** The number of windows currently kept mapped by the backend, not
+     * counting the ones only pinned by returned pointers */
+    std::size_t window_count() const {
+        return windows.size();
+    }
+
+private:
+    /** A mapped part of the file, [index * window_size, + length) */
+    struct window {
+        window(std::shared_ptr<handler_type> file, std::size_t index, std::size_t length)
+            : file{std::move(file)},
+              length{length},
+              data{this->file->mmap(length, index * window_size)} {
+        }
+
+        window(const window&) = delete;
+
+        window& operator=(const window&) = delete;
+
+        ~window() {
+            file->munmap(data, length);
+        }
+
+        std::shared_ptr<handler_type> file;
+        std::size_t length;
+        typename handler_type::buffer_type data;
+    };
+
+    using window_list = std::list<std::pair<std::size_t, std::shared_ptr<const window>>>;
+
+    std::shared_ptr<handler_type> file;
+    std::size_t used_size;
+
+    /* Most recently used first */
+    mutable window_list windows;
+    mutable std::unordered_map<std::size_t, typename window_list::iterator> positions;
+
+    /** Returns the window `index`, mapped at least up to `end` */
+    std::shared_ptr<const window> window_at(std::size_t index, offset_t end) const {
+        const auto it = positions.find(index);
+        if (it != positions.end()) {
+            windows.splice(windows.begin(), windows, it->second);
+            if (index * window_size + it->second->second->length >= end) {
+                return it->second->second;
+            }
+
+            /* The file has grown since the window was mapped */
+            windows.pop_front();
+            positions.erase(it);
+        }
+
+        const auto length = std::min(window_size, used_size - index * window_size);
+        auto mapped = std::make_shared<const window>(file, index, length);
+
+        windows.emplace_front(index, mapped);
+        positions[index] = windows.begin();
+        if (windows.size() > max_windows) {
+            positions.erase(windows.back().first);
+            windows.pop_back();
+        }
+        return mapped;
+    }
+
+    /** Copies `length` bytes starting from `offset`, window by window */
+    void read_into(offset_t offset, std::size_t length, std::uint8_t* into) const {
+        assert(offset + length <= used_size);
+        while (length > 0) {
+            const auto index = offset / window_size;
+            const auto in_window = offset - index * window_size;
+            const auto count = std::min(length, window_size - in_window);
+
+            std::memcpy(into, window_at(index, offset + count)->data + in_window, count);
+            offset += count;
+            into += count;
+            length -= count;
+        }
+    }
+};
+
+template <file_mode_t mode, std::size_t WindowSize, std::size_t MaxWindows>
+constexpr std::size_t windowed_mmap_backend<mode, WindowSize, MaxWindows>::window_size;
+
+template <file_mode_t mode, std::size_t WindowSize, std::size_t MaxWindows>
+constexpr std::size_t windowed_mmap_backend<mode, WindowSize, MaxWindows>::max_windows;
+}
@@ -2,94 +2,693 @@
 
 #include "stream.h"
 #include "mmap_backend.h"
+#include "posix_file_backend.h"
 #include "cache.h"
+#include "pipeline_queue.h"
+#include "shared_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 using namespace protostream;
 
-using hstream = stream<with_backend<mmap_backend<file_mode_t::READ_APPEND>>,
-                       with_cache<offsets_only_cache>,
-                       with_keyframe_factory<default_factory<const std::uint8_t*>>,
-                       with_delta_factory<default_factory<const std::uint8_t*>>,
-                       with_proto_header_factory<default_factory<const std::uint8_t*>>>;
+namespace {
+thread_local std::string last_error;
+
+/** Calls `fun`, translating an exception into an error code */
+template <class Fun>
+ProtostreamError report_errors(Fun&& fun) noexcept {
+    try {
+        fun();
+        return PROTOSTREAM_OK;
+    } catch (const std::system_error& e) {
+        last_error = e.what();
+        return PROTOSTREAM_ERROR_SYSTEM;
+    } catch (const std::bad_alloc& e) {
+        last_error = e.what();
+        return PROTOSTREAM_ERROR_NO_MEMORY;
+    } catch (const std::length_error& e) {
+        last_error = e.what();
+        return PROTOSTREAM_ERROR_INVALID_ARGUMENT;
+    } catch (const std::out_of_range& e) {
+        last_error = e.what();
+        return PROTOSTREAM_ERROR_INVALID_ARGUMENT;
+    } catch (const std::invalid_argument& e) {
+        last_error = e.what();
+        return PROTOSTREAM_ERROR_INVALID_ARGUMENT;
+    } catch (const std::exception& e) {
+        last_error = e.what();
+        return PROTOSTREAM_ERROR_INVALID_FILE;
+    } catch (...) {
+        last_error = "Unknown error";
+        return PROTOSTREAM_ERROR_UNKNOWN;
+    }
+}
+
+/** Constructs a `T` in the caller-provided `storage`, or on the heap if it
+ * is null */
+template <class T, class Storage, class... Args>
+T* construct(Storage* storage, Args&&... args) {
+    static_assert(sizeof(T) <= sizeof(Storage) && alignof(T) <= alignof(Storage),
+                  "An iterator does not fit in the caller-provided storage");
+    if (storage) {
+        return new (storage) T{std::forward<Args>(args)...};
+    } else {
+        return new T{std::forward<Args>(args)...};
+    }
+}
+
+/** Hands a frame buffer over to the C caller, who releases it with
+ * protostream_free_frame */
+inline const void* release(const std::uint8_t* ptr) {
+    return ptr;
+}
+
+inline const void* release(std::unique_ptr<const std::uint8_t[]>& ptr) {
+    return ptr.release();
+}
+
+inline void free_frame(const void*, const std::uint8_t*) {
+}
+
+inline void free_frame(const void* frame, const std::unique_ptr<const std::uint8_t[]>&) {
+    delete[] static_cast<const std::uint8_t*>(frame);
+}
+
+/** A frame visited by c_stream::scan */
+struct scanned_frame {
+    std::uint64_t id;
+    bool is_keyframe;
+    const void* data;
+    std::size_t size;
+    /** Owns `data` if the backend copies frames into buffers */
+    std::unique_ptr<const std::uint8_t[]> buffer;
+};
+
+inline scanned_frame make_scanned_frame(std::uint64_t id,
+                                        bool is_keyframe,
+                                        std::pair<const std::uint8_t*, std::size_t> frame) {
+    return {id, is_keyframe, frame.first, frame.second, nullptr};
+}
+
+inline scanned_frame make_scanned_frame(
+    std::uint64_t id,
+    bool is_keyframe,
+    std::pair<std::unique_ptr<const std::uint8_t[]>, std::size_t> frame) {
+    const auto data = frame.first.get();
+    return {id, is_keyframe, data, frame.second, std::move(frame.first)};
+}
+
+class c_delta_iterator {
+public:
+    virtual ~c_delta_iterator() = default;
+
+    virtual void get(const void** into, size_t* size) const = 0;
+
+    virtual void advance() = 0;
+};
+
+class c_stream;
+
+/** The type-erased iterators stored behind HKeyframeIterator and
+ * HDeltaIterator. They fit in HKeyframeIteratorStorage and
+ * HDeltaIteratorStorage, and are trivially destructible apart from their
+ * virtual destructors, so the ones in caller-provided storage need not be
+ * destroyed. */
+class c_keyframe_iterator {
+public:
+    virtual ~c_keyframe_iterator() = default;
+
+    virtual void get(const void** into, size_t* size) const = 0;
+
+    virtual bool valid(const c_stream& stream) const = 0;
+
+    virtual void advance(std::uint32_t offset) = 0;
+
+    /** Retrieves up to `max` keyframes, counting them in `count` as they
+     * are retrieved, so that it is accurate if an exception is thrown */
+    virtual void get_keyframes(const c_stream& stream,
+                               const void** out_ptrs,
+                               size_t* out_sizes,
+                               std::size_t max,
+                               std::size_t& count) = 0;
+
+    virtual c_delta_iterator* iter_deltas(HDeltaIteratorStorage* storage) const = 0;
+
+    virtual bool valid(const c_delta_iterator& iterator) const = 0;
+
+    /** Retrieves up to `max` deltas, like `get_keyframes` */
+    virtual void get_deltas(c_delta_iterator& iterator,
+                            const void** out_ptrs,
+                            size_t* out_sizes,
+                            std::size_t max,
+                            std::size_t& count) const = 0;
+};
+
+/** The type-erased stream behind HStream, one instantiation per backend and
+ * cache selectable with protostream_open_existing_ex */
+class c_stream {
+public:
+    virtual ~c_stream() noexcept(false) = default;
+
+    virtual void append_keyframe(const std::uint8_t* data, std::size_t size) = 0;
+
+    virtual void append_delta(const std::uint8_t* data, delta_size_t size) = 0;
+
+    virtual void get_header(const void** into, size_t* size) const = 0;
+
+    virtual void free_frame(const void* frame) const = 0;
+
+    virtual c_keyframe_iterator* iter_keyframes(HKeyframeIteratorStorage* storage) const = 0;
+
+    virtual std::size_t keyframe_count() const = 0;
+
+    virtual std::size_t frame_count() const = 0;
+
+    virtual std::uint32_t frames_per_keyframe() const = 0;
+
+    virtual counting_stats stats() const = 0;
+
+    /** Visits the frames [first, last) in order, until `visit` returns false */
+    virtual void scan(std::uint64_t first,
+                      std::uint64_t last,
+                      const std::function<bool(scanned_frame&&)>& visit) const = 0;
+};
+
+template <class Stream>
+class typed_delta_iterator : public c_delta_iterator {
+public:
+    explicit typed_delta_iterator(typename Stream::delta_iterator it) : it{it} {
+    }
+
+    void get(const void** into, size_t* size) const override {
+        auto delta = it->get();
+        *into = release(delta.first);
+        *size = delta.second;
+    }
+
+    void advance() override {
+        ++it;
+    }
+
+    typename Stream::delta_iterator it;
+};
+
+template <class Stream>
+class typed_stream;
+
+template <class Stream>
+class typed_keyframe_iterator : public c_keyframe_iterator {
+public:
+    explicit typed_keyframe_iterator(typename Stream::keyframe_iterator it) : it{it} {
+    }
+
+    void get(const void** into, size_t* size) const override {
+        auto keyframe = it->get();
+        *into = release(keyframe.first);
+        *size = keyframe.second;
+    }
+
+    bool valid(const c_stream& stream) const override {
+        return it != typed(stream).end();
+    }
+
+    void advance(std::uint32_t offset) override {
+        it += offset;
+    }
+
+    void get_keyframes(const c_stream& stream,
+                       const void** out_ptrs,
+                       size_t* out_sizes,
+                       std::size_t max,
+                       std::size_t& count) override {
+        const auto end = typed(stream).end();
+
+        for (count = 0; count < max && it != end; ++it) {
+            auto keyframe = it->get();
+            out_ptrs[count] = release(keyframe.first);
+            out_sizes[count++] = keyframe.second;
+        }
+    }
+
+    c_delta_iterator* iter_deltas(HDeltaIteratorStorage* storage) const override {
+        return construct<typed_delta_iterator<Stream>>(storage, it->begin());
+    }
+
+    bool valid(const c_delta_iterator& iterator) const override {
+        return typed(iterator) != it->end();
+    }
+
+    void get_deltas(c_delta_iterator& iterator,
+                    const void** out_ptrs,
+                    size_t* out_sizes,
+                    std::size_t max,
+                    std::size_t& count) const override {
+        const auto end = it->end();
+        auto& delta_it = typed(iterator);
+
+        for (count = 0; count < max && delta_it != end; ++delta_it) {
+            auto delta = delta_it->get();
+            out_ptrs[count] = release(delta.first);
+            out_sizes[count++] = delta.second;
+        }
+    }
+
+private:
+    typename Stream::keyframe_iterator it;
+
+    static const Stream& typed(const c_stream& stream) {
+        return static_cast<const typed_stream<Stream>&>(stream).str;
+    }
+
+    static const typename Stream::delta_iterator& typed(const c_delta_iterator& iterator) {
+        return static_cast<const typed_delta_iterator<Stream>&>(iterator).it;
+    }
+
+    static typename Stream::delta_iterator& typed(c_delta_iterator& iterator) {
+        return static_cast<typed_delta_iterator<Stream>&>(iterator).it;
+    }
+};
+
+/** Whether a posix_file_handler is opened for writing */
+template <class Handler>
+struct is_writable;
+
+template <file_mode_t mode>
+struct is_writable<posix_file_handler<mode>>
+    : std::integral_constant<bool, mode == file_mode_t::READ_APPEND> {};
+
+template <class Stream>
+class typed_stream : public c_stream {
+    using writable = is_writable<std::decay_t<
+        decltype(std::declval<const typename Stream::backend_type&>().handler())>>;
+
+public:
+    template <class... Args>
+    explicit typed_stream(Args&&... args) : str{std::forward<Args>(args)...} {
+    }
+
+    void append_keyframe(const std::uint8_t* data, std::size_t size) override {
+        append_keyframe(data, size, writable{});
+    }
+
+    void append_delta(const std::uint8_t* data, delta_size_t size) override {
+        append_delta(data, size, writable{});
+    }
+
+    void get_header(const void** into, size_t* size) const override {
+        auto header = str.get_proto_header();
+        *into = release(header.first);
+        *size = header.second;
+    }
+
+    void free_frame(const void* frame) const override {
+        ::free_frame(frame, typename Stream::pointer_type{});
+    }
+
+    c_keyframe_iterator* iter_keyframes(HKeyframeIteratorStorage* storage) const override {
+        return construct<typed_keyframe_iterator<Stream>>(storage, str.begin());
+    }
+
+    std::size_t keyframe_count() const override {
+        return str.keyframe_count();
+    }
+
+    std::size_t frame_count() const override {
+        return str.frame_count();
+    }
+
+    std::uint32_t frames_per_keyframe() const override {
+        return str.frames_per_keyframe();
+    }
+
+    counting_stats stats() const override {
+        return stats(std::is_same<typename Stream::stats_type, counting_stats>{});
+    }
+
+    void scan(std::uint64_t first,
+              std::uint64_t last,
+              const std::function<bool(scanned_frame&&)>& visit) const override {
+        if (first > last || last > str.frame_count()) {
+            throw std::out_of_range{"Invalid frame range"};
+        }
+        if (first == last) {
+            return;
+        }
+
+        const auto frames_per_kf = str.frames_per_keyframe();
+        auto keyframe = str.begin() + first / frames_per_kf;
+        auto frame = first / frames_per_kf * frames_per_kf;
+
+        for (; frame < last; ++keyframe) {
+            if (frame >= first && !visit(make_scanned_frame(frame, true, keyframe->get()))) {
+                return;
+            }
+            ++frame;
+
+            const auto end = keyframe->end();
+            for (auto delta = keyframe->begin(); frame < last && delta != end; ++delta, ++frame) {
+                if (frame >= first && !visit(make_scanned_frame(frame, false, delta->get()))) {
+                    return;
+                }
+            }
+        }
+    }
+
+    Stream str;
+
+private:
+    void append_keyframe(const std::uint8_t* data, std::size_t size, std::true_type) {
+        str.append_keyframe(data, size);
+    }
+
+    void append_delta(const std::uint8_t* data, delta_size_t size, std::true_type) {
+        str.append_delta(data, size);
+    }
+
+    [[noreturn]] void append_keyframe(const std::uint8_t*, std::size_t, std::false_type) {
+        throw std::invalid_argument{"Stream opened read-only"};
+    }
+
+    [[noreturn]] void append_delta(const std::uint8_t*, delta_size_t, std::false_type) {
+        throw std::invalid_argument{"Stream opened read-only"};
+    }
+
+    counting_stats stats(std::true_type /* counted */) const {
+        return str.stats();
+    }
+
+    counting_stats stats(std::false_type /* counted */) const {
+        return {};
+    }
+};
+
+template <template <file_mode_t> class Backend,
+          file_mode_t mode,
+          template <class> class Cache,
+          class Stats = no_stats>
+using c_stream_type = typed_stream<
+    stream<with_backend<Backend<mode>>,
+           with_cache<Cache>,
+           with_stats<Stats>,
+           with_keyframe_factory<default_factory<typename Backend<mode>::pointer_type>>,
+           with_delta_factory<default_factory<typename Backend<mode>::pointer_type>>,
+           with_proto_header_factory<default_factory<typename Backend<mode>::pointer_type>>>>;
+
+template <file_mode_t mode>
+using default_mmap_backend = mmap_backend<mode>;
+
+/** The stream opened by protostream_open_existing and protostream_open_new */
+using default_stream =
+    c_stream_type<default_mmap_backend, file_mode_t::READ_APPEND, offsets_only_cache>;
+
+template <template <file_mode_t> class Backend, file_mode_t mode, class Stats>
+c_stream* open_with_cache(const char* path, std::uint32_t flags) {
+    switch (flags & (PROTOSTREAM_OPEN_FULL_CACHE | PROTOSTREAM_OPEN_SHARED_CACHE)) {
+    case 0:
+        return new c_stream_type<Backend, mode, offsets_only_cache, Stats>{path};
+    case PROTOSTREAM_OPEN_FULL_CACHE:
+        return new c_stream_type<Backend, mode, full_cache, Stats>{path};
+    case PROTOSTREAM_OPEN_SHARED_CACHE:
+        return new c_stream_type<Backend, mode, shared_cache, Stats>{path};
+    default:
+        throw std::invalid_argument{"Conflicting cache flags"};
+    }
+}
+
+template <template <file_mode_t> class Backend, file_mode_t mode>
+c_stream* open_with_stats(const char* path, std::uint32_t flags) {
+    if (flags & PROTOSTREAM_OPEN_STATS) {
+        return open_with_cache<Backend, mode, counting_stats>(path, flags);
+    } else {
+        return open_with_cache<Backend, mode, no_stats>(path, flags);
+    }
+}
+
+template <template <file_mode_t> class Backend>
+c_stream* open_with_mode(const char* path, std::uint32_t flags) {
+    if (flags & PROTOSTREAM_OPEN_READ_ONLY) {
+        return open_with_stats<Backend, file_mode_t::READ_ONLY>(path, flags);
+    } else {
+        return open_with_stats<Backend, file_mode_t::READ_APPEND>(path, flags);
+    }
+}
+
+c_stream* open_existing(const char* path, std::uint32_t flags) {
+    constexpr std::uint32_t all_flags = PROTOSTREAM_OPEN_READ_ONLY | PROTOSTREAM_OPEN_PREAD |
+                                        PROTOSTREAM_OPEN_FULL_CACHE |
+                                        PROTOSTREAM_OPEN_SHARED_CACHE | PROTOSTREAM_OPEN_STATS;
+    if (flags & ~all_flags) {
+        throw std::invalid_argument{"Unknown flags"};
+    }
+
+    if (flags & PROTOSTREAM_OPEN_PREAD) {
+        return open_with_mode<posix_file_backend>(path, flags);
+    } else {
+        return open_with_mode<default_mmap_backend>(path, flags);
+    }
+}
+
+c_stream* as_stream(HStream* stream) {
+    return reinterpret_cast<c_stream*>(stream);
+}
+
+HStream* as_handle(c_stream* stream) {
+    return reinterpret_cast<HStream*>(stream);
+}
+
+c_keyframe_iterator* as_iterator(HKeyframeIterator* iterator) {
+    return reinterpret_cast<c_keyframe_iterator*>(iterator);
+}
+
+HKeyframeIterator* as_handle(c_keyframe_iterator* iterator) {
+    return reinterpret_cast<HKeyframeIterator*>(iterator);
+}
+
+c_delta_iterator* as_iterator(HDeltaIterator* iterator) {
+    return reinterpret_cast<c_delta_iterator*>(iterator);
+}
+
+HDeltaIterator* as_handle(c_delta_iterator* iterator) {
+    return reinterpret_cast<HDeltaIterator*>(iterator);
+}
+
+/** Appends a delta, rejecting the ones whose size does not fit in the file */
+void append_delta(c_stream* stream, const void* delta, std::size_t delta_size) {
+    if (delta_size > std::numeric_limits<delta_size_t>::max()) {
+        throw std::length_error{"Delta too large"};
+    }
+    stream->append_delta(static_cast<const std::uint8_t*>(delta),
+                         static_cast<delta_size_t>(delta_size));
+}
+
+/** Returns the result of a scan stopped by a callback returning `stopped` */
+int scan_result(int stopped) {
+    if (stopped < 0) {
+        last_error = "The scan callback failed";
+        return PROTOSTREAM_ERROR_CALLBACK;
+    }
+    return stopped;
+}
+}
 
 HStream* protostream_open_existing(const char* path) noexcept {
-    auto ptr = new hstream{path};
-    return reinterpret_cast<HStream*>(ptr);
+    return as_handle(new default_stream{path});
+}
+
+HStream* protostream_open_existing_ex(const char* path, uint32_t flags) noexcept {
+    return as_handle(open_existing(path, flags));
 }
 
 HStream* protostream_open_new(const char* path,
                               uint32_t frames_per_kf,
                               const void* proto_header,
                               size_t proto_header_size) noexcept {
-    auto ptr = new hstream{path, frames_per_kf, proto_header, proto_header_size};
-    return reinterpret_cast<HStream*>(ptr);
+    return as_handle(new default_stream{path, frames_per_kf, proto_header, proto_header_size});
 }
 
 void protostream_close(HStream* stream) noexcept {
-    auto ptr = reinterpret_cast<hstream*>(stream);
-    delete ptr;
+    delete as_stream(stream);
+}
+
+ProtostreamError protostream_try_open_existing(const char* path, HStream** stream) noexcept {
+    return report_errors([&] { *stream = as_handle(new default_stream{path}); });
+}
+
+ProtostreamError protostream_try_open_existing_ex(const char* path,
+                                                  uint32_t flags,
+                                                  HStream** stream) noexcept {
+    return report_errors([&] { *stream = as_handle(open_existing(path, flags)); });
+}
+
+ProtostreamError protostream_try_open_new(const char* path,
+                                          uint32_t frames_per_kf,
+                                          const void* proto_header,
+                                          size_t proto_header_size,
+                                          HStream** stream) noexcept {
+    return report_errors([&] {
+        *stream = as_handle(
+            new default_stream{path, frames_per_kf, proto_header, proto_header_size});
+    });
+}
+
+ProtostreamError protostream_try_close(HStream* stream) noexcept {
+    return report_errors([&] { delete as_stream(stream); });
+}
+
+const char* protostream_last_error(void) noexcept {
+    return last_error.c_str();
 }
 
 void protostream_append_keyframe(HStream* stream,
                                  const void* keyframe,
                                  size_t keyframe_size) noexcept {
-    auto ptr = reinterpret_cast<hstream*>(stream);
-    ptr->append_keyframe(static_cast<const std::uint8_t*>(keyframe), keyframe_size);
+    as_stream(stream)->append_keyframe(static_cast<const std::uint8_t*>(keyframe), keyframe_size);
 }
 
 void protostream_append_delta(HStream* stream, const void* delta, size_t delta_size) noexcept {
-    auto ptr = reinterpret_cast<hstream*>(stream);
-    ptr->append_delta(static_cast<const std::uint8_t*>(delta), delta_size);
+    append_delta(as_stream(stream), delta, delta_size);
+}
+
+ProtostreamError protostream_try_append_keyframe(HStream* stream,
+                                                 const void* keyframe,
+                                                 size_t keyframe_size) noexcept {
+    return report_errors([&] {
+        as_stream(stream)->append_keyframe(static_cast<const std::uint8_t*>(keyframe),
+                                           keyframe_size);
+    });
+}
+
+ProtostreamError protostream_try_append_delta(HStream* stream,
+                                              const void* delta,
+                                              size_t delta_size) noexcept {
+    return report_errors([&] { append_delta(as_stream(stream), delta, delta_size); });
+}
+
+ProtostreamError protostream_append_batch(HStream* stream,
+                                          const void* const* frames,
+                                          const size_t* sizes,
+                                          size_t count,
+                                          size_t* appended) noexcept {
+    auto ptr = as_stream(stream);
+    const auto frames_per_kf = ptr->frames_per_keyframe();
+    auto i = std::size_t{0};
+
+    const auto result = report_errors([&] {
+        for (; i < count; ++i) {
+            const auto frame = static_cast<const std::uint8_t*>(frames[i]);
+            if (ptr->frame_count() % frames_per_kf == 0) {
+                ptr->append_keyframe(frame, sizes[i]);
+            } else {
+                append_delta(ptr, frame, sizes[i]);
+            }
+        }
+    });
+
+    if (appended) {
+        *appended = i;
+    }
+    return result;
 }
 
 void protostream_get_header(HStream* stream, const void** into, size_t* size) noexcept {
-    auto ptr = reinterpret_cast<hstream*>(stream);
-    std::tie(*into, *size) = ptr->get_proto_header();
+    as_stream(stream)->get_header(into, size);
 }
 
 void protostream_free_header(const void*) noexcept {
 }
 
+void protostream_free_frame(HStream* stream, const void* frame) noexcept {
+    as_stream(stream)->free_frame(frame);
+}
+
 HKeyframeIterator* protostream_iter_keyframes(HStream* stream) noexcept {
-    auto ptr = reinterpret_cast<hstream*>(stream);
-    auto iter = new hstream::keyframe_iterator{ptr->begin()};
-    return reinterpret_cast<HKeyframeIterator*>(iter);
+    return as_handle(as_stream(stream)->iter_keyframes(nullptr));
+}
+
+HKeyframeIterator* protostream_init_keyframe_iterator(HStream* stream,
+                                                      HKeyframeIteratorStorage* storage) noexcept {
+    return as_handle(as_stream(stream)->iter_keyframes(storage));
 }
 
 void protostream_get_keyframe(HKeyframeIterator* iterator,
                               const void** into,
                               size_t* size) noexcept {
-    auto ptr = reinterpret_cast<hstream::keyframe_iterator*>(iterator);
-    std::tie(*into, *size) = (*ptr)->get();
+    as_iterator(iterator)->get(into, size);
+}
+
+ProtostreamError protostream_try_get_keyframe(HKeyframeIterator* iterator,
+                                              const void** into,
+                                              size_t* size) noexcept {
+    return report_errors([&] { as_iterator(iterator)->get(into, size); });
 }
 
 void protostream_free_keyframe(const void*) noexcept {
 }
 
 int protostream_valid_keyframe_iterator(HStream* stream, HKeyframeIterator* iterator) noexcept {
-    auto stream_ptr = reinterpret_cast<hstream*>(stream);
-    auto it = reinterpret_cast<hstream::keyframe_iterator*>(iterator);
-    return *it != stream_ptr->end();
+    return as_iterator(iterator)->valid(*as_stream(stream));
 }
 
 void protostream_advance_keyframe_iterator(HKeyframeIterator* iterator, uint32_t offset) noexcept {
-    auto it = reinterpret_cast<hstream::keyframe_iterator*>(iterator);
-    *it += offset;
+    as_iterator(iterator)->advance(offset);
 }
 
 void protostream_free_keyframe_iterator(HKeyframeIterator* iterator) noexcept {
-    delete reinterpret_cast<hstream::keyframe_iterator*>(iterator);
+    delete as_iterator(iterator);
+}
+
+size_t protostream_get_keyframes(HStream* stream,
+                                 HKeyframeIterator* iterator,
+                                 const void** out_ptrs,
+                                 size_t* out_sizes,
+                                 size_t max) noexcept {
+    auto count = std::size_t{0};
+    as_iterator(iterator)->get_keyframes(*as_stream(stream), out_ptrs, out_sizes, max, count);
+    return count;
+}
+
+ProtostreamError protostream_try_get_keyframes(HStream* stream,
+                                               HKeyframeIterator* iterator,
+                                               const void** out_ptrs,
+                                               size_t* out_sizes,
+                                               size_t max,
+                                               size_t* retrieved) noexcept {
+    auto count = std::size_t{0};
+    const auto result = report_errors([&] {
+        as_iterator(iterator)->get_keyframes(*as_stream(stream), out_ptrs, out_sizes, max, count);
+    });
+
+    *retrieved = count;
+    return result;
 }
 
 HDeltaIterator* protostream_iter_deltas(HKeyframeIterator* keyframe) noexcept {
-    auto ptr = reinterpret_cast<hstream::keyframe_iterator*>(keyframe);
-    auto iter = new hstream::delta_iterator{(*ptr)->begin()};
-    return reinterpret_cast<HDeltaIterator*>(iter);
+    return as_handle(as_iterator(keyframe)->iter_deltas(nullptr));
+}
+
+HDeltaIterator* protostream_init_delta_iterator(HKeyframeIterator* keyframe,
+                                                HDeltaIteratorStorage* storage) noexcept {
+    return as_handle(as_iterator(keyframe)->iter_deltas(storage));
 }
 
 void protostream_get_delta(HDeltaIterator* iterator, const void** into, size_t* size) noexcept {
-    auto ptr = reinterpret_cast<hstream::delta_iterator*>(iterator);
-    std::tie(*into, *size) = (*ptr)->get();
+    as_iterator(iterator)->get(into, size);
+}
+
+ProtostreamError protostream_try_get_delta(HDeltaIterator* iterator,
+                                           const void** into,
+                                           size_t* size) noexcept {
+    return report_errors([&] { as_iterator(iterator)->get(into, size); });
 }
 
 void protostream_free_delta(const void*) noexcept {
@@ -97,27 +696,144 @@ void protostream_free_delta(const void*) noexcept {
 
 int protostream_valid_delta_iterator(HKeyframeIterator* keyframe,
                                      HDeltaIterator* iterator) noexcept {
-    auto keyframe_ptr = reinterpret_cast<hstream::keyframe_iterator*>(keyframe);
-    auto it_ptr = reinterpret_cast<hstream::delta_iterator*>(iterator);
-    return *it_ptr != (*keyframe_ptr)->end();
+    return as_iterator(keyframe)->valid(*as_iterator(iterator));
 }
 
 void protostream_advance_delta_iterator(HDeltaIterator* iterator) noexcept {
-    ++*reinterpret_cast<hstream::delta_iterator*>(iterator);
+    as_iterator(iterator)->advance();
 }
 
 void protostream_free_delta_iterator(HDeltaIterator* iterator) noexcept {
-    delete reinterpret_cast<hstream::delta_iterator*>(iterator);
+    delete as_iterator(iterator);
+}
+
+size_t protostream_get_deltas(HKeyframeIterator* keyframe,
+                              HDeltaIterator* iterator,
+                              const void** out_ptrs,
+                              size_t* out_sizes,
+                              size_t max) noexcept {
+    auto count = std::size_t{0};
+    as_iterator(keyframe)->get_deltas(*as_iterator(iterator), out_ptrs, out_sizes, max, count);
+    return count;
+}
+
+ProtostreamError protostream_try_get_deltas(HKeyframeIterator* keyframe,
+                                            HDeltaIterator* iterator,
+                                            const void** out_ptrs,
+                                            size_t* out_sizes,
+                                            size_t max,
+                                            size_t* retrieved) noexcept {
+    auto count = std::size_t{0};
+    const auto result = report_errors([&] {
+        as_iterator(keyframe)->get_deltas(*as_iterator(iterator), out_ptrs, out_sizes, max, count);
+    });
+
+    *retrieved = count;
+    return result;
 }
 
 size_t protostream_keyframe_count(HStream* stream) noexcept {
-    return reinterpret_cast<hstream*>(stream)->keyframe_count();
+    return as_stream(stream)->keyframe_count();
 }
 
 size_t protostream_frame_count(HStream* stream) noexcept {
-    return reinterpret_cast<hstream*>(stream)->frame_count();
+    return as_stream(stream)->frame_count();
 }
 
 uint32_t protostream_frames_per_keyframe(HStream* stream) noexcept {
-    return reinterpret_cast<hstream*>(stream)->frames_per_keyframe();
+    return as_stream(stream)->frames_per_keyframe();
+}
+
+int protostream_scan(HStream* stream,
+                     uint64_t first_frame,
+                     uint64_t last_frame,
+                     ProtostreamScanCallback callback,
+                     void* user) noexcept {
+    auto stopped = 0;
+    const auto result = report_errors([&] {
+        as_stream(stream)->scan(first_frame, last_frame, [&](scanned_frame&& frame) {
+            stopped = callback(frame.id, frame.is_keyframe, frame.data, frame.size, user);
+            return stopped == 0;
+        });
+    });
+    return result != PROTOSTREAM_OK ? result : scan_result(stopped);
+}
+
+int protostream_scan_parallel(HStream* stream,
+                              uint64_t first_frame,
+                              uint64_t last_frame,
+                              ProtostreamScanCallback callback,
+                              void* user,
+                              unsigned threads) noexcept {
+    /* Frames are handed to the workers in batches of consecutive frames */
+    constexpr auto batch_size = std::size_t{256};
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    detail::pipeline_queue<std::vector<scanned_frame>> batches{2 * threads};
+    std::atomic<int> stopped{0};
+
+    const auto work = [&] {
+        while (auto batch = batches.pop()) {
+            for (auto& frame : *batch) {
+                if (stopped.load(std::memory_order_relaxed) != 0) {
+                    return;
+                }
+                const auto ret =
+                    callback(frame.id, frame.is_keyframe, frame.data, frame.size, user);
+                if (ret != 0) {
+                    auto expected = 0;
+                    stopped.compare_exchange_strong(expected, ret);
+                    batches.cancel();
+                    return;
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    const auto result = report_errors([&] {
+        for (auto i = 0u; i < threads; ++i) {
+            workers.emplace_back(work);
+        }
+
+        std::vector<scanned_frame> batch;
+        const auto flush = [&] {
+            const auto pushed = batches.push(std::move(batch));
+            batch.clear();
+            return pushed;
+        };
+
+        as_stream(stream)->scan(first_frame, last_frame, [&](scanned_frame&& frame) {
+            batch.push_back(std::move(frame));
+            return batch.size() < batch_size || flush();
+        });
+        if (!batch.empty()) {
+            flush();
+        }
+        batches.close();
+    });
+
+    if (result != PROTOSTREAM_OK) {
+        batches.cancel();
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    return result != PROTOSTREAM_OK ? result : scan_result(stopped.load());
+}
+
+void protostream_get_stats(HStream* stream, StreamStats* stats) noexcept {
+    const auto result = as_stream(stream)->stats();
+    stats->reads = result.reads;
+    stats->bytes_read = result.bytes_read;
+    stats->writes = result.writes;
+    stats->bytes_written = result.bytes_written;
+    stats->bytes_allocated = result.bytes_allocated;
+    stats->mmap_expansions = result.mmap_expansions;
+    stats->header_writes = result.header_writes;
+    stats->link_hops = result.link_hops;
+    stats->cache_hits = result.cache_hits;
+    stats->cache_misses = result.cache_misses;
 }
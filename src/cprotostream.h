@@ -8,7 +8,8 @@ extern "C" {
 
 /** Almost every function declared in this file wraps a protostream function
  * which may throw an exception if a system error occurs. In this case cprotostream
- * aborts execution.
+ * aborts execution, except in the functions returning a ProtostreamError, which
+ * report the failure instead.
  */
 #define NOEXCEPT noexcept
 #else
@@ -24,9 +25,93 @@ typedef struct HKeyframeIterator HKeyframeIterator;
 /** An opaque handler to a delta iterator */
 typedef struct HDeltaIterator HDeltaIterator;
 
+/** Error codes returned by the functions which do not abort on failure */
+typedef enum ProtostreamError {
+    PROTOSTREAM_OK = 0,
+    /** A system call failed */
+    PROTOSTREAM_ERROR_SYSTEM = -1,
+    /** Memory could not be allocated */
+    PROTOSTREAM_ERROR_NO_MEMORY = -2,
+    /** An argument is out of range, e.g. a delta is too large */
+    PROTOSTREAM_ERROR_INVALID_ARGUMENT = -3,
+    /** The file is not a valid protostream or is corrupted */
+    PROTOSTREAM_ERROR_INVALID_FILE = -4,
+    /** Any other failure */
+    PROTOSTREAM_ERROR_UNKNOWN = -5,
+    /** A scan callback returned a negative value */
+    PROTOSTREAM_ERROR_CALLBACK = -6
+} ProtostreamError;
+
+/** Flags of protostream_open_existing_ex, combined with bitwise OR */
+enum {
+    /** Opens the file without write permission, so it is never modified.
+     * protostream_try_append_* fail with PROTOSTREAM_ERROR_INVALID_ARGUMENT,
+     * while protostream_append_keyframe and protostream_append_delta abort. */
+    PROTOSTREAM_OPEN_READ_ONLY = 1,
+    /** Reads with pread instead of memory-mapping the file. Frames are then
+     * copied into buffers which must be freed with protostream_free_frame. */
+    PROTOSTREAM_OPEN_PREAD = 2,
+    /** Caches the keyframe headers as well as their offsets */
+    PROTOSTREAM_OPEN_FULL_CACHE = 4,
+    /** Shares the cached keyframe offsets and headers with the other streams
+     * of the process reading the same file. Excludes
+     * PROTOSTREAM_OPEN_FULL_CACHE. */
+    PROTOSTREAM_OPEN_SHARED_CACHE = 8,
+    /** Records I/O and cache statistics, see protostream_get_stats. Streams
+     * opened without it do not pay for the counters. */
+    PROTOSTREAM_OPEN_STATS = 16
+};
+
+/** Caller-provided storage for a keyframe iterator, see
+ * protostream_init_keyframe_iterator. Its contents are opaque. */
+typedef struct HKeyframeIteratorStorage {
+    uint64_t opaque[4];
+} HKeyframeIteratorStorage;
+
+/** Caller-provided storage for a delta iterator, see
+ * protostream_init_delta_iterator. Its contents are opaque. */
+typedef struct HDeltaIteratorStorage {
+    uint64_t opaque[4];
+} HDeltaIteratorStorage;
+
+/** I/O and cache statistics of a stream, see protostream::counting_stats */
+typedef struct StreamStats {
+    uint64_t reads;
+    uint64_t bytes_read;
+    uint64_t writes;
+    uint64_t bytes_written;
+    uint64_t bytes_allocated;
+    uint64_t mmap_expansions;
+    uint64_t header_writes;
+    uint64_t link_hops;
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+} StreamStats;
+
+/** A function called by protostream_scan for every frame, with the user
+ * pointer passed to protostream_scan. The frame is valid only during the
+ * call.
+ *
+ * Return value: 0 to continue the scan, a positive value to stop it, which
+ *     is then returned by protostream_scan, or a negative value to abort it
+ *     with PROTOSTREAM_ERROR_CALLBACK
+ */
+typedef int (*ProtostreamScanCallback)(uint64_t frame_id,
+                                       int is_keyframe,
+                                       const void* data,
+                                       size_t size,
+                                       void* user);
+
 /** Opens a protostream file, reading its header */
 HStream* protostream_open_existing(const char* path) NOEXCEPT;
 
+/** Opens a protostream file with the backend and the cache selected by
+ * `flags` (PROTOSTREAM_OPEN_*), reading its header.
+ *
+ * With no flags, this is equivalent to protostream_open_existing.
+ */
+HStream* protostream_open_existing_ex(const char* path, uint32_t flags) NOEXCEPT;
+
 /** Opens a protostream file and writes a new header to it */
 HStream* protostream_open_new(const char* path,
                               uint32_t frames_per_kf,
@@ -36,14 +121,89 @@ HStream* protostream_open_new(const char* path,
 /** Closes a protostream file */
 void protostream_close(HStream* stream) NOEXCEPT;
 
-/** Appends a keyframe to a protostream */
+/** Opens a protostream file, reading its header.
+ *
+ * On success the stream is written into *stream, otherwise *stream is left
+ * unchanged.
+ */
+ProtostreamError protostream_try_open_existing(const char* path, HStream** stream) NOEXCEPT;
+
+/** Opens a protostream file with the backend and the cache selected by
+ * `flags`, see protostream_open_existing_ex.
+ *
+ * On success the stream is written into *stream, otherwise *stream is left
+ * unchanged.
+ */
+ProtostreamError protostream_try_open_existing_ex(const char* path,
+                                                  uint32_t flags,
+                                                  HStream** stream) NOEXCEPT;
+
+/** Opens a protostream file and writes a new header to it.
+ *
+ * On success the stream is written into *stream, otherwise *stream is left
+ * unchanged.
+ */
+ProtostreamError protostream_try_open_new(const char* path,
+                                          uint32_t frames_per_kf,
+                                          const void* proto_header,
+                                          size_t proto_header_size,
+                                          HStream** stream) NOEXCEPT;
+
+/** Closes a protostream file. The stream is freed even if an error is
+ * returned. */
+ProtostreamError protostream_try_close(HStream* stream) NOEXCEPT;
+
+/** Returns a description of the last error returned in the calling thread */
+const char* protostream_last_error(void) NOEXCEPT;
+
+/** Appends a keyframe to a protostream.
+ *
+ * Aborts if the stream was opened with PROTOSTREAM_OPEN_READ_ONLY (see
+ * protostream_try_append_keyframe).
+ */
 void protostream_append_keyframe(HStream* stream,
                                  const void* keyframe,
                                  size_t keyframe_size) NOEXCEPT;
 
-/** Appends a delta to a protostream */
+/** Appends a delta to a protostream.
+ *
+ * Aborts if the delta is too large to be stored, or if the stream was opened
+ * with PROTOSTREAM_OPEN_READ_ONLY (see protostream_try_append_delta).
+ */
 void protostream_append_delta(HStream* stream, const void* delta, size_t delta_size) NOEXCEPT;
 
+/** Appends a keyframe to a protostream.
+ *
+ * Fails with PROTOSTREAM_ERROR_INVALID_ARGUMENT if the stream was opened
+ * with PROTOSTREAM_OPEN_READ_ONLY.
+ */
+ProtostreamError protostream_try_append_keyframe(HStream* stream,
+                                                 const void* keyframe,
+                                                 size_t keyframe_size) NOEXCEPT;
+
+/** Appends a delta to a protostream.
+ *
+ * Deltas larger than 65535 bytes, and appends to streams opened with
+ * PROTOSTREAM_OPEN_READ_ONLY, are rejected with
+ * PROTOSTREAM_ERROR_INVALID_ARGUMENT.
+ */
+ProtostreamError protostream_try_append_delta(HStream* stream,
+                                              const void* delta,
+                                              size_t delta_size) NOEXCEPT;
+
+/** Appends `count` frames to a protostream, frames[i] of size sizes[i].
+ *
+ * Every frame starting a group of frames_per_keyframe frames is appended as
+ * a keyframe, the others as deltas. On failure the frames preceding the
+ * failing one remain appended; their number is written into *appended
+ * unless appended is NULL.
+ */
+ProtostreamError protostream_append_batch(HStream* stream,
+                                          const void* const* frames,
+                                          const size_t* sizes,
+                                          size_t count,
+                                          size_t* appended) NOEXCEPT;
+
 /** Retrieves the header of a protostream.
  *
  * The address of the header is written into *into and its size into *size
@@ -53,9 +213,24 @@ void protostream_get_header(HStream* stream, const void** into, size_t* size) NO
 /** Frees a header returned by protostream_get_header */
 void protostream_free_header(const void* header) NOEXCEPT;
 
+/** Frees a header, keyframe or delta retrieved from a stream.
+ *
+ * Required for streams opened with PROTOSTREAM_OPEN_PREAD, whose frames are
+ * copied into buffers. For memory-mapped streams it does nothing, like
+ * protostream_free_header, protostream_free_keyframe and
+ * protostream_free_delta, which are only valid for them.
+ */
+void protostream_free_frame(HStream* stream, const void* frame) NOEXCEPT;
+
 /** Returns an iterator over keyframes in a stream */
 HKeyframeIterator* protostream_iter_keyframes(HStream* stream) NOEXCEPT;
 
+/** Initializes an iterator over keyframes in a stream in caller-provided
+ * storage and returns it. The iterator must not be freed.
+ */
+HKeyframeIterator* protostream_init_keyframe_iterator(HStream* stream,
+                                                      HKeyframeIteratorStorage* storage) NOEXCEPT;
+
 /** Retrieves the contents of a keyframe.
  *
  * Precondition: protostream_valid_keyframe_iterator(stream, iterator),
@@ -66,6 +241,16 @@ void protostream_get_keyframe(HKeyframeIterator* iterator,
                               const void** into,
                               size_t* size) NOEXCEPT;
 
+/** Retrieves the contents of a keyframe, see protostream_get_keyframe.
+ *
+ * Fails instead of aborting, e.g. if the frame cannot be read from a
+ * stream opened with PROTOSTREAM_OPEN_PREAD. On failure *into and *size are
+ * left unchanged.
+ */
+ProtostreamError protostream_try_get_keyframe(HKeyframeIterator* iterator,
+                                              const void** into,
+                                              size_t* size) NOEXCEPT;
+
 /** Frees the contents of a keyframe returned by protostream_get_keyframe */
 void protostream_free_keyframe(const void* keyframe) NOEXCEPT;
 
@@ -87,9 +272,43 @@ void protostream_advance_keyframe_iterator(HKeyframeIterator* iterator, uint32_t
 /** Frees a keyframe iterator */
 void protostream_free_keyframe_iterator(HKeyframeIterator* iterator) NOEXCEPT;
 
+/** Retrieves the contents of up to `max` consecutive keyframes, advancing
+ * the iterator past them.
+ *
+ * The address and the size of the i-th keyframe are written into
+ * out_ptrs[i] and out_sizes[i].
+ * Return value: the number of keyframes retrieved, less than `max` only if
+ *     the end of the stream has been reached
+ */
+size_t protostream_get_keyframes(HStream* stream,
+                                 HKeyframeIterator* iterator,
+                                 const void** out_ptrs,
+                                 size_t* out_sizes,
+                                 size_t max) NOEXCEPT;
+
+/** Retrieves the contents of up to `max` consecutive keyframes, see
+ * protostream_get_keyframes.
+ *
+ * The number of keyframes retrieved is written into *retrieved. On failure
+ * they are the ones preceding the keyframe which could not be read, and the
+ * iterator points to the latter.
+ */
+ProtostreamError protostream_try_get_keyframes(HStream* stream,
+                                               HKeyframeIterator* iterator,
+                                               const void** out_ptrs,
+                                               size_t* out_sizes,
+                                               size_t max,
+                                               size_t* retrieved) NOEXCEPT;
+
 /** Returns an iterator over keyframes associated with the given keyframe */
 HDeltaIterator* protostream_iter_deltas(HKeyframeIterator* keyframe) NOEXCEPT;
 
+/** Initializes an iterator over deltas associated with the given keyframe
+ * in caller-provided storage and returns it. The iterator must not be freed.
+ */
+HDeltaIterator* protostream_init_delta_iterator(HKeyframeIterator* keyframe,
+                                                HDeltaIteratorStorage* storage) NOEXCEPT;
+
 /** Retrieves the contents of a delta.
  *
  *  Precondition: protostream_valid_delta_iterator(keyframe, iterator),
@@ -98,6 +317,12 @@ HDeltaIterator* protostream_iter_deltas(HKeyframeIterator* keyframe) NOEXCEPT;
  */
 void protostream_get_delta(HDeltaIterator* iterator, const void** into, size_t* size) NOEXCEPT;
 
+/** Retrieves the contents of a delta, failing instead of aborting, see
+ * protostream_try_get_keyframe */
+ProtostreamError protostream_try_get_delta(HDeltaIterator* iterator,
+                                           const void** into,
+                                           size_t* size) NOEXCEPT;
+
 /** Frees the contents of a delta returned by protostream_get_delta */
 void protostream_free_delta(const void* delta) NOEXCEPT;
 
@@ -120,6 +345,29 @@ void protostream_advance_delta_iterator(HDeltaIterator* iterator) NOEXCEPT;
 /** Frees a delta iterator */
 void protostream_free_delta_iterator(HDeltaIterator* iterator) NOEXCEPT;
 
+/** Retrieves the contents of up to `max` consecutive deltas, advancing the
+ * iterator past them.
+ *
+ * The address and the size of the i-th delta are written into out_ptrs[i]
+ * and out_sizes[i].
+ * Return value: the number of deltas retrieved, less than `max` only if the
+ *     last delta of the keyframe has been reached
+ */
+size_t protostream_get_deltas(HKeyframeIterator* keyframe,
+                              HDeltaIterator* iterator,
+                              const void** out_ptrs,
+                              size_t* out_sizes,
+                              size_t max) NOEXCEPT;
+
+/** Retrieves the contents of up to `max` consecutive deltas, failing instead
+ * of aborting, see protostream_try_get_keyframes */
+ProtostreamError protostream_try_get_deltas(HKeyframeIterator* keyframe,
+                                            HDeltaIterator* iterator,
+                                            const void** out_ptrs,
+                                            size_t* out_sizes,
+                                            size_t max,
+                                            size_t* retrieved) NOEXCEPT;
+
 /** Returns the total number of keyframes in the stream */
 size_t protostream_keyframe_count(HStream* stream) NOEXCEPT;
 
@@ -129,6 +377,46 @@ size_t protostream_frame_count(HStream* stream) NOEXCEPT;
 /** Returns the number of frames per keyframe (incl. the keyframe) */
 uint32_t protostream_frames_per_keyframe(HStream* stream) NOEXCEPT;
 
+/** Calls `callback` for every frame in [first_frame, last_frame), in order.
+ *
+ * Frames are passed straight out of the file mapping for memory-mapped
+ * streams, with a single seek to the first frame.
+ * Return value:
+ *     - 0 if all the frames have been visited
+ *     - the positive value returned by the callback which stopped the scan
+ *     - a negative ProtostreamError on failure, e.g.
+ *       PROTOSTREAM_ERROR_INVALID_ARGUMENT if the range is not within the
+ *       stream, or PROTOSTREAM_ERROR_CALLBACK if the callback failed
+ */
+int protostream_scan(HStream* stream,
+                     uint64_t first_frame,
+                     uint64_t last_frame,
+                     ProtostreamScanCallback callback,
+                     void* user) NOEXCEPT;
+
+/** Like protostream_scan, but calls `callback` concurrently on `threads`
+ * worker threads (0 for one per hardware thread), while the calling thread
+ * reads the frames.
+ *
+ * The callback must be thread-safe. Each worker visits batches of
+ * consecutive frames in order, but the batches are not ordered between
+ * the workers. After a callback stops the scan, the callbacks already
+ * running on other workers are completed.
+ */
+int protostream_scan_parallel(HStream* stream,
+                              uint64_t first_frame,
+                              uint64_t last_frame,
+                              ProtostreamScanCallback callback,
+                              void* user,
+                              unsigned threads) NOEXCEPT;
+
+/** Writes the statistics gathered since the stream was opened into *stats.
+ *
+ * Only streams opened with PROTOSTREAM_OPEN_STATS gather statistics, all the
+ * counters of the other ones are zero.
+ */
+void protostream_get_stats(HStream* stream, StreamStats* stats) NOEXCEPT;
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -1,53 +1,102 @@
+#include <gtest/gtest.h>
+
 #include "stream.h"
 #include "mmap_backend.h"
 #include "posix_file_backend.h"
+#include "windowed_mmap_backend.h"
 #include "cache.h"
+#include "../../tools/string_factory.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
 
 namespace streams {
 
 inline namespace types {
 using namespace protostream;
 
-struct string_factory {
-    using type = std::string;
-
-    static type build(const char* start, std::size_t len) {
-        return std::string(start, start + len);
-    }
-
-    template <class Ptr>
-    static type build(Ptr&& ptr, std::size_t len) {
-        return build(reinterpret_cast<const char*>(detail::as_ptr(ptr)), len);
-    }
-};
-
-using mmap_writer = stream<with_backend<mmap_backend<file_mode_t::READ_APPEND>>,
-                           with_cache<offsets_only_cache>,
-                           with_keyframe_factory<string_factory>,
-                           with_delta_factory<string_factory>,
-                           with_proto_header_factory<string_factory>>;
+using tools::string_factory;
 
-using stream_writer = stream<with_backend<posix_file_backend<file_mode_t::READ_APPEND>>,
-                             with_cache<full_cache>,
+/** A stream of `Options` building its proto header, keyframes and deltas
+ * into strings */
+template <class... Options>
+using string_stream = stream<Options...,
                              with_keyframe_factory<string_factory>,
                              with_delta_factory<string_factory>,
                              with_proto_header_factory<string_factory>>;
 
-using mmap_reader = stream<with_backend<mmap_backend<file_mode_t::READ_ONLY>>,
-                           with_cache<offsets_only_cache>,
-                           with_keyframe_factory<string_factory>,
-                           with_delta_factory<string_factory>,
-                           with_proto_header_factory<string_factory>>;
+using mmap_writer = string_stream<with_backend<mmap_backend<file_mode_t::READ_APPEND>>,
+                                  with_cache<offsets_only_cache>>;
 
-using stream_reader = stream<with_backend<posix_file_backend<file_mode_t::READ_ONLY>>,
-                             with_cache<full_cache>,
-                             with_keyframe_factory<string_factory>,
-                             with_delta_factory<string_factory>,
-                             with_proto_header_factory<string_factory>>;
+using stream_writer = string_stream<with_backend<posix_file_backend<file_mode_t::READ_APPEND>>,
+                                    with_cache<full_cache>>;
+
+using mmap_reader = string_stream<with_backend<mmap_backend<file_mode_t::READ_ONLY>>,
+                                  with_cache<offsets_only_cache>>;
+
+using stream_reader = string_stream<with_backend<posix_file_backend<file_mode_t::READ_ONLY>>,
+                                    with_cache<full_cache>>;
+
+/* Small windows, so that frames straddle their boundaries */
+template <file_mode_t mode>
+using small_windows_backend = windowed_mmap_backend<mode, 64 * 1024, 2>;
+
+using windowed_writer = string_stream<with_backend<small_windows_backend<file_mode_t::READ_APPEND>>,
+                                      with_cache<full_cache>>;
+
+using windowed_reader = string_stream<with_backend<small_windows_backend<file_mode_t::READ_ONLY>>,
+                                      with_cache<offsets_only_cache>>;
+}
+
+using read_streams = std::tuple<types::mmap_reader,
+                                types::mmap_writer,
+                                types::stream_reader,
+                                types::stream_writer,
+                                types::windowed_reader,
+                                types::windowed_writer>;
+
+using write_streams = std::tuple<types::mmap_writer, types::stream_writer, types::windowed_writer>;
+
+/** Appends `count` frames to `stream`, the contents of its `i`-th frame being
+ * `frame(i)`. Every `frames_per_keyframe()`-th frame is a keyframe. */
+template <class Stream, class Frame>
+void append_frames(Stream& stream, std::size_t count, Frame&& frame) {
+    const auto end = stream.frame_count() + count;
+    for (auto i = std::size_t{stream.frame_count()}; i < end; ++i) {
+        const auto data = frame(i);
+        const auto ptr = reinterpret_cast<const std::uint8_t*>(data.data());
+        if (i % stream.frames_per_keyframe() == 0) {
+            stream.append_keyframe(ptr, data.size());
+        } else {
+            stream.append_delta(ptr, data.size());
+        }
+    }
 }
 
-using read_streams =
-    std::tuple<types::mmap_reader, types::mmap_writer, types::stream_reader, types::stream_writer>;
+/** Reads the keyframes of `stream` and their deltas in order, expecting the
+ * `i`-th frame read to be `frame(first + i)`. Returns the number of frames
+ * read. */
+template <class Stream, class Frame>
+std::size_t read_all(const Stream& stream, Frame&& frame, std::size_t first = 0) {
+    auto id = first;
+    for (const auto& keyframe : stream) {
+        EXPECT_EQ(frame(id++), keyframe.get());
+        for (const auto& delta : keyframe) {
+            EXPECT_EQ(frame(id++), delta.get());
+        }
+    }
+    return id - first;
+}
 
-using write_streams = std::tuple<types::mmap_writer, types::stream_writer>;
-}
\ No newline at end of file
+/** Creates the stream `path` holding `count` frames, see `append_frames` */
+template <class Writer, class Frame>
+void fill(const char* path,
+          std::uint32_t frames_per_kf,
+          std::size_t count,
+          Frame&& frame,
+          const std::string& proto_header = "") {
+    Writer stream{path, frames_per_kf, proto_header.data(), proto_header.size()};
+    append_frames(stream, count, frame);
+}
+}
@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+
+#include "io_thread_pool.h"
+#include "shared_cache.h"
+#include "windowed_mmap_backend.h"
+#include "streams.h"
+#include "../common/temporary_file.h"
+
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+using namespace protostream;
+
+template <class Backend>
+using async_reader = streams::string_stream<with_backend<Backend>, with_cache<shared_cache>>;
+
+/* Reads remap the windows without synchronization */
+static_assert(
+    !detail::is_thread_safe_backend<windowed_mmap_backend<file_mode_t::READ_ONLY>>::value,
+    "windowed_mmap_backend cannot serve concurrent reads");
+
+constexpr auto frames_per_keyframe = 5u;
+constexpr auto frame_count = 2000u;
+
+std::string frame(std::size_t id) {
+    return std::string(id % 3, '*') + std::to_string(id);
+}
+}
+
+template <class Reader>
+struct integration_async_read : public testing::Test {
+    virtual void SetUp() override {
+        streams::fill<streams::mmap_writer>(file.filepath(), frames_per_keyframe, frame_count,
+                                            frame);
+    }
+
+protected:
+    temporary_file file;
+};
+
+using async_readers = testing::Types<async_reader<mmap_backend<file_mode_t::READ_ONLY>>,
+                                     async_reader<posix_file_backend<file_mode_t::READ_ONLY>>>;
+
+TYPED_TEST_CASE(integration_async_read, async_readers);
+
+TYPED_TEST(integration_async_read, concurrent_reads) {
+    const TypeParam stream{this->file.filepath()};
+    io_thread_pool pool{4};
+
+    std::vector<std::pair<std::size_t, std::future<std::string>>> keyframes;
+    std::vector<std::future<std::string>> frames;
+    for (auto i = 0u; i < frame_count; ++i) {
+        /* Scattered ids, so that the seeks do not follow each other */
+        const auto id = i * 7919 % frame_count;
+        frames.push_back(stream.async_read_frame(id, pool));
+        if (id % frames_per_keyframe == 0) {
+            keyframes.emplace_back(id, stream.async_read_keyframe(id / frames_per_keyframe, pool));
+        }
+    }
+
+    for (auto i = 0u; i < frame_count; ++i) {
+        EXPECT_EQ(frame(i * 7919 % frame_count), frames[i].get());
+    }
+    for (auto& keyframe : keyframes) {
+        EXPECT_EQ(frame(keyframe.first), keyframe.second.get());
+    }
+}
+
+TYPED_TEST(integration_async_read, out_of_range) {
+    const TypeParam stream{this->file.filepath()};
+    io_thread_pool pool{1};
+
+    EXPECT_THROW(stream.async_read_frame(frame_count, pool), std::out_of_range);
+    EXPECT_THROW(stream.async_read_keyframe(frame_count / frames_per_keyframe, pool),
+                 std::out_of_range);
+}
+
+TEST(io_thread_pool, exceptions) {
+    io_thread_pool pool{2};
+    auto failed = pool.submit([]() -> int { throw std::runtime_error{"failed"}; });
+    auto succeeded = pool.submit([] { return 42; });
+
+    EXPECT_THROW(failed.get(), std::runtime_error);
+    EXPECT_EQ(42, succeeded.get());
+}
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include "streams.h"
+#include "../common/temporary_file.h"
+
+namespace {
+using namespace protostream;
+
+template <class Backend, byte_order Order, checksum_mode Mode = checksum_mode::off>
+using ordered_stream = streams::string_stream<with_backend<Backend>,
+                                              with_cache<offsets_only_cache>,
+                                              with_byte_order<Order>,
+                                              with_checksums<Mode>>;
+
+template <byte_order Order, checksum_mode Mode = checksum_mode::off>
+using mmap_reader = ordered_stream<mmap_backend<file_mode_t::READ_ONLY>, Order, Mode>;
+
+template <byte_order Order, checksum_mode Mode = checksum_mode::off>
+using posix_reader = ordered_stream<posix_file_backend<file_mode_t::READ_ONLY>, Order, Mode>;
+
+constexpr auto frames_per_keyframe = 3;
+constexpr auto frame_count = 40;
+const std::string proto_header = "proto";
+
+/* Frames of varying lengths, so that the keyframes start at unaligned offsets */
+std::string frame(std::size_t id) {
+    return std::string(id % 7, '*') + "frame #" + std::to_string(id);
+}
+
+template <class Stream>
+std::size_t read_all(const Stream& stream) {
+    EXPECT_EQ(proto_header, stream.get_proto_header());
+    return streams::read_all(stream, frame);
+}
+}
+
+template <class Writer>
+struct integration_byte_order : public testing::Test {
+    virtual void SetUp() override {
+        streams::fill<Writer>(file.filepath(), frames_per_keyframe, frame_count, frame,
+                              proto_header);
+    }
+
+protected:
+    temporary_file file;
+};
+
+using native_writers =
+    testing::Types<ordered_stream<mmap_backend<file_mode_t::READ_APPEND>, byte_order::native>,
+                   ordered_stream<posix_file_backend<file_mode_t::READ_APPEND>,
+                                  byte_order::native,
+                                  checksum_mode::on_read>>;
+
+TYPED_TEST_CASE(integration_byte_order, native_writers);
+
+TYPED_TEST(integration_byte_order, read) {
+    EXPECT_EQ(frame_count, read_all(mmap_reader<byte_order::native>{this->file.filepath()}));
+    EXPECT_EQ(frame_count, read_all(posix_reader<byte_order::native>{this->file.filepath()}));
+    EXPECT_EQ(frame_count,
+              read_all(mmap_reader<byte_order::native, checksum_mode::eager>{
+                  this->file.filepath()}));
+}
+
+TYPED_TEST(integration_byte_order, seek) {
+    const auto stream = mmap_reader<byte_order::native>{this->file.filepath()};
+    for (auto kf = std::size_t{0}; kf * frames_per_keyframe < frame_count; ++kf) {
+        EXPECT_EQ(frame(kf * frames_per_keyframe), stream.begin()[kf].get());
+    }
+}
+
+TYPED_TEST(integration_byte_order, mismatch) {
+    if (detail::host_is_little_endian()) {
+        EXPECT_THROW(streams::mmap_reader{this->file.filepath()}, std::runtime_error);
+    }
+}
+
+TEST(integration_byte_order, big_endian_files) {
+    EXPECT_NO_THROW(posix_reader<byte_order::big>{"data/medium.data"});
+    if (detail::host_is_little_endian()) {
+        EXPECT_THROW(mmap_reader<byte_order::native>{"data/medium.data"}, std::runtime_error);
+    }
+}
+
+TEST(integration_byte_order, no_padding) {
+    using writer = mmap_backend<file_mode_t::READ_APPEND>;
+    temporary_file native;
+    temporary_file big;
+    streams::fill<ordered_stream<writer, byte_order::native>>(
+        native.filepath(), frames_per_keyframe, frame_count, frame, proto_header);
+    streams::fill<ordered_stream<writer, byte_order::big>>(big.filepath(), frames_per_keyframe,
+                                                           frame_count, frame, proto_header);
+    EXPECT_EQ(big.contents().size(), native.contents().size());
+}
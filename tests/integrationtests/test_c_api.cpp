@@ -0,0 +1,367 @@
+#include <gtest/gtest.h>
+
+#include "../../src/cprotostream.h"
+#include "../common/temporary_file.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace {
+constexpr auto frames_per_keyframe = 4u;
+constexpr auto frame_count = 30u;
+
+std::string frame(std::size_t id) {
+    return std::string(id % 7, '*') + std::to_string(id);
+}
+
+std::string contents(const void* ptr, std::size_t size) {
+    return {static_cast<const char*>(ptr), size};
+}
+
+/** Records the scanned frames, stopping after `limit` of them */
+struct scan_state {
+    std::vector<std::string> frames;
+    std::size_t limit = std::numeric_limits<std::size_t>::max();
+};
+
+int record_frame(uint64_t id, int is_keyframe, const void* data, size_t size, void* user) {
+    auto state = static_cast<scan_state*>(user);
+    EXPECT_EQ(id % frames_per_keyframe == 0, is_keyframe != 0);
+    EXPECT_EQ(frame(id), contents(data, size));
+    state->frames.push_back(contents(data, size));
+    return state->frames.size() == state->limit ? 7 : 0;
+}
+
+/** Fails on the frame whose id is passed as the user pointer */
+int fail_frame(uint64_t id, int, const void*, size_t, void* user) {
+    return id == *static_cast<uint64_t*>(user) ? -1 : 0;
+}
+
+/** Counts the scanned frames, checking their contents */
+int count_frame(uint64_t id, int, const void* data, size_t size, void* user) {
+    if (frame(id) != contents(data, size)) {
+        return 1;
+    }
+    ++*static_cast<std::atomic<std::size_t>*>(user);
+    return 0;
+}
+}
+
+struct integration_c_api : public testing::Test {
+    virtual void SetUp() override {
+        std::vector<std::string> data;
+        std::vector<const void*> frames;
+        std::vector<size_t> sizes;
+        for (auto i = 0u; i < frame_count; ++i) {
+            data.push_back(frame(i));
+        }
+        for (const auto& str : data) {
+            frames.push_back(str.data());
+            sizes.push_back(str.size());
+        }
+
+        HStream* stream = nullptr;
+        ASSERT_EQ(PROTOSTREAM_OK,
+                  protostream_try_open_new(file.filepath(), frames_per_keyframe, "", 0, &stream));
+        size_t appended = 0;
+        ASSERT_EQ(PROTOSTREAM_OK, protostream_append_batch(stream, frames.data(), sizes.data(),
+                                                           frames.size(), &appended));
+        EXPECT_EQ(frame_count, appended);
+        ASSERT_EQ(PROTOSTREAM_OK, protostream_try_close(stream));
+    }
+
+protected:
+    temporary_file file;
+};
+
+TEST_F(integration_c_api, batch_read) {
+    HStream* stream = nullptr;
+    ASSERT_EQ(PROTOSTREAM_OK, protostream_try_open_existing(file.filepath(), &stream));
+    EXPECT_EQ(frame_count, protostream_frame_count(stream));
+
+    HKeyframeIteratorStorage kf_storage;
+    auto keyframes = protostream_init_keyframe_iterator(stream, &kf_storage);
+
+    const void* ptrs[frames_per_keyframe];
+    size_t sizes[frames_per_keyframe];
+    auto id = std::size_t{0};
+    while (protostream_valid_keyframe_iterator(stream, keyframes)) {
+        const void* ptr;
+        size_t size;
+        protostream_get_keyframe(keyframes, &ptr, &size);
+        EXPECT_EQ(frame(id++), contents(ptr, size));
+
+        HDeltaIteratorStorage delta_storage;
+        auto deltas = protostream_init_delta_iterator(keyframes, &delta_storage);
+        const auto count =
+            protostream_get_deltas(keyframes, deltas, ptrs, sizes, frames_per_keyframe);
+        EXPECT_EQ(std::min<std::size_t>(frames_per_keyframe - 1, frame_count - id), count);
+        for (auto i = std::size_t{0}; i < count; ++i) {
+            EXPECT_EQ(frame(id++), contents(ptrs[i], sizes[i]));
+        }
+        EXPECT_FALSE(protostream_valid_delta_iterator(keyframes, deltas));
+
+        protostream_advance_keyframe_iterator(keyframes, 1);
+    }
+    EXPECT_EQ(frame_count, id);
+
+    keyframes = protostream_init_keyframe_iterator(stream, &kf_storage);
+    EXPECT_EQ(frames_per_keyframe,
+              protostream_get_keyframes(stream, keyframes, ptrs, sizes, frames_per_keyframe));
+    EXPECT_EQ(frame(frames_per_keyframe), contents(ptrs[1], sizes[1]));
+    EXPECT_EQ(4, protostream_get_keyframes(stream, keyframes, ptrs, sizes, frames_per_keyframe));
+    EXPECT_FALSE(protostream_valid_keyframe_iterator(stream, keyframes));
+
+    EXPECT_EQ(PROTOSTREAM_OK, protostream_try_close(stream));
+}
+
+TEST_F(integration_c_api, errors) {
+    HStream* stream = nullptr;
+    EXPECT_EQ(PROTOSTREAM_ERROR_SYSTEM,
+              protostream_try_open_existing("/nonexistent/protostream", &stream));
+    EXPECT_EQ(nullptr, stream);
+    EXPECT_NE(std::string{}, protostream_last_error());
+
+    temporary_file invalid{std::string(100, 'x')};
+    EXPECT_EQ(PROTOSTREAM_ERROR_INVALID_FILE,
+              protostream_try_open_existing(invalid.filepath(), &stream));
+    EXPECT_EQ(nullptr, stream);
+
+    ASSERT_EQ(PROTOSTREAM_OK, protostream_try_open_existing(file.filepath(), &stream));
+    const std::string large(70000, '*');
+    EXPECT_EQ(PROTOSTREAM_ERROR_INVALID_ARGUMENT,
+              protostream_try_append_delta(stream, large.data(), large.size()));
+
+    const void* frames[] = {large.data(), large.data()};
+    const size_t sizes[] = {large.size(), large.size()};
+    size_t appended = 0;
+    EXPECT_EQ(PROTOSTREAM_ERROR_INVALID_ARGUMENT,
+              protostream_append_batch(stream, frames, sizes, 2, &appended));
+    EXPECT_EQ(0, appended);
+    EXPECT_EQ(frame_count, protostream_frame_count(stream));
+
+    EXPECT_EQ(PROTOSTREAM_OK, protostream_try_close(stream));
+}
+
+TEST_F(integration_c_api, read_errors) {
+    HStream* stream = nullptr;
+    ASSERT_EQ(PROTOSTREAM_OK,
+              protostream_try_open_existing_ex(
+                  file.filepath(), PROTOSTREAM_OPEN_READ_ONLY | PROTOSTREAM_OPEN_PREAD, &stream));
+
+    const auto keyframe_count = protostream_keyframe_count(stream);
+    HKeyframeIteratorStorage kf_storage;
+    auto keyframes = protostream_init_keyframe_iterator(stream, &kf_storage);
+    protostream_advance_keyframe_iterator(keyframes, keyframe_count - 1);
+
+    const void* ptr;
+    size_t size;
+    ASSERT_EQ(PROTOSTREAM_OK, protostream_try_get_keyframe(keyframes, &ptr, &size));
+    protostream_free_frame(stream, ptr);
+
+    HDeltaIteratorStorage delta_storage;
+    auto deltas = protostream_init_delta_iterator(keyframes, &delta_storage);
+    ASSERT_EQ(PROTOSTREAM_OK, protostream_try_get_delta(deltas, &ptr, &size));
+    protostream_free_frame(stream, ptr);
+
+    struct stat st;
+    ASSERT_EQ(0, stat(file.filepath(), &st));
+    ASSERT_EQ(0, truncate(file.filepath(), st.st_size / 2));
+
+    /* The frames of the second half of the file cannot be read anymore */
+    ptr = nullptr;
+    EXPECT_NE(PROTOSTREAM_OK, protostream_try_get_delta(deltas, &ptr, &size));
+    EXPECT_EQ(nullptr, ptr);
+    EXPECT_NE(std::string{}, protostream_last_error());
+
+    std::vector<const void*> ptrs(keyframe_count);
+    std::vector<size_t> sizes(keyframe_count);
+    size_t retrieved = 42;
+    EXPECT_NE(PROTOSTREAM_OK, protostream_try_get_deltas(keyframes, deltas, ptrs.data(),
+                                                         sizes.data(), keyframe_count, &retrieved));
+    EXPECT_EQ(0, retrieved);
+
+    /* The keyframes preceding the first unreadable one are retrieved */
+    keyframes = protostream_init_keyframe_iterator(stream, &kf_storage);
+    EXPECT_NE(PROTOSTREAM_OK, protostream_try_get_keyframes(stream, keyframes, ptrs.data(),
+                                                            sizes.data(), keyframe_count,
+                                                            &retrieved));
+    ASSERT_GT(retrieved, 0);
+    ASSERT_LT(retrieved, keyframe_count);
+    for (auto i = std::size_t{0}; i < retrieved; ++i) {
+        EXPECT_EQ(frame(i * frames_per_keyframe), contents(ptrs[i], sizes[i]));
+        protostream_free_frame(stream, ptrs[i]);
+    }
+
+    EXPECT_EQ(PROTOSTREAM_OK, protostream_try_close(stream));
+}
+
+TEST_F(integration_c_api, oversized_delta) {
+    HStream* stream = nullptr;
+    ASSERT_EQ(PROTOSTREAM_OK, protostream_try_open_existing(file.filepath(), &stream));
+
+    const std::string large(70000, '*');
+    EXPECT_DEATH(protostream_append_delta(stream, large.data(), large.size()), "");
+    EXPECT_EQ(frame_count, protostream_frame_count(stream));
+
+    EXPECT_EQ(PROTOSTREAM_OK, protostream_try_close(stream));
+}
+
+struct integration_c_api_flags : public integration_c_api,
+                                 public testing::WithParamInterface<uint32_t> {};
+
+TEST_P(integration_c_api_flags, read) {
+    HStream* stream = nullptr;
+    ASSERT_EQ(PROTOSTREAM_OK,
+              protostream_try_open_existing_ex(file.filepath(), GetParam(), &stream));
+    EXPECT_EQ(frame_count, protostream_frame_count(stream));
+
+    auto keyframes = protostream_iter_keyframes(stream);
+    protostream_advance_keyframe_iterator(keyframes, 5);
+
+    const void* ptr;
+    size_t size;
+    protostream_get_keyframe(keyframes, &ptr, &size);
+    EXPECT_EQ(frame(5 * frames_per_keyframe), contents(ptr, size));
+    protostream_free_frame(stream, ptr);
+
+    HDeltaIteratorStorage storage;
+    auto deltas = protostream_init_delta_iterator(keyframes, &storage);
+    protostream_advance_delta_iterator(deltas);
+    protostream_get_delta(deltas, &ptr, &size);
+    EXPECT_EQ(frame(5 * frames_per_keyframe + 2), contents(ptr, size));
+    protostream_free_frame(stream, ptr);
+    protostream_free_keyframe_iterator(keyframes);
+
+    if (GetParam() & PROTOSTREAM_OPEN_READ_ONLY) {
+        EXPECT_EQ(PROTOSTREAM_ERROR_INVALID_ARGUMENT,
+                  protostream_try_append_delta(stream, "x", 1));
+    } else {
+        EXPECT_EQ(PROTOSTREAM_OK, protostream_try_append_delta(stream, "x", 1));
+        EXPECT_EQ(frame_count + 1, protostream_frame_count(stream));
+    }
+
+    EXPECT_EQ(PROTOSTREAM_OK, protostream_try_close(stream));
+}
+
+INSTANTIATE_TEST_CASE_P(all,
+                        integration_c_api_flags,
+                        testing::Values(0,
+                                        PROTOSTREAM_OPEN_READ_ONLY,
+                                        PROTOSTREAM_OPEN_PREAD,
+                                        PROTOSTREAM_OPEN_READ_ONLY | PROTOSTREAM_OPEN_PREAD,
+                                        PROTOSTREAM_OPEN_READ_ONLY | PROTOSTREAM_OPEN_FULL_CACHE,
+                                        PROTOSTREAM_OPEN_READ_ONLY | PROTOSTREAM_OPEN_PREAD |
+                                            PROTOSTREAM_OPEN_SHARED_CACHE,
+                                        PROTOSTREAM_OPEN_PREAD | PROTOSTREAM_OPEN_STATS));
+
+TEST_F(integration_c_api, invalid_flags) {
+    HStream* stream = nullptr;
+    EXPECT_EQ(PROTOSTREAM_ERROR_INVALID_ARGUMENT,
+              protostream_try_open_existing_ex(
+                  file.filepath(), PROTOSTREAM_OPEN_FULL_CACHE | PROTOSTREAM_OPEN_SHARED_CACHE,
+                  &stream));
+    EXPECT_EQ(PROTOSTREAM_ERROR_INVALID_ARGUMENT,
+              protostream_try_open_existing_ex(file.filepath(), 1u << 31, &stream));
+    EXPECT_EQ(nullptr, stream);
+}
+
+TEST_F(integration_c_api, stats) {
+    for (auto flags : {0u, unsigned{PROTOSTREAM_OPEN_STATS}}) {
+        HStream* stream = nullptr;
+        ASSERT_EQ(PROTOSTREAM_OK,
+                  protostream_try_open_existing_ex(
+                      file.filepath(), PROTOSTREAM_OPEN_PREAD | flags, &stream));
+
+        scan_state all;
+        EXPECT_EQ(0, protostream_scan(stream, 0, frame_count, record_frame, &all));
+
+        StreamStats stats;
+        protostream_get_stats(stream, &stats);
+        if (flags & PROTOSTREAM_OPEN_STATS) {
+            EXPECT_LT(0u, stats.reads);
+            EXPECT_LT(0u, stats.bytes_allocated);
+        } else {
+            EXPECT_EQ(0u, stats.reads);
+            EXPECT_EQ(0u, stats.bytes_allocated);
+        }
+
+        EXPECT_EQ(PROTOSTREAM_OK, protostream_try_close(stream));
+    }
+}
+
+TEST_F(integration_c_api, read_only_append) {
+    HStream* stream = nullptr;
+    ASSERT_EQ(PROTOSTREAM_OK,
+              protostream_try_open_existing_ex(
+                  file.filepath(), PROTOSTREAM_OPEN_READ_ONLY, &stream));
+
+    EXPECT_EQ(PROTOSTREAM_ERROR_INVALID_ARGUMENT,
+              protostream_try_append_keyframe(stream, "x", 1));
+    EXPECT_NE(std::string{}, protostream_last_error());
+    EXPECT_EQ(PROTOSTREAM_ERROR_INVALID_ARGUMENT, protostream_try_append_delta(stream, "x", 1));
+    EXPECT_EQ(frame_count, protostream_frame_count(stream));
+
+    EXPECT_EQ(PROTOSTREAM_OK, protostream_try_close(stream));
+}
+
+TEST_F(integration_c_api, scan) {
+    HStream* stream = nullptr;
+    ASSERT_EQ(PROTOSTREAM_OK,
+              protostream_try_open_existing_ex(
+                  file.filepath(), PROTOSTREAM_OPEN_READ_ONLY, &stream));
+
+    scan_state all;
+    EXPECT_EQ(0, protostream_scan(stream, 0, frame_count, record_frame, &all));
+    EXPECT_EQ(frame_count, all.frames.size());
+
+    for (auto first = 0u; first <= frames_per_keyframe + 1; ++first) {
+        scan_state range;
+        EXPECT_EQ(0, protostream_scan(stream, first, 2 * frames_per_keyframe + 3, record_frame,
+                                      &range));
+        ASSERT_EQ(2 * frames_per_keyframe + 3 - first, range.frames.size());
+        EXPECT_EQ(frame(first), range.frames.front());
+    }
+
+    scan_state stopped;
+    stopped.limit = 5;
+    EXPECT_EQ(7, protostream_scan(stream, 3, frame_count, record_frame, &stopped));
+    EXPECT_EQ(5, stopped.frames.size());
+
+    /* Negative values are errors, not stop values */
+    auto failing = uint64_t{10};
+    EXPECT_EQ(PROTOSTREAM_ERROR_CALLBACK,
+              protostream_scan(stream, 0, frame_count, fail_frame, &failing));
+    EXPECT_NE(std::string{}, protostream_last_error());
+
+    EXPECT_EQ(PROTOSTREAM_ERROR_INVALID_ARGUMENT,
+              protostream_scan(stream, 0, frame_count + 1, record_frame, &all));
+    EXPECT_EQ(PROTOSTREAM_ERROR_INVALID_ARGUMENT,
+              protostream_scan(stream, 2, 1, record_frame, &all));
+
+    EXPECT_EQ(PROTOSTREAM_OK, protostream_try_close(stream));
+}
+
+TEST_P(integration_c_api_flags, scan_parallel) {
+    HStream* stream = nullptr;
+    ASSERT_EQ(PROTOSTREAM_OK,
+              protostream_try_open_existing_ex(file.filepath(), GetParam(), &stream));
+
+    for (auto threads : {0u, 1u, 3u}) {
+        std::atomic<std::size_t> count{0};
+        EXPECT_EQ(0, protostream_scan_parallel(stream, 1, frame_count, count_frame, &count,
+                                               threads));
+        EXPECT_EQ(frame_count - 1, count);
+
+        auto failing = uint64_t{frame_count / 2};
+        EXPECT_EQ(PROTOSTREAM_ERROR_CALLBACK,
+                  protostream_scan_parallel(stream, 1, frame_count, fail_frame, &failing, threads));
+    }
+
+    EXPECT_EQ(PROTOSTREAM_OK, protostream_try_close(stream));
+}
@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+
+#include "streams.h"
+#include "../common/file_operations.h"
+#include "../common/temporary_file.h"
+
+namespace {
+using namespace protostream;
+
+template <checksum_mode Mode, class Backend = mmap_backend<file_mode_t::READ_ONLY>>
+using checked_stream = streams::string_stream<with_backend<Backend>,
+                                              with_cache<offsets_only_cache>,
+                                              with_checksums<Mode>>;
+
+constexpr auto frames_per_keyframe = 4;
+constexpr auto frame_count = 50;
+
+std::string frame(std::size_t id) {
+    return "frame #" + std::to_string(id);
+}
+
+/** Overwrites the first occurrence of `what` in the file */
+void corrupt(const temporary_file& file, const std::string& what) {
+    auto contents = file.contents();
+    const auto pos = contents.find(what);
+    ASSERT_NE(std::string::npos, pos);
+    contents[pos] ^= 1;
+
+    auto backend = posix_file_backend<file_mode_t::READ_APPEND>{file.filepath()};
+    backend.write(pos, 1, reinterpret_cast<const std::uint8_t*>(&contents[pos]));
+}
+}
+
+template <class Writer>
+struct integration_checksums : public testing::Test {
+    virtual void SetUp() override {
+        streams::fill<Writer>(file.filepath(), frames_per_keyframe, frame_count, frame);
+    }
+
+protected:
+    temporary_file file;
+};
+
+using writers =
+    testing::Types<checked_stream<checksum_mode::on_read, mmap_backend<file_mode_t::READ_APPEND>>,
+                   checked_stream<checksum_mode::eager,
+                                  posix_file_backend<file_mode_t::READ_APPEND>>>;
+
+TYPED_TEST_CASE(integration_checksums, writers);
+
+TYPED_TEST(integration_checksums, read) {
+    const auto path = this->file.filepath();
+    EXPECT_EQ(frame_count, streams::read_all(checked_stream<checksum_mode::off>{path}, frame));
+    EXPECT_EQ(frame_count, streams::read_all(checked_stream<checksum_mode::on_read>{path}, frame));
+    EXPECT_EQ(frame_count, streams::read_all(checked_stream<checksum_mode::eager>{path}, frame));
+    EXPECT_EQ(frame_count, streams::read_all(streams::stream_reader{path}, frame));
+}
+
+TYPED_TEST(integration_checksums, corrupted_keyframe) {
+    corrupt(this->file, frame(8));
+
+    EXPECT_THROW(checked_stream<checksum_mode::eager>{this->file.filepath()}, std::runtime_error);
+
+    const auto stream = checked_stream<checksum_mode::on_read>{this->file.filepath()};
+    EXPECT_EQ(frame(4), stream.begin()[1].get());
+    EXPECT_THROW(stream.begin()[2].get(), std::runtime_error);
+}
+
+TYPED_TEST(integration_checksums, corrupted_delta) {
+    corrupt(this->file, frame(9));
+
+    EXPECT_THROW(checked_stream<checksum_mode::eager>{this->file.filepath()}, std::runtime_error);
+
+    const auto stream = checked_stream<checksum_mode::on_read>{this->file.filepath()};
+    const auto keyframe = stream.begin()[2];
+    EXPECT_EQ(frame(8), keyframe.get());
+    EXPECT_THROW(keyframe.begin()->get(), std::runtime_error);
+}
+
+TEST(integration_checksums, eager_without_checksums) {
+    using simple_tests_file = checked_stream<checksum_mode::eager>;
+    EXPECT_NO_THROW(simple_tests_file{"data/medium.data"});
+}
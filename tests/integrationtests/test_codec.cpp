@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+
+#include "streams.h"
+#include "../common/temporary_file.h"
+
+#include <iterator>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+namespace {
+using namespace protostream;
+
+template <class Backend, template <class> class Cache>
+using compressed_stream =
+    streams::string_stream<with_backend<Backend>, with_cache<Cache>, with_codec<lz_codec>>;
+
+constexpr auto frames_per_keyframe = 5;
+constexpr auto frame_count = 203;
+
+std::string frame(std::size_t id) {
+    /* Make every other frame highly compressible */
+    if (id % 2) {
+        return std::string(1000 + id, 'a' + id % 26);
+    } else {
+        return std::to_string(id);
+    }
+}
+}
+
+template <class Writer>
+struct integration_codec : public testing::Test {
+    virtual void SetUp() override {
+        streams::fill<Writer>(file.filepath(), frames_per_keyframe, frame_count, frame, "header");
+    }
+
+    template <class Reader>
+    void check() {
+        const auto stream = Reader{file.filepath()};
+        EXPECT_EQ("header", stream.get_proto_header());
+        EXPECT_EQ(frame_count, streams::read_all(stream, frame));
+    }
+
+protected:
+    temporary_file file;
+};
+
+using writers =
+    testing::Types<compressed_stream<mmap_backend<file_mode_t::READ_APPEND>, offsets_only_cache>,
+                   compressed_stream<posix_file_backend<file_mode_t::READ_APPEND>, full_cache>>;
+
+TYPED_TEST_CASE(integration_codec, writers);
+
+TYPED_TEST(integration_codec, read_mmap) {
+    this->template check<
+        compressed_stream<mmap_backend<file_mode_t::READ_ONLY>, offsets_only_cache>>();
+}
+
+TYPED_TEST(integration_codec, read_posix) {
+    this->template check<
+        compressed_stream<posix_file_backend<file_mode_t::READ_ONLY>, full_cache>>();
+}
+
+TYPED_TEST(integration_codec, compressed_size) {
+    auto raw_size = std::size_t{0};
+    for (auto i = 0; i < frame_count; ++i) {
+        raw_size += frame(i).size();
+    }
+
+    EXPECT_GT(raw_size / 4, this->file.size());
+}
+
+TYPED_TEST(integration_codec, incompressible_delta_limit) {
+    /* Random bytes do not compress, so they are stored after the method tag */
+    std::mt19937 random;
+    std::string data(std::numeric_limits<delta_size_t>::max(), '\0');
+    for (auto& c : data) {
+        c = static_cast<char>(random());
+    }
+    const auto ptr = reinterpret_cast<const std::uint8_t*>(data.data());
+
+    auto stream = TypeParam{this->file.filepath()};
+    const auto count = stream.frame_count();
+    EXPECT_THROW(stream.append_delta(ptr, data.size()), std::length_error);
+    EXPECT_EQ(count, stream.frame_count());
+
+    stream.append_delta(ptr, data.size() - 1);
+    const auto keyframe = stream.begin()[count / frames_per_keyframe];
+    auto delta = keyframe.begin();
+    std::advance(delta, count % frames_per_keyframe - 1);
+    EXPECT_EQ(data.substr(0, data.size() - 1), delta->get());
+}
+
+TYPED_TEST(integration_codec, open_without_codec) {
+    EXPECT_THROW(streams::mmap_reader{this->file.filepath()}, std::runtime_error);
+}
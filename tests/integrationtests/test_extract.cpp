@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+
+#include "streams.h"
+#include "../common/temporary_file.h"
+
+#include <stdexcept>
+#include <string>
+
+namespace {
+using namespace protostream;
+
+template <class Backend, byte_order Order>
+using checked_stream = streams::string_stream<with_backend<Backend>,
+                                              with_cache<offsets_only_cache>,
+                                              with_byte_order<Order>,
+                                              with_checksums<checksum_mode::eager>>;
+
+constexpr auto frames_per_keyframe = 3u;
+constexpr auto frame_count = 100u;
+const std::string proto_header = "proto";
+
+/* Frames of varying lengths, so that native keyframes need padding */
+std::string frame(std::size_t id) {
+    return std::string(id % 7, '*') + "frame #" + std::to_string(id);
+}
+
+/** Checks that the stream holds the frames of keyframes `first` to `last`
+ * (both included) */
+template <class Stream>
+void expect_frames(const Stream& stream, std::size_t first, std::size_t last) {
+    EXPECT_EQ(proto_header, stream.get_proto_header());
+    ASSERT_EQ(last + 1 - first, stream.keyframe_count());
+
+    const auto count = streams::read_all(stream, frame, first * frames_per_keyframe);
+    EXPECT_EQ(std::min<std::size_t>((last + 1) * frames_per_keyframe, frame_count),
+              first * frames_per_keyframe + count);
+    EXPECT_EQ(count, stream.frame_count());
+
+    /* Follow the skiplists from the beginning */
+    for (auto kf = std::size_t{0}; kf < stream.keyframe_count(); kf += 5) {
+        EXPECT_EQ(frame((first + kf) * frames_per_keyframe), stream.begin()[kf].get());
+    }
+}
+}
+
+template <class Order>
+struct integration_extract : public testing::Test {
+    using writer = checked_stream<posix_file_backend<file_mode_t::READ_APPEND>, Order::value>;
+    using reader = checked_stream<mmap_backend<file_mode_t::READ_ONLY>, Order::value>;
+
+    virtual void SetUp() override {
+        streams::fill<writer>(source_file.filepath(), frames_per_keyframe, frame_count, frame,
+                              proto_header);
+    }
+
+protected:
+    temporary_file source_file;
+    temporary_file file;
+};
+
+using orders = testing::Types<std::integral_constant<byte_order, byte_order::big>,
+                              std::integral_constant<byte_order, byte_order::native>>;
+
+TYPED_TEST_CASE(integration_extract, orders);
+
+TYPED_TEST(integration_extract, middle) {
+    {
+        const typename TestFixture::reader source{this->source_file.filepath()};
+        source.extract(5, 23, this->file.filepath());
+    }
+
+    /* The checksums and the keyframe chain are verified on open */
+    expect_frames(typename TestFixture::reader{this->file.filepath()}, 5, 23);
+}
+
+TYPED_TEST(integration_extract, tail) {
+    {
+        const typename TestFixture::reader source{this->source_file.filepath()};
+        source.extract(30, source.keyframe_count() - 1, this->file.filepath());
+    }
+
+    expect_frames(typename TestFixture::reader{this->file.filepath()}, 30,
+                  (frame_count + frames_per_keyframe - 1) / frames_per_keyframe - 1);
+}
+
+TYPED_TEST(integration_extract, append_after) {
+    {
+        const typename TestFixture::reader source{this->source_file.filepath()};
+        source.extract(0, 19, this->file.filepath());
+    }
+
+    {
+        typename TestFixture::writer stream{this->file.filepath()};
+        streams::append_frames(stream, 5 * frames_per_keyframe, frame);
+    }
+
+    expect_frames(typename TestFixture::reader{this->file.filepath()}, 0, 24);
+}
+
+TYPED_TEST(integration_extract, single_keyframe) {
+    {
+        const typename TestFixture::reader source{this->source_file.filepath()};
+        source.extract(7, 7, this->file.filepath());
+    }
+
+    expect_frames(typename TestFixture::reader{this->file.filepath()}, 7, 7);
+}
+
+TYPED_TEST(integration_extract, invalid_range) {
+    const typename TestFixture::reader source{this->source_file.filepath()};
+    EXPECT_THROW(source.extract(5, 4, this->file.filepath()), std::out_of_range);
+    EXPECT_THROW(source.extract(0, source.keyframe_count(), this->file.filepath()),
+                 std::out_of_range);
+}
+
+TYPED_TEST(integration_extract, destination_not_empty) {
+    const typename TestFixture::reader source{this->source_file.filepath()};
+    EXPECT_THROW(source.extract(0, 1, this->source_file.filepath()), std::runtime_error);
+}
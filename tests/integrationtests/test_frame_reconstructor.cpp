@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+
+#include "frame_reconstructor.h"
+#include "simple_tests.h"
+#include "streams.h"
+#include "type_list.h"
+
+#include <numeric>
+#include <random>
+
+namespace {
+/** Appends the delta to the state, so that the state of a frame lists all the
+ * frames it was reconstructed from */
+struct append_delta {
+    std::size_t* applications;
+
+    void operator()(std::string& state, const std::string& delta) const {
+        ++*applications;
+        state += "," + delta;
+    }
+};
+}
+
+template <class Param>
+struct integration_frame_reconstructor : public testing::Test {
+    virtual void SetUp() override {
+        stream = std::make_unique<typename Param::stream>(Param::test::file);
+    }
+
+protected:
+    std::unique_ptr<typename Param::stream> stream;
+    std::size_t applications = 0;
+
+    auto reconstructor(std::size_t interval, std::size_t budget) {
+        return protostream::make_frame_reconstructor(*stream, append_delta{&applications},
+                                                     interval, budget);
+    }
+
+    static std::string expected(std::size_t frame) {
+        const auto group_start = frame - frame % Param::test::frames_per_keyframe;
+        auto result = Param::test::frame(group_start);
+        for (auto idx = group_start + 1; idx <= frame; ++idx) {
+            result += "," + Param::test::frame(idx);
+        }
+        return result;
+    }
+};
+
+using pairs = type_list::product<streams::read_streams, simple_tests::tests>::type<testing::Types>;
+
+TYPED_TEST_CASE(integration_frame_reconstructor, pairs);
+
+TYPED_TEST(integration_frame_reconstructor, sequential) {
+    auto reconstructor = this->reconstructor(3, 1 << 20);
+
+    for (auto frame = std::size_t{0}; frame < TypeParam::test::frame_count; ++frame) {
+        EXPECT_EQ(this->expected(frame), reconstructor.get(frame));
+    }
+
+    EXPECT_EQ(TypeParam::test::frame_count - TypeParam::test::keyframe_count,
+              this->applications);
+}
+
+TYPED_TEST(integration_frame_reconstructor, randomised) {
+    auto reconstructor = this->reconstructor(2, 1 << 20);
+
+    auto frames = std::vector<std::size_t>(TypeParam::test::frame_count, 0);
+    std::iota(std::begin(frames), std::end(frames), 0);
+    std::shuffle(std::begin(frames), std::end(frames), std::mt19937_64{0x4242deadbeef4242llu});
+    for (auto frame : frames) {
+        EXPECT_EQ(this->expected(frame), reconstructor.get(frame));
+    }
+}
+
+TYPED_TEST(integration_frame_reconstructor, scrubbing) {
+    constexpr auto interval = 2;
+    auto reconstructor = this->reconstructor(interval, 1 << 20);
+    const auto last = TypeParam::test::frame_count - 1;
+
+    reconstructor.get(last);
+    this->applications = 0;
+
+    for (auto iter = 0; iter < 10; ++iter) {
+        EXPECT_EQ(this->expected(last - 1), reconstructor.get(last - 1));
+        EXPECT_EQ(this->expected(last), reconstructor.get(last));
+    }
+
+    EXPECT_LE(this->applications, 20u * (interval - 1) + 10u);
+}
+
+TYPED_TEST(integration_frame_reconstructor, forward_jump) {
+    constexpr auto interval = 2;
+    auto reconstructor = this->reconstructor(interval, 1 << 20);
+    const auto last = TypeParam::test::frames_per_keyframe - 1;
+
+    /* Caches the checkpoints of the first group, then rewinds to its second frame */
+    reconstructor.get(last);
+    reconstructor.get(1);
+    this->applications = 0;
+
+    EXPECT_EQ(this->expected(last), reconstructor.get(last));
+    EXPECT_LE(this->applications, interval - 1u);
+}
+
+TYPED_TEST(integration_frame_reconstructor, memory_budget) {
+    constexpr auto budget = 4 * sizeof(std::string);
+    auto reconstructor = this->reconstructor(1, budget);
+
+    for (auto frame = std::size_t{0}; frame < TypeParam::test::frame_count; ++frame) {
+        EXPECT_EQ(this->expected(frame), reconstructor.get(frame));
+        EXPECT_LE(reconstructor.memory_usage(), budget);
+    }
+
+    reconstructor.clear();
+    EXPECT_EQ(0u, reconstructor.memory_usage());
+    EXPECT_EQ(this->expected(0), reconstructor.get(0));
+}
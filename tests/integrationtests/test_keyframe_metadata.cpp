@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include "streams.h"
+#include "../common/temporary_file.h"
+
+namespace {
+using namespace protostream;
+
+struct timestamp : public detail::with_offset<std::uint64_t, 0> {};
+
+template <class Backend, template <class> class Cache>
+using timestamped_stream = streams::string_stream<with_backend<Backend>,
+                                                  with_cache<Cache>,
+                                                  with_keyframe_metadata<timestamp>>;
+
+constexpr auto frames_per_keyframe = 3;
+constexpr auto keyframe_count = 1000;
+
+std::uint64_t time_of(std::size_t keyframe) {
+    return 1000 + 10 * keyframe;
+}
+}
+
+template <class Param>
+struct integration_keyframe_metadata : public testing::Test {
+    using writer = timestamped_stream<mmap_backend<file_mode_t::READ_APPEND>, offsets_only_cache>;
+
+    virtual void SetUp() override {
+        writer stream{file.filepath(), frames_per_keyframe, "", 0};
+
+        for (auto i = 0; i < keyframe_count * frames_per_keyframe; ++i) {
+            const auto data = std::to_string(i);
+            const auto ptr = reinterpret_cast<const std::uint8_t*>(data.c_str());
+            if (i % frames_per_keyframe == 0) {
+                stream.append_keyframe(ptr, data.length(), time_of(i / frames_per_keyframe));
+            } else {
+                stream.append_delta(ptr, data.length());
+            }
+        }
+    }
+
+protected:
+    temporary_file file;
+};
+
+using metadata_streams =
+    testing::Types<timestamped_stream<mmap_backend<file_mode_t::READ_ONLY>, offsets_only_cache>,
+                   timestamped_stream<posix_file_backend<file_mode_t::READ_ONLY>, full_cache>>;
+
+TYPED_TEST_CASE(integration_keyframe_metadata, metadata_streams);
+
+TYPED_TEST(integration_keyframe_metadata, read) {
+    const auto stream = TypeParam{this->file.filepath()};
+    auto idx = std::size_t{0};
+    for (const auto& keyframe : stream) {
+        EXPECT_EQ(time_of(idx), keyframe.metadata());
+        EXPECT_EQ(std::to_string(idx * frames_per_keyframe), keyframe.get());
+        ++idx;
+    }
+    EXPECT_EQ(keyframe_count, idx);
+}
+
+TYPED_TEST(integration_keyframe_metadata, lower_bound) {
+    const auto stream = TypeParam{this->file.filepath()};
+
+    EXPECT_EQ(stream.begin(), stream.lower_bound_by_metadata(0));
+    EXPECT_EQ(stream.end(), stream.lower_bound_by_metadata(time_of(keyframe_count)));
+
+    for (auto idx = std::size_t{0}; idx < keyframe_count; idx += 7) {
+        EXPECT_EQ(idx, stream.lower_bound_by_metadata(time_of(idx))->id());
+        EXPECT_EQ(idx + 1, stream.lower_bound_by_metadata(time_of(idx) + 1)->id());
+    }
+}
+
+TYPED_TEST(integration_keyframe_metadata, open_without_metadata) {
+    EXPECT_THROW(streams::mmap_reader{this->file.filepath()}, std::runtime_error);
+}
@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+
+#include "prefetching_range.h"
+#include "streams.h"
+#include "../common/temporary_file.h"
+
+#include <string>
+
+namespace {
+using namespace protostream;
+
+constexpr auto frames_per_keyframe = 4u;
+constexpr auto frame_count = 1001u;
+
+std::string frame(std::size_t id) {
+    return std::string(id % 5 * 1000, '*') + std::to_string(id);
+}
+}
+
+template <class Reader>
+struct integration_prefetching_range : public testing::Test {
+    virtual void SetUp() override {
+        streams::fill<streams::mmap_writer>(file.filepath(), frames_per_keyframe, frame_count,
+                                            frame);
+    }
+
+protected:
+    temporary_file file;
+};
+
+using readers = testing::Types<streams::mmap_reader, streams::stream_reader>;
+
+TYPED_TEST_CASE(integration_prefetching_range, readers);
+
+TYPED_TEST(integration_prefetching_range, sequential) {
+    const TypeParam stream{this->file.filepath()};
+
+    for (auto depth : {1u, 3u, 64u}) {
+        prefetching_range<TypeParam> range{stream, depth};
+
+        auto id = std::size_t{0};
+        auto keyframe_id = keyframe_id_t{0};
+        for (const auto& block : range) {
+            EXPECT_EQ(keyframe_id++, block.id);
+            EXPECT_EQ(frame(id++), block.keyframe);
+            for (const auto& delta : block.deltas) {
+                EXPECT_EQ(frame(id++), delta);
+            }
+        }
+        EXPECT_EQ(frame_count, id);
+    }
+}
+
+TYPED_TEST(integration_prefetching_range, from_keyframe) {
+    const TypeParam stream{this->file.filepath()};
+    prefetching_range<TypeParam> range{stream, 2, 100};
+
+    auto it = range.begin();
+    ASSERT_NE(range.end(), it);
+    EXPECT_EQ(100, it->id);
+    EXPECT_EQ(frame(100 * frames_per_keyframe), it->keyframe);
+    ++it;
+    EXPECT_EQ(101, it->id);
+
+    /* The range is destroyed before the helper thread reaches the end */
+}
+
+TYPED_TEST(integration_prefetching_range, empty) {
+    const TypeParam stream{this->file.filepath()};
+    prefetching_range<TypeParam> range{stream, 2, stream.keyframe_count()};
+    EXPECT_EQ(range.end(), range.begin());
+}
@@ -96,4 +96,41 @@ TYPED_TEST(integration_read_simple, deltas) {
             cnt++;
         }
     }
-}
\ No newline at end of file
+}
+
+TYPED_TEST(integration_read_simple, keyframes_random_access) {
+    const auto begin = this->stream->begin();
+    const auto end = this->stream->end();
+    const auto count = static_cast<std::ptrdiff_t>(TypeParam::test::keyframe_count);
+
+    EXPECT_EQ(count, end - begin);
+    EXPECT_EQ(end, begin + count);
+    EXPECT_EQ(begin, end - count);
+    EXPECT_TRUE(begin < end);
+    EXPECT_TRUE(end >= begin);
+
+    for (auto idx = count - 1; idx >= 0; --idx) {
+        const auto expected = TypeParam::test::frame(idx * TypeParam::test::frames_per_keyframe);
+        EXPECT_EQ(expected, begin[idx].get());
+        EXPECT_EQ(expected, (end - (count - idx))->get());
+        EXPECT_EQ(idx, (end - (count - idx))->id());
+    }
+
+    auto it = end;
+    --it;
+    EXPECT_EQ(count - 1, it->id());
+    it -= count - 1;
+    EXPECT_EQ(begin, it);
+}
+
+TYPED_TEST(integration_read_simple, keyframes_bisect) {
+    for (auto frame = std::size_t{0}; frame < TypeParam::test::frame_count; ++frame) {
+        const auto it = std::partition_point(
+            this->stream->begin(), this->stream->end(), [frame](const auto& keyframe) {
+                return std::stoul(keyframe.get()) <= std::stoul(TypeParam::test::frame(frame));
+            });
+
+        ASSERT_NE(this->stream->begin(), it);
+        EXPECT_EQ(frame / TypeParam::test::frames_per_keyframe, std::prev(it)->id());
+    }
+}
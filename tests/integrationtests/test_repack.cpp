@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+
+#include "repack.h"
+#include "streams.h"
+#include "../common/temporary_file.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+/* The state of frame i is the number i * i; a delta holds the difference */
+std::string state_of(int frame) {
+    return std::to_string(frame * frame);
+}
+
+void apply(std::string& state, const std::string& delta) {
+    state = std::to_string(std::stoi(state) + std::stoi(delta));
+}
+
+std::vector<std::uint8_t> payload(const std::string& value) {
+    return {value.begin(), value.end()};
+}
+
+std::vector<std::uint8_t> encode_keyframe(const std::string& state) {
+    return payload(state);
+}
+
+std::vector<std::uint8_t> encode_delta(const std::string& from, const std::string& to) {
+    return payload(std::to_string(std::stoi(to) - std::stoi(from)));
+}
+
+constexpr auto frames_per_keyframe = 4;
+constexpr auto frame_count = 50;
+
+/** Keyframes hold the state, deltas the difference from the previous one */
+std::string frame(std::size_t id) {
+    const auto n = static_cast<int>(id);
+    return id % frames_per_keyframe == 0 ? state_of(n) : std::to_string(n * n - (n - 1) * (n - 1));
+}
+}
+
+struct integration_repack : public testing::TestWithParam<std::uint32_t> {
+    virtual void SetUp() override {
+        streams::fill<streams::stream_writer>(source_file.filepath(), frames_per_keyframe,
+                                              frame_count, frame, "proto");
+    }
+
+protected:
+    temporary_file source_file;
+    temporary_file destination_file;
+};
+
+TEST_P(integration_repack, frames_preserved) {
+    const auto interval = GetParam();
+    {
+        const streams::mmap_reader source{source_file.filepath()};
+        streams::mmap_writer destination{destination_file.filepath(), interval, "proto", 5};
+        protostream::repack(source, destination, apply, encode_keyframe, encode_delta, 3);
+    }
+
+    const streams::stream_reader stream{destination_file.filepath()};
+    ASSERT_EQ(frame_count, stream.frame_count());
+    ASSERT_EQ((frame_count + interval - 1) / interval, stream.keyframe_count());
+    EXPECT_EQ("proto", stream.get_proto_header());
+
+    auto frame = 0;
+    for (const auto& keyframe : stream) {
+        auto state = keyframe.get();
+        EXPECT_EQ(state_of(frame), state);
+        ++frame;
+
+        for (const auto& delta : keyframe) {
+            apply(state, delta.get());
+            EXPECT_EQ(state_of(frame), state);
+            ++frame;
+        }
+    }
+    EXPECT_EQ(frame_count, frame);
+
+    /* The skiplists are rebuilt */
+    const auto last = stream.keyframe_count() - 1;
+    EXPECT_EQ(state_of(last * interval), stream.begin()[last].get());
+}
+
+INSTANTIATE_TEST_CASE_P(intervals, integration_repack, testing::Values(1, 3, 4, 6, 8, 64));
+
+TEST_F(integration_repack, callback_error) {
+    const streams::mmap_reader source{source_file.filepath()};
+    streams::mmap_writer destination{destination_file.filepath(), 3, "", 0};
+
+    const auto failing = [](std::string&, const std::string&) {
+        throw std::invalid_argument{"apply"};
+    };
+    EXPECT_THROW(protostream::repack(source, destination, failing, encode_keyframe, encode_delta),
+                 std::invalid_argument);
+}
+
+TEST_F(integration_repack, destination_not_empty) {
+    const streams::mmap_reader source{source_file.filepath()};
+    streams::mmap_writer destination{destination_file.filepath(), 3, "", 0};
+    destination.append_keyframe(reinterpret_cast<const std::uint8_t*>("0"), 1);
+
+    EXPECT_THROW(protostream::repack(source, destination, apply, encode_keyframe, encode_delta),
+                 std::runtime_error);
+}
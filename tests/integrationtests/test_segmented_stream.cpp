@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+
+#include "segmented_stream.h"
+#include "streams.h"
+
+#include <boost/filesystem.hpp>
+
+#include <string>
+
+namespace {
+using writer_type = protostream::segmented_stream<streams::stream_writer>;
+using reader_type = protostream::segmented_stream<streams::mmap_reader>;
+
+constexpr auto frames_per_keyframe = 2;
+
+/** The keyframe `i` is "k<i>", followed by the single delta "d<i>" */
+std::string frame(std::size_t id) {
+    return (id % frames_per_keyframe == 0 ? "k" : "d") + std::to_string(id / frames_per_keyframe);
+}
+
+/** Appends `keyframe_count` keyframes with their deltas */
+void fill(writer_type& stream, int keyframe_count) {
+    streams::append_frames(stream, keyframe_count * frames_per_keyframe, frame);
+}
+
+protostream::segment_limits keyframe_limit(protostream::keyframe_id_t keyframes) {
+    protostream::segment_limits limits;
+    limits.max_segment_keyframes = keyframes;
+    return limits;
+}
+}
+
+struct integration_segmented_stream : public testing::Test {
+    virtual void SetUp() override {
+        directory = boost::filesystem::unique_path();
+    }
+
+    virtual void TearDown() override {
+        boost::filesystem::remove_all(directory);
+    }
+
+    /** Checks that the stream holds the keyframes [first, count) written by `fill` */
+    void expect_contents(const reader_type& stream, int first, int count) {
+        ASSERT_EQ(count, stream.keyframe_count());
+        ASSERT_EQ(count * frames_per_keyframe, stream.frame_count());
+        ASSERT_EQ(count - first, stream.end() - stream.begin());
+
+        auto expected = first;
+        for (auto it = stream.begin(); it != stream.end(); ++it, ++expected) {
+            EXPECT_EQ(expected, it.keyframe_id());
+            EXPECT_EQ("k" + std::to_string(expected), it->get());
+
+            auto delta = it->begin();
+            ASSERT_NE(it->end(), delta);
+            EXPECT_EQ("d" + std::to_string(expected), delta->get());
+            EXPECT_EQ(it->end(), ++delta);
+        }
+        EXPECT_EQ(count, expected);
+    }
+
+    const char* path() const {
+        return directory.native().c_str();
+    }
+
+protected:
+    boost::filesystem::path directory;
+};
+
+TEST_F(integration_segmented_stream, rollover_by_keyframes) {
+    {
+        writer_type stream{path(), frames_per_keyframe, "proto", 5, keyframe_limit(3)};
+        fill(stream, 10);
+        EXPECT_EQ(4, stream.segment_count());
+        EXPECT_EQ(9, stream.segment_begin(3));
+    }
+
+    reader_type stream{path()};
+    EXPECT_EQ("proto", stream.get_proto_header());
+    EXPECT_EQ(4, stream.segment_count());
+    expect_contents(stream, 0, 10);
+
+    /* Random access across the segments, in both directions */
+    auto it = stream.begin() + 7;
+    EXPECT_EQ("k7", it->get());
+    EXPECT_EQ("k2", (it - 5)->get());
+    EXPECT_EQ("k9", stream.begin()[9].get());
+    EXPECT_EQ(stream.end(), it + 3);
+}
+
+TEST_F(integration_segmented_stream, rollover_by_size) {
+    protostream::segment_limits limits;
+    limits.max_segment_size = 1;
+
+    {
+        writer_type stream{path(), frames_per_keyframe, "", 0, limits};
+        fill(stream, 5);
+        EXPECT_EQ(5, stream.segment_count());
+    }
+
+    expect_contents(reader_type{path()}, 0, 5);
+}
+
+TEST_F(integration_segmented_stream, reopen_and_append) {
+    {
+        writer_type stream{path(), frames_per_keyframe, "", 0, keyframe_limit(3)};
+        fill(stream, 4);
+    }
+
+    {
+        writer_type stream{path(), keyframe_limit(3)};
+        EXPECT_EQ(4, stream.keyframe_count());
+        fill(stream, 4);
+        EXPECT_EQ(3, stream.segment_count());
+    }
+
+    expect_contents(reader_type{path()}, 0, 8);
+}
+
+TEST_F(integration_segmented_stream, segments_are_streams) {
+    {
+        writer_type stream{path(), frames_per_keyframe, "proto", 5, keyframe_limit(3)};
+        fill(stream, 5);
+    }
+
+    reader_type stream{path()};
+    const auto& segment = stream.segment(1);
+    EXPECT_EQ(2, segment.keyframe_count());
+    EXPECT_EQ("k4", segment.begin()[1].get());
+    EXPECT_EQ("proto", segment.get_proto_header());
+}
+
+TEST_F(integration_segmented_stream, drop_segments) {
+    {
+        writer_type stream{path(), frames_per_keyframe, "", 0, keyframe_limit(3)};
+        fill(stream, 10);
+        auto it = stream.begin() + 7;
+
+        stream.drop_segments_before(7);
+        EXPECT_EQ(2, stream.segment_count());
+        EXPECT_EQ(6, stream.first_keyframe());
+
+        /* Iterators to the remaining segments stay valid */
+        EXPECT_EQ("k7", it->get());
+        EXPECT_EQ("k6", (it - 1)->get());
+        ++it;
+        ++it;
+        EXPECT_EQ("k9", it->get());
+        EXPECT_EQ("k8", it[-1].get());
+
+        /* The last segment is kept */
+        stream.drop_segments_before(100);
+        EXPECT_EQ(1, stream.segment_count());
+        EXPECT_EQ(9, stream.first_keyframe());
+    }
+
+    auto files = 0;
+    for (auto it = boost::filesystem::directory_iterator{directory};
+         it != boost::filesystem::directory_iterator{}; ++it) {
+        ++files;
+    }
+    EXPECT_EQ(2, files);
+
+    expect_contents(reader_type{path()}, 9, 10);
+}
+
+TEST_F(integration_segmented_stream, already_exists) {
+    writer_type stream{path(), frames_per_keyframe, "", 0};
+    EXPECT_THROW((writer_type{path(), frames_per_keyframe, "", 0}), std::runtime_error);
+}
+
+TEST_F(integration_segmented_stream, missing_manifest) {
+    EXPECT_THROW(reader_type{path()}, std::system_error);
+}
+
+TEST_F(integration_segmented_stream, inconsistent_segment) {
+    {
+        writer_type stream{path(), frames_per_keyframe, "", 0, keyframe_limit(3)};
+        fill(stream, 5);
+    }
+
+    /* Replace the first segment with a shorter one */
+    const auto first = (directory / "00000000000000000000.segment").native();
+    boost::filesystem::remove(first);
+    {
+        streams::stream_writer segment{first.c_str(), frames_per_keyframe, "", 0};
+    }
+
+    EXPECT_THROW(reader_type{path()}, std::runtime_error);
+}
@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+
+#include "shared_cache.h"
+#include "streams.h"
+#include "../common/temporary_file.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+using namespace protostream;
+
+template <class Backend>
+using shared_reader = streams::string_stream<with_backend<Backend>, with_cache<shared_cache>>;
+
+using mmap_shared_reader = shared_reader<mmap_backend<file_mode_t::READ_ONLY>>;
+using posix_shared_reader = shared_reader<posix_file_backend<file_mode_t::READ_ONLY>>;
+
+constexpr auto keyframe_count = 500;
+
+std::string frame(std::size_t id) {
+    return std::to_string(id);
+}
+}
+
+struct integration_shared_cache : public testing::Test {
+    virtual void SetUp() override {
+        streams::fill<streams::stream_writer>(file.filepath(), 1, keyframe_count, frame);
+        streams::fill<streams::stream_writer>(other.filepath(), 1, keyframe_count, frame);
+    }
+
+protected:
+    temporary_file file;
+    temporary_file other;
+};
+
+TEST_F(integration_shared_cache, shared_between_streams) {
+    const auto first = mmap_shared_reader{file.filepath()};
+    const auto second = posix_shared_reader{file.filepath()};
+    const auto unrelated = mmap_shared_reader{other.filepath()};
+
+    const auto initial = second.memory_usage();
+    EXPECT_EQ("321", first.begin()[321].get());
+
+    /* The index warmed up by the first stream is used by the second one */
+    EXPECT_LT(initial, second.memory_usage());
+    EXPECT_EQ("321", second.begin()[321].get());
+
+    EXPECT_GT(first.memory_usage(), unrelated.memory_usage());
+}
+
+TEST_F(integration_shared_cache, released_with_last_stream) {
+    const auto before = shared_index_registry::instance().size();
+    {
+        const auto first = mmap_shared_reader{file.filepath()};
+        const auto second = mmap_shared_reader{file.filepath()};
+        EXPECT_EQ(before + 1, shared_index_registry::instance().size());
+    }
+    EXPECT_EQ(before, shared_index_registry::instance().size());
+}
+
+TEST_F(integration_shared_cache, concurrent_readers) {
+    std::vector<std::thread> threads;
+    std::vector<int> failures(8);
+
+    for (auto t = 0u; t < failures.size(); ++t) {
+        threads.emplace_back([this, t, &failures] {
+            const auto stream = mmap_shared_reader{file.filepath()};
+            for (auto i = 0; i < keyframe_count; ++i) {
+                const auto kf = (i * 37 + t * 101) % keyframe_count;
+                if (stream.begin()[kf].get() != std::to_string(kf)) {
+                    ++failures[t];
+                }
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (const auto count : failures) {
+        EXPECT_EQ(0, count);
+    }
+}
+
+TEST_F(integration_shared_cache, modified_in_place) {
+    const auto before = shared_index_registry::instance().size();
+    const auto old = mmap_shared_reader{file.filepath()};
+    EXPECT_EQ("321", old.begin()[321].get());
+
+    {
+        streams::stream_writer writer{file.filepath()};
+        writer.truncate_frames(100);
+        streams::append_frames(writer, 100, [](std::size_t id) { return "longer " + frame(id); });
+    }
+
+    /* The index of the old contents is not shared with the new stream */
+    const auto current = mmap_shared_reader{file.filepath()};
+    EXPECT_EQ(before + 2, shared_index_registry::instance().size());
+    EXPECT_EQ("longer 150", current.begin()[150].get());
+    EXPECT_EQ("99", current.begin()[99].get());
+}
@@ -0,0 +1,54 @@
+#include <gtest/gtest.h>
+
+#include "streams.h"
+#include "../common/temporary_file.h"
+
+namespace {
+using namespace protostream;
+
+template <unsigned Height>
+using writer = streams::string_stream<with_backend<posix_file_backend<file_mode_t::READ_APPEND>>,
+                                      with_cache<full_cache>,
+                                      with_skiplist_height<Height>>;
+
+constexpr auto frames_per_keyframe = 2;
+constexpr auto keyframe_count = 300;
+
+std::string frame(std::size_t id) {
+    return "frame #" + std::to_string(id);
+}
+}
+
+template <class Height>
+struct integration_skiplist_height : public testing::Test {
+    virtual void SetUp() override {
+        streams::fill<writer<Height::value>>(file.filepath(), frames_per_keyframe,
+                                             keyframe_count * frames_per_keyframe, frame);
+    }
+
+protected:
+    temporary_file file;
+};
+
+using heights = testing::Types<std::integral_constant<unsigned, 1>,
+                               std::integral_constant<unsigned, 3>,
+                               std::integral_constant<unsigned, 10>,
+                               std::integral_constant<unsigned, 40>,
+                               std::integral_constant<unsigned, 64>>;
+
+TYPED_TEST_CASE(integration_skiplist_height, heights);
+
+TYPED_TEST(integration_skiplist_height, sequential) {
+    const auto stream = streams::mmap_reader{this->file.filepath()};
+    EXPECT_EQ(keyframe_count * frames_per_keyframe, streams::read_all(stream, frame));
+}
+
+TYPED_TEST(integration_skiplist_height, random_access) {
+    const auto stream = streams::stream_reader{this->file.filepath()};
+
+    for (const auto kf : {299, 0, 257, 1, 128, 255, 17, 298}) {
+        EXPECT_EQ(frame(kf * frames_per_keyframe), stream.begin()[kf].get());
+    }
+
+    EXPECT_EQ(stream.end(), stream.begin() + keyframe_count);
+}
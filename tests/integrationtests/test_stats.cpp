@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+
+#include "streams.h"
+#include "../common/temporary_file.h"
+
+#include <string>
+#include <type_traits>
+
+namespace {
+using namespace protostream;
+
+template <class Backend, template <class> class Cache>
+using counted_stream = streams::string_stream<with_backend<Backend>,
+                                              with_cache<Cache>,
+                                              with_stats<counting_stats>>;
+
+using mmap_writer = counted_stream<mmap_backend<file_mode_t::READ_APPEND>, offsets_only_cache>;
+using stream_writer =
+    counted_stream<posix_file_backend<file_mode_t::READ_APPEND>, offsets_only_cache>;
+using mmap_reader = counted_stream<mmap_backend<file_mode_t::READ_ONLY>, full_cache>;
+using stream_reader = counted_stream<posix_file_backend<file_mode_t::READ_ONLY>, full_cache>;
+
+constexpr auto frames_per_keyframe = 4u;
+constexpr auto frame_count = 1000u;
+constexpr auto frame_size = 4096u;
+
+/** Writes the stream `path`, returning the statistics of the writer */
+template <class Writer>
+counting_stats write_counted(const char* path) {
+    const std::string data(frame_size, '*');
+
+    Writer stream{path, frames_per_keyframe, "", 0};
+    streams::append_frames(stream, frame_count, [&data](std::size_t) { return data; });
+    return stream.stats();
+}
+}
+
+static_assert(std::is_same<streams::mmap_reader::stats_type, no_stats>::value,
+              "Statistics are not recorded by default");
+static_assert(std::is_same<streams::mmap_reader::backend_type,
+                           mmap_backend<file_mode_t::READ_ONLY>>::value,
+              "The backend is not wrapped without statistics");
+
+TEST(integration_stats, mmap_writer) {
+    temporary_file file;
+    const auto stats = write_counted<mmap_writer>(file.filepath());
+
+    EXPECT_EQ(frame_count, stats.header_writes);
+    EXPECT_GE(stats.bytes_written, frame_count * frame_size);
+    EXPECT_GE(stats.mmap_expansions, frame_count * frame_size / (1024 * 1024));
+    EXPECT_EQ(0, stats.bytes_allocated);
+}
+
+TEST(integration_stats, stream_writer) {
+    temporary_file file;
+    const auto stats = write_counted<stream_writer>(file.filepath());
+
+    EXPECT_EQ(frame_count, stats.header_writes);
+    EXPECT_GE(stats.writes, 3 * frame_count);
+    EXPECT_GE(stats.bytes_written, frame_count * frame_size);
+    EXPECT_EQ(0, stats.mmap_expansions);
+}
+
+template <class Reader>
+struct integration_stats_read : public testing::Test {
+    virtual void SetUp() override {
+        write_counted<mmap_writer>(file.filepath());
+    }
+
+protected:
+    temporary_file file;
+};
+
+using readers = testing::Types<mmap_reader, stream_reader>;
+
+TYPED_TEST_CASE(integration_stats_read, readers);
+
+TYPED_TEST(integration_stats_read, seek) {
+    const TypeParam stream{this->file.filepath()};
+    const auto opened = stream.stats();
+    EXPECT_EQ(0, opened.link_hops);
+    EXPECT_EQ(0, opened.header_writes);
+
+    const auto last = stream.keyframe_count() - 1;
+    EXPECT_EQ(std::string(frame_size, '*'), stream.begin()[last].get());
+    const auto first_seek = stream.stats();
+    EXPECT_GT(first_seek.link_hops, 0);
+    EXPECT_GT(first_seek.cache_misses, 0);
+    EXPECT_GT(first_seek.bytes_read, opened.bytes_read + frame_size);
+
+    /* The same seek is answered by the cache */
+    stream.begin()[last].get();
+    const auto second_seek = stream.stats();
+    EXPECT_EQ(first_seek.cache_misses, second_seek.cache_misses);
+    EXPECT_GT(second_seek.cache_hits, first_seek.cache_hits);
+
+    if (std::is_pointer<typename TypeParam::pointer_type>::value) {
+        EXPECT_EQ(0, second_seek.bytes_allocated);
+    } else {
+        EXPECT_GE(second_seek.bytes_allocated, 2 * frame_size);
+    }
+}
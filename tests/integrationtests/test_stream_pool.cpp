@@ -0,0 +1,202 @@
+#include <gtest/gtest.h>
+
+#include "shared_cache.h"
+#include "stream_pool.h"
+#include "streams.h"
+#include "windowed_mmap_backend.h"
+#include "../common/temporary_file.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+
+#include <chrono>
+#include <limits>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace {
+/* The pooled streams are shared between the threads acquiring them */
+using shared_reader = streams::string_stream<
+    protostream::with_backend<protostream::mmap_backend<protostream::file_mode_t::READ_ONLY>>,
+    protostream::with_cache<protostream::shared_cache>>;
+
+using pool_type = protostream::stream_pool<shared_reader>;
+
+/* stream_pool rejects these, as their reads race with each other */
+using windowed_reader = streams::string_stream<
+    protostream::with_backend<
+        protostream::windowed_mmap_backend<protostream::file_mode_t::READ_ONLY>>,
+    protostream::with_cache<protostream::shared_cache>>;
+
+using counted_reader = streams::string_stream<
+    protostream::with_backend<protostream::mmap_backend<protostream::file_mode_t::READ_ONLY>>,
+    protostream::with_cache<protostream::shared_cache>,
+    protostream::with_stats<protostream::counting_stats>>;
+
+static_assert(
+    !protostream::detail::is_thread_safe_backend<windowed_reader::backend_type>::value,
+    "Streams on windowed_mmap_backend cannot be pooled");
+static_assert(!std::is_same<counted_reader::stats_type, protostream::no_stats>::value,
+              "Streams recording statistics cannot be pooled");
+
+constexpr auto frames_per_keyframe = 1;
+
+std::string frame(std::size_t id) {
+    return std::to_string(id);
+}
+
+/* Checks the files on every acquire */
+constexpr auto no_budget = std::numeric_limits<std::size_t>::max();
+constexpr auto always = std::chrono::seconds{0};
+}
+
+struct integration_stream_pool : public testing::Test {
+    virtual void SetUp() override {
+        files.resize(3);
+        for (auto i = 0u; i < files.size(); ++i) {
+            streams::fill<streams::stream_writer>(files[i].filepath(), frames_per_keyframe,
+                                                  10 * (i + 1), frame);
+        }
+    }
+
+protected:
+    std::vector<temporary_file> files;
+
+    /** Replaces the file `path` with a new one holding `count` frames */
+    void replace(const char* path, std::size_t count) {
+        auto replacement = temporary_file{};
+        streams::fill<streams::stream_writer>(replacement.filepath(), frames_per_keyframe, count,
+                                              frame);
+        ASSERT_EQ(0, std::rename(replacement.filepath(), path));
+        replacement.close();
+    }
+};
+
+TEST_F(integration_stream_pool, reuse) {
+    pool_type pool{2};
+
+    const auto first = pool.acquire(files[0].filepath());
+    EXPECT_EQ(10, first->keyframe_count());
+    EXPECT_EQ("7", first->begin()[7].get());
+
+    EXPECT_EQ(first, pool.acquire(files[0].filepath()));
+    EXPECT_EQ(1, pool.size());
+}
+
+TEST_F(integration_stream_pool, evict_lru) {
+    pool_type pool{2};
+
+    const auto first = pool.acquire(files[0].filepath()).get();
+    const auto second = pool.acquire(files[1].filepath()).get();
+    EXPECT_EQ(first, pool.acquire(files[0].filepath()).get());
+
+    EXPECT_EQ(30, pool.acquire(files[2].filepath())->keyframe_count());
+    EXPECT_EQ(2, pool.size());
+
+    /* files[1] was the least recently used one */
+    EXPECT_EQ(first, pool.acquire(files[0].filepath()).get());
+    const auto reopened = pool.acquire(files[1].filepath());
+    EXPECT_EQ(20, reopened->keyframe_count());
+    (void)second;
+}
+
+TEST_F(integration_stream_pool, memory_budget) {
+    pool_type pool{3, 0};
+
+    const auto handle = pool.acquire(files[0].filepath());
+    pool.acquire(files[1].filepath());
+    EXPECT_EQ(1, pool.size());
+
+    /* Evicted streams stay valid while they are used */
+    EXPECT_EQ("9", handle->begin()[9].get());
+}
+
+TEST_F(integration_stream_pool, concurrent_acquire) {
+    pool_type pool{2};
+
+    std::vector<std::thread> threads;
+    for (auto t = 0; t < 4; ++t) {
+        threads.emplace_back([this, &pool, t] {
+            for (auto i = 0; i < 50; ++i) {
+                const auto& file = files[(t + i) % files.size()];
+                const auto stream = pool.acquire(file.filepath());
+                EXPECT_EQ("3", stream->begin()[3].get());
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(2, pool.size());
+}
+
+TEST_F(integration_stream_pool, replaced_file) {
+    pool_type pool{2, no_budget, always};
+
+    const auto old = pool.acquire(files[0].filepath());
+    EXPECT_EQ(10, old->keyframe_count());
+
+    replace(files[0].filepath(), 5);
+
+    const auto current = pool.acquire(files[0].filepath());
+    EXPECT_NE(old, current);
+    EXPECT_EQ(5, current->keyframe_count());
+    EXPECT_EQ(10, old->keyframe_count());
+}
+
+TEST_F(integration_stream_pool, modified_file) {
+    pool_type pool{2, no_budget, always};
+
+    const auto old = pool.acquire(files[1].filepath());
+    for (auto kf = 0; kf < 20; ++kf) {
+        EXPECT_EQ(frame(kf), old->begin()[kf].get());
+    }
+
+    {
+        streams::stream_writer writer{files[1].filepath()};
+        writer.truncate_frames(5);
+        streams::append_frames(writer, 20, [](std::size_t id) { return "longer " + frame(id); });
+    }
+
+    const auto current = pool.acquire(files[1].filepath());
+    EXPECT_NE(old, current);
+    ASSERT_EQ(25, current->keyframe_count());
+    for (auto kf = 5; kf < 25; ++kf) {
+        EXPECT_EQ("longer " + frame(kf), current->begin()[kf].get());
+    }
+}
+
+TEST_F(integration_stream_pool, revalidation_interval) {
+    pool_type pool{2, no_budget, std::chrono::hours{1}};
+
+    const auto old = pool.acquire(files[0].filepath());
+    replace(files[0].filepath(), 5);
+
+    /* The file is not checked again within the interval */
+    EXPECT_EQ(old, pool.acquire(files[0].filepath()));
+}
+
+TEST_F(integration_stream_pool, shared_index) {
+    const auto link = std::string{files[0].filepath()} + ".link";
+    ASSERT_EQ(0, ::link(files[0].filepath(), link.c_str()));
+
+    pool_type pool{2};
+    const auto first = pool.acquire(files[0].filepath());
+    const auto second = pool.acquire(link);
+    EXPECT_NE(first, second);
+    EXPECT_EQ("7", second->begin()[7].get());
+
+    /* Both streams read the same file, so the index is counted once */
+    EXPECT_EQ(first->own_memory_usage() + second->memory_usage(), pool.memory_usage());
+
+    std::remove(link.c_str());
+}
+
+TEST_F(integration_stream_pool, missing_file) {
+    pool_type pool{2};
+    EXPECT_THROW(pool.acquire("/nonexistent/file"), std::system_error);
+}
@@ -0,0 +1,141 @@
+#include <gtest/gtest.h>
+
+#include "streams.h"
+#include "../common/temporary_file.h"
+
+#include <stdexcept>
+#include <string>
+
+namespace {
+constexpr auto frames_per_keyframe = 3u;
+
+std::string frame(std::size_t id, const std::string& generation) {
+    return generation + std::string(id % 5, '*') + std::to_string(id);
+}
+
+/** Returns the frames of the given generation, see `streams::append_frames` */
+auto frames_of(const std::string& generation) {
+    return [generation](std::size_t id) { return frame(id, generation); };
+}
+
+/** Checks that the stream holds `count` frames, the ones following
+ * `boundary` being of the generation `second` */
+template <class Stream>
+void expect_frames(const Stream& stream,
+                   std::size_t count,
+                   std::size_t boundary,
+                   const std::string& second = "new") {
+    ASSERT_EQ(count, stream.frame_count());
+    ASSERT_EQ((count + frames_per_keyframe - 1) / frames_per_keyframe, stream.keyframe_count());
+
+    const auto expected = [boundary, &second](std::size_t id) {
+        return frame(id, id < boundary ? "old" : second);
+    };
+
+    EXPECT_EQ(count, streams::read_all(stream, expected));
+
+    /* Seek to every keyframe from the beginning, following the skiplists */
+    for (auto kf = std::size_t{0}; kf < stream.keyframe_count(); ++kf) {
+        EXPECT_EQ(expected(kf * frames_per_keyframe), stream.begin()[kf].get());
+    }
+}
+}
+
+template <class Writer>
+struct integration_truncate : public testing::Test {
+    virtual void SetUp() override {
+        streams::fill<Writer>(file.filepath(), frames_per_keyframe, 200, frames_of("old"));
+    }
+
+protected:
+    temporary_file file;
+
+    /** Truncates the stream to `count` frames and appends new ones up to
+     * `total`, within a single writer */
+    void truncate_and_append(std::size_t count, std::size_t total) {
+        Writer stream{file.filepath()};
+
+        /* Fill the cache with the links of the discarded keyframes */
+        EXPECT_EQ(frame(195, "old"), stream.begin()[65].get());
+
+        stream.truncate_frames(count);
+        expect_frames(stream, count, count);
+
+        streams::append_frames(stream, total - count, frames_of("new"));
+        expect_frames(stream, total, count);
+    }
+};
+
+using writers = testing::Types<streams::mmap_writer, streams::stream_writer>;
+
+TYPED_TEST_CASE(integration_truncate, writers);
+
+TYPED_TEST(integration_truncate, within_group) {
+    this->truncate_and_append(100, 250);
+    expect_frames(streams::stream_reader{this->file.filepath()}, 250, 100);
+}
+
+TYPED_TEST(integration_truncate, at_keyframe) {
+    this->truncate_and_append(99, 150);
+    expect_frames(streams::mmap_reader{this->file.filepath()}, 150, 99);
+}
+
+TYPED_TEST(integration_truncate, last_frame) {
+    this->truncate_and_append(199, 200);
+    expect_frames(streams::stream_reader{this->file.filepath()}, 200, 199);
+}
+
+TYPED_TEST(integration_truncate, everything) {
+    this->truncate_and_append(0, 10);
+    expect_frames(streams::stream_reader{this->file.filepath()}, 10, 0);
+}
+
+TYPED_TEST(integration_truncate, reopen) {
+    {
+        TypeParam stream{this->file.filepath()};
+        stream.truncate_frames(40);
+    }
+
+    expect_frames(streams::stream_reader{this->file.filepath()}, 40, 40);
+
+    {
+        TypeParam stream{this->file.filepath()};
+        streams::append_frames(stream, 80, frames_of("new"));
+    }
+
+    expect_frames(streams::stream_reader{this->file.filepath()}, 120, 40);
+}
+
+TYPED_TEST(integration_truncate, invalid_count) {
+    TypeParam stream{this->file.filepath()};
+    EXPECT_THROW(stream.truncate_frames(201), std::out_of_range);
+
+    stream.truncate_frames(200);
+    EXPECT_EQ(200, stream.frame_count());
+}
+
+TYPED_TEST(integration_truncate, interrupted) {
+    const auto old_contents = this->file.contents();
+    {
+        TypeParam stream{this->file.filepath()};
+        stream.truncate_frames(100);
+    }
+
+    /* The file left by an interruption right after the header was written:
+     * the new header followed by the old frames, links and all */
+    const auto header = this->file.contents().substr(0, protostream::file_header::size);
+    temporary_file interrupted{header + old_contents.substr(header.size())};
+
+    expect_frames(streams::stream_reader{interrupted.filepath()}, 100, 100);
+    expect_frames(streams::mmap_reader{interrupted.filepath()}, 100, 100);
+
+    /* Longer frames, so that the new keyframes are not placed where the
+     * discarded ones were */
+    {
+        TypeParam stream{interrupted.filepath()};
+        streams::append_frames(stream, 50, frames_of("longer"));
+        expect_frames(stream, 150, 100, "longer");
+    }
+
+    expect_frames(streams::stream_reader{interrupted.filepath()}, 150, 100, "longer");
+}
@@ -39,4 +39,26 @@ TYPED_TEST(integration_write_simple, write) {
     }
 
     EXPECT_EQ(file_contents(TypeParam::test::file), file.contents());
-}
\ No newline at end of file
+}
+
+TYPED_TEST(integration_write_simple, reopen) {
+    auto file = temporary_file{};
+
+    /* Reopen the file for append several times, at various keyframes */
+    const auto step = TypeParam::test::frames_per_keyframe * 3 + 1;
+    {
+        constexpr auto header = TypeParam::test::header;
+        auto stream = typename TypeParam::stream{
+            file.filepath(), TypeParam::test::frames_per_keyframe, header, strlen(header)};
+        streams::append_frames(stream, std::min(step, TypeParam::test::frame_count),
+                               TypeParam::test::frame);
+    }
+
+    for (auto from = step; from < TypeParam::test::frame_count; from += step) {
+        auto stream = typename TypeParam::stream{file.filepath()};
+        streams::append_frames(stream, std::min(step, TypeParam::test::frame_count - from),
+                               TypeParam::test::frame);
+    }
+
+    EXPECT_EQ(file_contents(TypeParam::test::file), file.contents());
+}
@@ -7,6 +7,8 @@
 #include "common.h"
 #include "header.h"
 
+#include <array>
+
 template <template <class> class Cache>
 struct cache_test_base : public testing::Test {
     static offset_t link(unsigned level) {
@@ -22,6 +24,8 @@ struct cache_test_base : public testing::Test {
         for (auto idx = 0u; idx < skiplist.size(); ++idx) {
             skiplist[idx] = protostream::detail::htobe(link(idx));
         }
+
+        header.write(serialised.data());
     }
 
     virtual void SetUp() override {
@@ -40,16 +44,14 @@ struct cache_test_base : public testing::Test {
             .WillOnce(testing::Return(reinterpret_cast<const std::uint8_t*>(skiplist.data())));
     }
 
-    template <class Field>
-    void expect_field_reads(protostream::offset_t keyframe_offset) {
-        read_helper<Field>{}(*backend, keyframe_offset)
-            .WillRepeatedly(testing::Return(header.get<Field>()));
+    void expect_header_reads(protostream::offset_t keyframe_offset) {
+        EXPECT_CALL(*backend, read(keyframe_offset, protostream::reduced_keyframe_header::size))
+            .WillRepeatedly(testing::Return(serialised.data()));
     }
 
-    template <class Field>
-    void expect_field_read(protostream::offset_t keyframe_offset) {
-        read_helper<Field>{}(*backend, keyframe_offset)
-            .WillOnce(testing::Return(header.get<Field>()));
+    void expect_header_read(protostream::offset_t keyframe_offset) {
+        EXPECT_CALL(*backend, read(keyframe_offset, protostream::reduced_keyframe_header::size))
+            .WillOnce(testing::Return(serialised.data()));
     }
 
     std::unique_ptr<mock_backend> backend;
@@ -57,24 +59,17 @@ struct cache_test_base : public testing::Test {
 
     static protostream::reduced_keyframe_header header;
     static std::array<offset_t, protostream::fields::skiplist_height> skiplist;
+    alignas(offset_t) static std::array<std::uint8_t, protostream::reduced_keyframe_header::size>
+        serialised;
 
-private:
-    template <class Field, unsigned bits = 8 * Field::size>
-    struct read_helper;
-
-#define CACHE_TEST_BASE_DEFINE_HELPER(bits)                                                        \
-    template <class Field>                                                                         \
-    struct read_helper<Field, bits> {                                                              \
-        auto&& operator()(mock_backend & backend, protostream::offset_t keyframe_offset) {         \
-            return EXPECT_CALL(backend, read##bits(keyframe_offset + Field::offset));              \
-        }                                                                                          \
-    };
-
-    MOCK_BACKEND_FOR_ALL_NUMERICS(CACHE_TEST_BASE_DEFINE_HELPER);
 };
 
 template <template <class> class Cache>
 protostream::reduced_keyframe_header cache_test_base<Cache>::header;
 
 template <template <class> class Cache>
-std::array<offset_t, protostream::fields::skiplist_height> cache_test_base<Cache>::skiplist;
\ No newline at end of file
+std::array<offset_t, protostream::fields::skiplist_height> cache_test_base<Cache>::skiplist;
+
+template <template <class> class Cache>
+std::array<std::uint8_t, protostream::reduced_keyframe_header::size>
+    cache_test_base<Cache>::serialised;
\ No newline at end of file
@@ -12,7 +12,9 @@ struct mock_cache : public protostream::cache_base<mock_cache<Backend>, Backend>
     using base = protostream::cache_base<mock_cache<Backend>, Backend>;
 
 public:
-    mock_cache(Backend& backend) : base{backend} {
+    mock_cache(Backend& backend,
+               const protostream::keyframe_layout& layout = protostream::keyframe_layout{})
+        : base{backend, layout} {
     }
 
     MOCK_CONST_METHOD1(header_at,
@@ -42,4 +42,22 @@ TEST_F(cache_base, offset_caching) {
         const auto keyframe_id = header.get<protostream::fields::kf_num>() + (1 << idx);
         EXPECT_EQ(link(idx), cache->offset_of(keyframe_id));
     }
-}
\ No newline at end of file
+}
+
+TEST_F(cache_base, nearest_known) {
+    constexpr offset_t keyframe_offset = 302;
+    const auto kf_num = header.get<protostream::fields::kf_num>();
+
+    EXPECT_CALL(*cache, header_at(keyframe_offset)).WillOnce(Return(header));
+
+    expect_skiplist_read(keyframe_offset);
+
+    EXPECT_FALSE(cache->nearest_known(kf_num));
+
+    cache->link_at(keyframe_offset, 0);
+
+    EXPECT_FALSE(cache->nearest_known(kf_num - 1));
+    EXPECT_EQ(std::make_pair(kf_num, keyframe_offset), *cache->nearest_known(kf_num));
+    EXPECT_EQ(std::make_pair(kf_num + 2, link(1)), *cache->nearest_known(kf_num + 3));
+    EXPECT_EQ(std::make_pair(kf_num + 512, link(9)), *cache->nearest_known(kf_num + 100000));
+}
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include "codec.h"
+
+#include <random>
+#include <string>
+
+namespace {
+std::string round_trip(const std::string& data) {
+    const auto ptr = reinterpret_cast<const std::uint8_t*>(data.data());
+    const auto compressed = protostream::lz_codec::compress(ptr, data.size());
+
+    auto result = std::string(data.size(), '\0');
+    protostream::lz_codec::decompress(compressed.data(), compressed.size(),
+                                      reinterpret_cast<std::uint8_t*>(&result[0]), data.size());
+    return result;
+}
+
+std::string random_string(std::size_t length, int alphabet) {
+    auto gen = std::mt19937{42};
+    auto result = std::string{};
+    for (auto i = std::size_t{0}; i < length; ++i) {
+        result += static_cast<char>('a' + gen() % alphabet);
+    }
+    return result;
+}
+}
+
+TEST(lz_codec, round_trip) {
+    EXPECT_EQ("", round_trip(""));
+    EXPECT_EQ("abc", round_trip("abc"));
+    EXPECT_EQ("abcdabcdabcd", round_trip("abcdabcdabcd"));
+    EXPECT_EQ(std::string(100000, 'x'), round_trip(std::string(100000, 'x')));
+
+    for (auto alphabet : {2, 4, 26}) {
+        const auto data = random_string(200000, alphabet);
+        EXPECT_EQ(data, round_trip(data));
+    }
+}
+
+TEST(lz_codec, compresses) {
+    const auto data = std::string(10000, 'x') + random_string(1000, 3);
+    const auto compressed = protostream::lz_codec::compress(
+        reinterpret_cast<const std::uint8_t*>(data.data()), data.size());
+
+    EXPECT_GT(data.size() / 2, compressed.size());
+}
+
+TEST(lz_codec, corrupted) {
+    const auto data = std::string(1000, 'x');
+    auto compressed = protostream::lz_codec::compress(
+        reinterpret_cast<const std::uint8_t*>(data.data()), data.size());
+    auto result = std::string(data.size(), '\0');
+    const auto into = reinterpret_cast<std::uint8_t*>(&result[0]);
+
+    EXPECT_THROW(protostream::lz_codec::decompress(compressed.data(), compressed.size() - 2, into,
+                                                   data.size()),
+                 std::runtime_error);
+    EXPECT_THROW(protostream::lz_codec::decompress(compressed.data(), compressed.size(), into,
+                                                   data.size() - 1),
+                 std::runtime_error);
+}
+
+TEST(codec_frame, stored_if_incompressible) {
+    using frame = protostream::detail::codec_frame<protostream::lz_codec>;
+    const auto data = std::string{"abc"};
+    const auto encoded =
+        frame::encode(reinterpret_cast<const std::uint8_t*>(data.data()), data.size());
+
+    ASSERT_EQ(data.size() + 1, encoded.size());
+    EXPECT_EQ(frame::stored, encoded[0]);
+
+    const auto decoded = frame::decode(encoded.data(), encoded.size());
+    EXPECT_EQ(data, std::string(decoded.first.get(), decoded.first.get() + decoded.second));
+}
+
+TEST(codec_frame, compressed) {
+    using frame = protostream::detail::codec_frame<protostream::lz_codec>;
+    const auto data = std::string(1000, 'y');
+    const auto encoded =
+        frame::encode(reinterpret_cast<const std::uint8_t*>(data.data()), data.size());
+
+    ASSERT_GT(data.size(), encoded.size());
+    EXPECT_EQ(frame::compressed, encoded[0]);
+
+    const auto decoded = frame::decode(encoded.data(), encoded.size());
+    EXPECT_EQ(data, std::string(decoded.first.get(), decoded.first.get() + decoded.second));
+}
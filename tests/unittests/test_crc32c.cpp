@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+#include "crc32c.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+namespace detail = protostream::detail;
+
+namespace {
+std::uint32_t crc_of(const std::string& data) {
+    return detail::crc32c(reinterpret_cast<const std::uint8_t*>(data.data()), data.size());
+}
+}
+
+TEST(crc32c, known_values) {
+    EXPECT_EQ(0x00000000u, crc_of(""));
+    EXPECT_EQ(0xe3069283u, crc_of("123456789"));
+    EXPECT_EQ(0x8a9136aau, crc_of(std::string(32, '\0')));
+    EXPECT_EQ(0x62a8ab43u, crc_of(std::string(32, '\xff')));
+}
+
+TEST(crc32c, incremental) {
+    const auto data = std::string{"The quick brown fox jumps over the lazy dog"};
+    for (auto split = std::size_t{0}; split <= data.size(); ++split) {
+        const auto first = crc_of(data.substr(0, split));
+        const auto rest = data.substr(split);
+        EXPECT_EQ(crc_of(data),
+                  detail::crc32c(reinterpret_cast<const std::uint8_t*>(rest.data()), rest.size(),
+                                 first));
+    }
+}
+
+TEST(crc32c, combine) {
+    const auto data = std::string(1000, 'x') + "The quick brown fox jumps over the lazy dog";
+    for (auto split : {0, 1, 7, 500, 1000, 1043}) {
+        const auto first = data.substr(0, split);
+        const auto second = data.substr(split);
+        EXPECT_EQ(crc_of(data),
+                  detail::crc32c_combine(crc_of(first), crc_of(second), second.size()));
+    }
+}
+
+TEST(crc32c, implementations_agree) {
+    auto gen = std::mt19937{42};
+    auto data = std::vector<std::uint8_t>(4099);
+    for (auto& byte : data) {
+        byte = static_cast<std::uint8_t>(gen());
+    }
+
+    for (auto offset : {0, 1, 3, 7}) {
+        const auto ptr = data.data() + offset;
+        const auto size = data.size() - offset;
+        const auto software = ~detail::crc32c_impl::software(~0u, ptr, size);
+        EXPECT_EQ(software, detail::crc32c(ptr, size));
+#ifdef PROTOSTREAM_HAVE_SSE42_CRC32C
+        if (detail::crc32c_impl::has_hardware()) {
+            EXPECT_EQ(software, ~detail::crc32c_impl::hardware(~0u, ptr, size));
+        }
+#endif
+    }
+}
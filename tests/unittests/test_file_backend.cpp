@@ -1,12 +1,14 @@
 #include <gtest/gtest.h>
 #include "posix_file_backend.h"
 #include "mmap_backend.h"
+#include "windowed_mmap_backend.h"
 
 #include "../common/temporary_file.h"
 
 using backends =
     testing::Types<protostream::mmap_backend<protostream::file_mode_t::READ_APPEND>,
-                   protostream::posix_file_backend<protostream::file_mode_t::READ_APPEND>>;
+                   protostream::posix_file_backend<protostream::file_mode_t::READ_APPEND>,
+                   protostream::windowed_mmap_backend<protostream::file_mode_t::READ_APPEND>>;
 
 template <class T>
 struct file_backend : public testing::Test {};
@@ -12,7 +12,8 @@ constexpr const char serialised[] = "PROTOSTR"                         /* magic
                                     "\x8f\x1e\x0b\x3d\x9a\x7b\x00\xff" /* keyframe count */
                                     "\x00\x01\x02\x03\x29\x10\xff\xff" /* frame count */
                                     "\xff\x0d\xe9\x21"                 /* frames per keyframe */
-                                    "\x00\x00\x00\x00";                /* reserved */
+                                    "\x00\x00\x00"                    /* metadata, codec, flags */
+                                    "\x28";                            /* skiplist height */
 
 constexpr auto file_size = std::uint64_t{0xdeadbeeffebeaddellu};
 constexpr auto proto_header_offset = std::uint64_t{0x1223344598877665llu};
@@ -20,6 +21,7 @@ constexpr auto kf0_offset = std::uint64_t{0x9988776612832938llu};
 constexpr auto keyframe_count = std::uint64_t{0x8f1e0b3d9a7b00ffllu};
 constexpr auto frame_count = std::uint64_t{0x000102032910ffffllu};
 constexpr auto frames_per_kf = std::uint32_t{0xff0de921u};
+constexpr auto skiplist_height = std::uint8_t{40};
 }
 
 static_assert(protostream::file_header::size == sizeof(serialised) - 1, "Wrong header size");
@@ -34,6 +36,7 @@ TEST(file_header, read) {
     EXPECT_EQ(keyframe_count, header.get<protostream::fields::keyframe_count>());
     EXPECT_EQ(frame_count, header.get<protostream::fields::frame_count>());
     EXPECT_EQ(frames_per_kf, header.get<protostream::fields::frames_per_kf>());
+    EXPECT_EQ(skiplist_height, header.get<protostream::fields::kf_skiplist_height>());
 }
 
 TEST(file_header, write) {
@@ -45,6 +48,7 @@ TEST(file_header, write) {
     header.get<protostream::fields::keyframe_count>() = keyframe_count;
     header.get<protostream::fields::frame_count>() = frame_count;
     header.get<protostream::fields::frames_per_kf>() = frames_per_kf;
+    header.get<protostream::fields::kf_skiplist_height>() = skiplist_height;
 
     auto data = std::array<std::uint8_t, sizeof(serialised)>{};
     data.fill(0);
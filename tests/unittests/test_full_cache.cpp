@@ -11,9 +11,7 @@ struct full_cache : public cache_test_base<protostream::full_cache> {};
 TEST_F(full_cache, read_header) {
     constexpr offset_t keyframe_offset = 404;
 
-    expect_field_read<protostream::fields::kf_num>(keyframe_offset);
-    expect_field_read<protostream::fields::delta_offset>(keyframe_offset);
-    expect_field_read<protostream::fields::kf_size>(keyframe_offset);
+    expect_header_read(keyframe_offset);
 
     for (auto iter = 0; iter < 100; ++iter) {
         EXPECT_EQ(header, cache->header_at(keyframe_offset));
@@ -23,9 +21,7 @@ TEST_F(full_cache, read_header) {
 TEST_F(full_cache, links) {
     constexpr offset_t keyframe_offset = 404;
 
-    expect_field_read<protostream::fields::kf_num>(keyframe_offset);
-    expect_field_read<protostream::fields::delta_offset>(keyframe_offset);
-    expect_field_read<protostream::fields::kf_size>(keyframe_offset);
+    expect_header_read(keyframe_offset);
     expect_skiplist_read(keyframe_offset);
 
     for (auto idx = 0u; idx < skiplist.size(); ++idx) {
@@ -11,9 +11,7 @@ struct offsets_only_cache : public cache_test_base<protostream::offsets_only_cac
 TEST_F(offsets_only_cache, read_header) {
     constexpr offset_t keyframe_offset = 404;
 
-    expect_field_read<protostream::fields::kf_num>(keyframe_offset);
-    expect_field_read<protostream::fields::delta_offset>(keyframe_offset);
-    expect_field_read<protostream::fields::kf_size>(keyframe_offset);
+    expect_header_read(keyframe_offset);
 
     EXPECT_EQ(header, cache->header_at(keyframe_offset));
 }
@@ -21,9 +19,7 @@ TEST_F(offsets_only_cache, read_header) {
 TEST_F(offsets_only_cache, links) {
     constexpr offset_t keyframe_offset = 404;
 
-    expect_field_reads<protostream::fields::kf_num>(keyframe_offset);
-    expect_field_reads<protostream::fields::delta_offset>(keyframe_offset);
-    expect_field_reads<protostream::fields::kf_size>(keyframe_offset);
+    expect_header_reads(keyframe_offset);
     expect_skiplist_read(keyframe_offset);
 
     for (auto idx = 0u; idx < skiplist.size(); ++idx) {
@@ -1,7 +1,9 @@
 #include <gtest/gtest.h>
 #include "header.h"
 
+#include <algorithm>
 #include <array>
+#include <vector>
 
 namespace {
 constexpr const char serialised[] = "\x01\x23\x45\x67\x76\x54\x32\x10" /* keyframe number */
@@ -50,4 +52,37 @@ TEST(reduced_keyframe_header, write) {
 
     EXPECT_EQ(std::string(std::end(serialised) - 4, std::end(serialised)),
               std::string(std::end(data) - 4, std::end(data)));
-}
\ No newline at end of file
+}
+
+TEST(reduced_keyframe_header, layout) {
+    const auto default_layout = protostream::keyframe_layout{};
+    EXPECT_EQ(sizeof(serialised) - 1, default_layout.header_size());
+    EXPECT_EQ(sizeof(serialised) - 1 - sizeof(kf_size), default_layout.kf_size_offset());
+
+    const auto header = default_layout.read(reinterpret_cast<const std::uint8_t*>(serialised));
+    EXPECT_EQ(kf_num, header.get<protostream::fields::kf_num>());
+    EXPECT_EQ(delta_offset, header.get<protostream::fields::delta_offset>());
+    EXPECT_EQ(kf_size, header.get<protostream::fields::kf_size>());
+}
+
+TEST(reduced_keyframe_header, layout_custom_height) {
+    for (const auto order : {protostream::byte_order::big, protostream::byte_order::native}) {
+        auto layout = protostream::keyframe_layout{};
+        layout.order = order;
+        layout.skiplist_height = 37;
+        EXPECT_EQ(16 + 8 * 37 + 4, layout.header_size());
+
+        auto header = protostream::reduced_keyframe_header{};
+        header.get<protostream::fields::kf_num>() = kf_num;
+        header.get<protostream::fields::delta_offset>() = delta_offset;
+        header.get<protostream::fields::kf_size>() = kf_size;
+
+        std::vector<std::uint8_t> data(layout.header_size());
+        layout.write(header, data.data());
+
+        EXPECT_EQ(header, layout.read(data.data()));
+        EXPECT_TRUE(std::all_of(data.begin() + protostream::fields::skiplist_offset(),
+                                data.begin() + layout.kf_size_offset(),
+                                [](std::uint8_t byte) { return byte == 0; }));
+    }
+}
@@ -68,4 +68,21 @@ TEST(utils, readbuf_unaligned) {
     const auto buffer = detail::htobe(value);
 
     EXPECT_EQ(value, detail::readbuf_unaligned<std::uint32_t>(&buffer));
-}
\ No newline at end of file
+}
+
+TEST(utils, readbuf_array) {
+    /* An odd count and an unaligned buffer */
+    constexpr auto count = 11u;
+    std::uint8_t buffer[1 + count * sizeof(std::uint64_t)];
+    for (auto i = 0u; i < count; ++i) {
+        const auto value = detail::htobe(std::uint64_t{0x0102030405060708llu} * (i + 1));
+        memcpy(buffer + 1 + i * sizeof(value), &value, sizeof(value));
+    }
+
+    std::uint64_t result[count];
+    detail::readbuf_array(buffer + 1, count, result);
+
+    for (auto i = 0u; i < count; ++i) {
+        EXPECT_EQ(std::uint64_t{0x0102030405060708llu} * (i + 1), result[i]);
+    }
+}
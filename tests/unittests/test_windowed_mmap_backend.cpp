@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+#include "windowed_mmap_backend.h"
+
+#include "../common/temporary_file.h"
+
+#include <string>
+
+namespace {
+constexpr auto window_size = std::size_t{64 * 1024};
+
+using backend = protostream::windowed_mmap_backend<protostream::file_mode_t::READ_APPEND,
+                                                   window_size,
+                                                   2>;
+
+std::string pattern(std::size_t size) {
+    std::string result(size, '\0');
+    for (auto i = std::size_t{0}; i < size; ++i) {
+        result[i] = static_cast<char>('a' + i % 23);
+    }
+    return result;
+}
+
+std::string read(const backend& backend, std::size_t offset, std::size_t length) {
+    const auto data = backend.read(offset, length);
+    const auto ptr = reinterpret_cast<const char*>(data.get());
+    return {ptr, ptr + length};
+}
+}
+
+TEST(windowed_mmap_backend, straddling_read) {
+    const auto payload = pattern(3 * window_size);
+    const auto file = temporary_file{payload};
+    const auto b = backend{file.filepath()};
+
+    EXPECT_EQ(payload.substr(window_size - 10, 20), read(b, window_size - 10, 20));
+    EXPECT_EQ(payload.substr(10, 2 * window_size + 20), read(b, 10, 2 * window_size + 20));
+
+    auto value = std::uint32_t{};
+    b.read_small(2 * window_size - 2, &value);
+    EXPECT_EQ(0, payload.compare(2 * window_size - 2, sizeof(value),
+                                 reinterpret_cast<const char*>(&value), sizeof(value)));
+}
+
+TEST(windowed_mmap_backend, bounded_windows) {
+    const auto payload = pattern(5 * window_size);
+    const auto file = temporary_file{payload};
+    const auto b = backend{file.filepath()};
+
+    const auto pinned = b.read(42, 10);
+    for (auto i = std::size_t{0}; i < 5; ++i) {
+        EXPECT_EQ(payload.substr(i * window_size + 7, 100), read(b, i * window_size + 7, 100));
+        EXPECT_LE(b.window_count(), 2);
+    }
+
+    /* The evicted window stays mapped while pointed to */
+    EXPECT_EQ(payload.substr(42, 10),
+              std::string(reinterpret_cast<const char*>(pinned.get()), 10));
+}
+
+TEST(windowed_mmap_backend, read_after_append) {
+    const auto file = temporary_file{"hello"};
+    auto b = backend{file.filepath()};
+    EXPECT_EQ("hello", read(b, 0, 5));
+
+    const auto payload = pattern(window_size);
+    b.write(5, payload.size(), reinterpret_cast<const std::uint8_t*>(payload.data()));
+    EXPECT_EQ(5 + window_size, b.size());
+    EXPECT_EQ("hello" + payload.substr(0, 100), read(b, 0, 105));
+    EXPECT_EQ(payload.substr(window_size - 20), read(b, window_size - 15, 20));
+
+    b.truncate(3);
+    EXPECT_EQ(3, b.size());
+    EXPECT_EQ(0, b.window_count());
+    EXPECT_EQ("hel", read(b, 0, 3));
+}
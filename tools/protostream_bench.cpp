@@ -0,0 +1,430 @@
+#include "string_factory.h"
+
+#include "cache.h"
+#include "mmap_backend.h"
+#include "posix_file_backend.h"
+#include "stream.h"
+
+#include <getopt.h>
+
+#include <cinttypes>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace protostream;
+
+namespace {
+using tools::string_factory;
+
+template <class T, file_mode_t Mode>
+struct stream_tag {
+    using type = T;
+    using writable = std::integral_constant<bool, Mode == file_mode_t::READ_APPEND>;
+};
+
+/** The stream type chosen with the command line options */
+struct stream_config {
+    std::string backend = "mmap";
+    std::string cache = "offsets";
+    checksum_mode checksums = checksum_mode::off;
+};
+
+template <class Backend, template <class> class Cache, checksum_mode Checksums>
+using bench_stream = stream<with_backend<Backend>,
+                            with_cache<Cache>,
+                            with_checksums<Checksums>,
+                            with_keyframe_factory<string_factory>,
+                            with_delta_factory<string_factory>,
+                            with_proto_header_factory<string_factory>>;
+
+template <file_mode_t Mode, template <class> class Cache, checksum_mode Checksums, class Fn>
+void with_backend_of(const stream_config& config, Fn&& fn) {
+    if (config.backend == "mmap") {
+        fn(stream_tag<bench_stream<mmap_backend<Mode>, Cache, Checksums>, Mode>{});
+    } else if (config.backend == "posix") {
+        fn(stream_tag<bench_stream<posix_file_backend<Mode>, Cache, Checksums>, Mode>{});
+    } else {
+        throw std::invalid_argument{"Unknown backend: " + config.backend};
+    }
+}
+
+template <file_mode_t Mode, checksum_mode Checksums, class Fn>
+void with_cache_of(const stream_config& config, Fn&& fn) {
+    if (config.cache == "offsets") {
+        with_backend_of<Mode, offsets_only_cache, Checksums>(config, fn);
+    } else if (config.cache == "full") {
+        with_backend_of<Mode, full_cache, Checksums>(config, fn);
+    } else {
+        throw std::invalid_argument{"Unknown cache: " + config.cache};
+    }
+}
+
+/** Calls `fn` with a `stream_tag` of the configured stream type */
+template <file_mode_t Mode, class Fn>
+void with_stream(const stream_config& config, Fn&& fn) {
+    switch (config.checksums) {
+    case checksum_mode::off:
+        return with_cache_of<Mode, checksum_mode::off>(config, fn);
+    case checksum_mode::on_read:
+        return with_cache_of<Mode, checksum_mode::on_read>(config, fn);
+    case checksum_mode::eager:
+        return with_cache_of<Mode, checksum_mode::eager>(config, fn);
+    }
+}
+
+checksum_mode parse_checksums(const std::string& value) {
+    if (value == "off") {
+        return checksum_mode::off;
+    } else if (value == "on_read") {
+        return checksum_mode::on_read;
+    } else if (value == "eager") {
+        return checksum_mode::eager;
+    }
+    throw std::invalid_argument{"Unknown checksum mode: " + value};
+}
+
+std::uint64_t parse_number(const std::string& value) {
+    std::size_t end;
+    const auto number = std::stoull(value, &end);
+    if (end != value.size()) {
+        throw std::invalid_argument{"Invalid number: " + value};
+    }
+    return number;
+}
+
+/** A distribution of frame sizes: "N", "uniform:MIN:MAX" or "exponential:MEAN" */
+class size_distribution {
+public:
+    size_distribution(const std::string& spec, std::size_t max) : max{max} {
+        std::vector<std::string> parts;
+        std::istringstream stream{spec};
+        for (std::string part; std::getline(stream, part, ':');) {
+            parts.push_back(part);
+        }
+
+        if (parts.size() == 1) {
+            uniform = decltype(uniform){parse_number(parts[0]), parse_number(parts[0])};
+        } else if (parts.size() == 3 && parts[0] == "uniform") {
+            const auto low = parse_number(parts[1]);
+            const auto high = parse_number(parts[2]);
+            if (low > high) {
+                throw std::invalid_argument{"Invalid size distribution: " + spec};
+            }
+            uniform = decltype(uniform){low, high};
+        } else if (parts.size() == 2 && parts[0] == "exponential") {
+            exponential = true;
+            mean = parse_number(parts[1]);
+        } else {
+            throw std::invalid_argument{"Invalid size distribution: " + spec};
+        }
+
+        if ((exponential ? mean : uniform.max()) > max) {
+            throw std::invalid_argument{"Frame sizes are limited to " + std::to_string(max)};
+        }
+    }
+
+    template <class Generator>
+    std::size_t operator()(Generator& gen) {
+        if (exponential) {
+            return std::min(static_cast<std::size_t>(
+                                std::exponential_distribution<double>{1.0 / mean}(gen)),
+                            max);
+        }
+        return uniform(gen);
+    }
+
+private:
+    std::size_t max;
+    std::uniform_int_distribution<std::size_t> uniform;
+    bool exponential = false;
+    std::size_t mean = 0;
+};
+
+/** Writes a stream of synthetic frames with pseudo-random payloads */
+template <class Writer>
+void generate(const char* path,
+              std::uint64_t frame_count,
+              std::uint32_t frames_per_kf,
+              size_distribution keyframe_sizes,
+              size_distribution delta_sizes,
+              std::uint64_t seed) {
+    constexpr auto pool_size = std::size_t{1} << 24;
+
+    std::mt19937_64 gen{seed};
+    std::vector<std::uint8_t> pool(pool_size);
+    std::generate(pool.begin(), pool.end(), [&gen] { return static_cast<std::uint8_t>(gen()); });
+
+    /* Payloads are slices of a random pool, at random offsets */
+    const auto next_payload = [&](std::size_t size) {
+        return pool.data() + gen() % (pool_size - size + 1);
+    };
+
+    Writer stream{path, frames_per_kf, "", 0};
+    for (auto frame = std::uint64_t{0}; frame < frame_count; ++frame) {
+        if (frame % frames_per_kf == 0) {
+            const auto size = keyframe_sizes(gen);
+            stream.append_keyframe(next_payload(size), size);
+        } else {
+            const auto size = delta_sizes(gen);
+            stream.append_delta(next_payload(size), size);
+        }
+
+        if ((frame + 1) % (std::uint64_t{1} << 24) == 0) {
+            fprintf(stderr, "%" PRIu64 " frames, %zu bytes\n", frame + 1, stream.file_size());
+        }
+    }
+}
+
+/** A single operation of a trace */
+struct trace_op {
+    std::string name;
+    std::uint64_t argument;
+};
+
+/** Reads a trace: one operation per line, blank lines and lines starting
+ * with '#' being skipped */
+std::vector<trace_op> read_trace(const char* path) {
+    std::ifstream file{path};
+    if (!file) {
+        throw std::runtime_error{std::string{"Cannot open "} + path};
+    }
+
+    std::vector<trace_op> ops;
+    auto line_number = 0;
+    for (std::string line; std::getline(file, line);) {
+        ++line_number;
+        std::istringstream stream{line};
+        trace_op op;
+        if (!(stream >> op.name) || op.name[0] == '#') {
+            continue;
+        }
+
+        std::string extra;
+        if (!(stream >> op.argument) || stream >> extra ||
+            (op.name != "seek" && op.name != "read" && op.name != "append_keyframe" &&
+             op.name != "append_delta")) {
+            throw std::runtime_error{"Invalid trace operation at line " +
+                                     std::to_string(line_number) + ": " + line};
+        }
+        ops.push_back(op);
+    }
+    return ops;
+}
+
+template <class Stream>
+void append_frame(Stream&, const trace_op&, const std::vector<std::uint8_t>&, std::false_type) {
+    throw std::logic_error{"Appending to a read-only stream"};
+}
+
+template <class Stream>
+void append_frame(Stream& stream,
+                  const trace_op& op,
+                  const std::vector<std::uint8_t>& payload,
+                  std::true_type /* writable */) {
+    if (op.argument > payload.size() ||
+        (op.name == "append_delta" && op.argument > std::numeric_limits<delta_size_t>::max())) {
+        throw std::out_of_range{"Appended frame too large"};
+    }
+
+    const auto keyframe_due = stream.frame_count() % stream.frames_per_keyframe() == 0;
+    if ((op.name == "append_keyframe") != keyframe_due) {
+        throw std::logic_error{keyframe_due ? "A keyframe must be appended"
+                                            : "A delta must be appended"};
+    }
+
+    if (op.name == "append_keyframe") {
+        stream.append_keyframe(payload.data(), op.argument);
+    } else {
+        stream.append_delta(payload.data(), op.argument);
+    }
+}
+
+/** Replays `ops` against the stream, returning the latencies of each
+ * operation type in nanoseconds */
+template <class Stream, class Writable>
+std::map<std::string, std::vector<double>> replay(Stream& stream,
+                                                  const std::vector<trace_op>& ops,
+                                                  Writable writable) {
+    const std::vector<std::uint8_t> payload(std::size_t{1} << 24, 0x5a);
+    std::map<std::string, std::vector<double>> latencies;
+
+    for (const auto& op : ops) {
+        const auto start = std::chrono::steady_clock::now();
+
+        if (op.name == "seek") {
+            if (op.argument >= stream.keyframe_count()) {
+                throw std::out_of_range{"Seek past the last keyframe"};
+            }
+            stream.begin()[op.argument].get();
+        } else if (op.name == "read") {
+            if (op.argument >= stream.frame_count()) {
+                throw std::out_of_range{"Read past the last frame"};
+            }
+            const auto keyframe = stream.begin()[op.argument / stream.frames_per_keyframe()];
+            const auto delta = op.argument % stream.frames_per_keyframe();
+            if (delta == 0) {
+                keyframe.get();
+            } else {
+                std::next(keyframe.begin(), delta - 1)->get();
+            }
+        } else {
+            append_frame(stream, op, payload, writable);
+        }
+
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        latencies[op.name].push_back(
+            std::chrono::duration<double, std::nano>{elapsed}.count());
+    }
+
+    return latencies;
+}
+
+void report(std::map<std::string, std::vector<double>> latencies) {
+    printf("%-16s %12s %12s %12s %12s %12s %12s\n", "operation", "count", "p50 [us]", "p90 [us]",
+           "p99 [us]", "p99.9 [us]", "max [us]");
+
+    for (auto& op : latencies) {
+        auto& values = op.second;
+        std::sort(values.begin(), values.end());
+
+        /* Nearest-rank percentiles: the ceil(p / 100 * n)-th smallest value */
+        const auto percentile = [&values](double p) {
+            const auto rank = static_cast<std::size_t>(std::ceil(p * values.size() / 100));
+            return values[std::min(std::max(rank, std::size_t{1}), values.size()) - 1] / 1000;
+        };
+
+        printf("%-16s %12zu %12.2f %12.2f %12.2f %12.2f %12.2f\n", op.first.c_str(),
+               values.size(), percentile(50), percentile(90), percentile(99), percentile(99.9),
+               values.back() / 1000);
+    }
+}
+
+void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [OPTIONS] generate FILE FRAMES FRAMES_PER_KEYFRAME\n"
+            "       %s [OPTIONS] replay FILE TRACE\n"
+            "\n"
+            "generate writes a new stream of FRAMES synthetic frames.\n"
+            "replay runs the operations of TRACE against FILE and reports their latencies.\n"
+            "\n"
+            "Options:\n"
+            "  -b, --backend=mmap|posix        stream backend (default: mmap)\n"
+            "  -c, --cache=offsets|full        keyframe cache (default: offsets)\n"
+            "  -s, --checksums=off|on_read|eager\n"
+            "                                  checksum mode (default: off)\n"
+            "  -k, --keyframe-size=SIZES       keyframe sizes (default: 4096)\n"
+            "  -d, --delta-size=SIZES          delta sizes (default: 256)\n"
+            "  -r, --seed=N                    payload and size seed (default: 0)\n"
+            "\n"
+            "SIZES is either a number N, uniform:MIN:MAX or exponential:MEAN.\n"
+            "\n"
+            "A trace holds one operation per line:\n"
+            "  seek KEYFRAME           reads the keyframe KEYFRAME\n"
+            "  read FRAME              reads the frame FRAME, walking from its keyframe\n"
+            "  append_keyframe SIZE    appends a keyframe of SIZE bytes\n"
+            "  append_delta SIZE       appends a delta of SIZE bytes\n"
+            "Blank lines and lines starting with '#' are skipped.\n",
+            name, name);
+}
+}
+
+int main(int argc, char* argv[]) {
+    const option long_options[] = {{"backend", required_argument, nullptr, 'b'},
+                                   {"cache", required_argument, nullptr, 'c'},
+                                   {"checksums", required_argument, nullptr, 's'},
+                                   {"keyframe-size", required_argument, nullptr, 'k'},
+                                   {"delta-size", required_argument, nullptr, 'd'},
+                                   {"seed", required_argument, nullptr, 'r'},
+                                   {nullptr, 0, nullptr, 0}};
+
+    try {
+        stream_config config;
+        std::string keyframe_sizes = "4096";
+        std::string delta_sizes = "256";
+        std::uint64_t seed = 0;
+
+        int opt;
+        while ((opt = getopt_long(argc, argv, "b:c:s:k:d:r:", long_options, nullptr)) != -1) {
+            switch (opt) {
+            case 'b':
+                config.backend = optarg;
+                break;
+            case 'c':
+                config.cache = optarg;
+                break;
+            case 's':
+                config.checksums = parse_checksums(optarg);
+                break;
+            case 'k':
+                keyframe_sizes = optarg;
+                break;
+            case 'd':
+                delta_sizes = optarg;
+                break;
+            case 'r':
+                seed = parse_number(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+            }
+        }
+
+        const std::vector<std::string> args(argv + optind, argv + argc);
+        if (args.size() == 4 && args[0] == "generate") {
+            const auto frames_per_kf = parse_number(args[3]);
+            if (frames_per_kf == 0 || frames_per_kf > std::numeric_limits<std::uint32_t>::max()) {
+                throw std::invalid_argument{"Invalid number of frames per keyframe: " + args[3]};
+            }
+
+            const size_distribution keyframes{keyframe_sizes, std::size_t{1} << 24};
+            const size_distribution deltas{delta_sizes, std::numeric_limits<delta_size_t>::max()};
+            with_stream<file_mode_t::READ_APPEND>(config, [&](auto tag) {
+                generate<typename decltype(tag)::type>(
+                    args[1].c_str(), parse_number(args[2]),
+                    static_cast<std::uint32_t>(frames_per_kf), keyframes, deltas, seed);
+            });
+        } else if (args.size() == 3 && args[0] == "replay") {
+            const auto ops = read_trace(args[2].c_str());
+            const auto appends = std::any_of(ops.begin(), ops.end(), [](const trace_op& op) {
+                return op.name == "append_keyframe" || op.name == "append_delta";
+            });
+
+            const auto run = [&](auto tag) {
+                typename decltype(tag)::type stream{args[1].c_str()};
+                report(replay(stream, ops, typename decltype(tag)::writable{}));
+            };
+
+            /* Read-only traces do not need write access to the file */
+            if (appends) {
+                with_stream<file_mode_t::READ_APPEND>(config, run);
+            } else {
+                with_stream<file_mode_t::READ_ONLY>(config, run);
+            }
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include "repack_plugin.h"
+#include "string_factory.h"
+
+#include "cache.h"
+#include "mmap_backend.h"
+#include "posix_file_backend.h"
+#include "repack.h"
+#include "stream.h"
+
+#include <dlfcn.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include <exception>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace protostream;
+
+namespace {
+using tools::string_factory;
+
+using reader = stream<with_backend<mmap_backend<file_mode_t::READ_ONLY>>,
+                      with_cache<offsets_only_cache>,
+                      with_keyframe_factory<string_factory>,
+                      with_delta_factory<string_factory>,
+                      with_proto_header_factory<string_factory>>;
+
+using writer = stream<with_backend<posix_file_backend<file_mode_t::READ_APPEND>>,
+                      with_cache<offsets_only_cache>,
+                      with_keyframe_factory<string_factory>,
+                      with_delta_factory<string_factory>,
+                      with_proto_header_factory<string_factory>>;
+
+/** Calls a plugin function, taking the ownership of the buffer it returns */
+template <class Fn, class... Args>
+std::string call(const char* name, Fn fn, Args... args) {
+    void* result = nullptr;
+    std::size_t result_size = 0;
+    if (fn(args..., &result, &result_size) != 0) {
+        throw std::runtime_error{std::string{name} + " failed"};
+    }
+
+    std::string value{static_cast<const char*>(result), result_size};
+    free(result);
+    return value;
+}
+
+std::vector<std::uint8_t> to_payload(const std::string& value) {
+    return {value.begin(), value.end()};
+}
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 5) {
+        fprintf(stderr, "Usage: %s PLUGIN SOURCE DESTINATION FRAMES_PER_KEYFRAME\n\n"
+                        "Copies SOURCE into the new file DESTINATION, placing a keyframe every\n"
+                        "FRAMES_PER_KEYFRAME frames. The keyframes and deltas are synthesized by\n"
+                        "the shared library PLUGIN, see repack_plugin.h.\n",
+                argv[0]);
+        return 1;
+    }
+
+    char* end;
+    const auto frames_per_kf = strtoul(argv[4], &end, 10);
+    if (*end != '\0' || frames_per_kf == 0 ||
+        frames_per_kf > std::numeric_limits<std::uint32_t>::max()) {
+        fprintf(stderr, "Invalid number of frames per keyframe: %s\n", argv[4]);
+        return 1;
+    }
+
+    const auto plugin = dlopen(argv[1], RTLD_NOW);
+    if (!plugin) {
+        fprintf(stderr, "%s\n", dlerror());
+        return 1;
+    }
+
+    const auto apply = reinterpret_cast<decltype(&protostream_repack_apply)>(
+        dlsym(plugin, "protostream_repack_apply"));
+    const auto diff = reinterpret_cast<decltype(&protostream_repack_diff)>(
+        dlsym(plugin, "protostream_repack_diff"));
+    if (!apply || !diff) {
+        fprintf(stderr, "%s does not export the repack functions\n", argv[1]);
+        return 1;
+    }
+
+    try {
+        const reader source{argv[2]};
+        const auto proto_header = source.get_proto_header();
+        writer destination{argv[3], static_cast<std::uint32_t>(frames_per_kf),
+                           proto_header.data(), proto_header.size()};
+
+        repack(source, destination,
+               [apply](std::string& state, const std::string& delta) {
+                   state = call("protostream_repack_apply", apply, state.data(), state.size(),
+                                delta.data(), delta.size());
+               },
+               to_payload,
+               [diff](const std::string& from, const std::string& to) {
+                   return to_payload(call("protostream_repack_diff", diff, from.data(),
+                                          from.size(), to.data(), to.size()));
+               });
+    } catch (const std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    return 0;
+}
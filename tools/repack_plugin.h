@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The functions a plugin of protostream_repack must export.
+ *
+ * The state of a frame is represented by the keyframe payload encoding it.
+ * Both functions store the address of a buffer allocated by malloc() into
+ * *result and its size into *result_size, and return 0 on success. The
+ * buffer is freed by the caller.
+ */
+
+/** Computes the state following `state` by applying `delta` to it */
+int protostream_repack_apply(const void* state,
+                             size_t state_size,
+                             const void* delta,
+                             size_t delta_size,
+                             void** result,
+                             size_t* result_size);
+
+/** Computes the delta turning the state `from` into `to` */
+int protostream_repack_diff(const void* from,
+                            size_t from_size,
+                            const void* to,
+                            size_t to_size,
+                            void** result,
+                            size_t* result_size);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "stream.h"
+
+#include <cstddef>
+#include <string>
+
+namespace tools {
+
+/** Builds frames and proto headers as `std::string` copies of their contents,
+ * for the tools, the tests and the benchmarks */
+struct string_factory {
+    using type = std::string;
+
+    static type build(const char* start, std::size_t len) {
+        return std::string(start, start + len);
+    }
+
+    template <class Ptr>
+    static type build(Ptr&& ptr, std::size_t len) {
+        return build(reinterpret_cast<const char*>(protostream::detail::as_ptr(ptr)), len);
+    }
+};
+}